@@ -0,0 +1,76 @@
+/*********************************************************************
+----------------------------------------------------------------------
+File    : FlashConf.h
+Purpose : Loader build configuration shared by FlashDev.c and
+          FlashPrg.c, may be overridden by preprocessor definitions
+--------  END-OF-HEADER  ---------------------------------------------
+*/
+#ifndef _FLASHCONF_H
+#define _FLASHCONF_H
+
+#include "board.h"
+
+//
+// QSPI NOR flash, memory mapped window of the QUADSPI controller.
+// The size comes from the board selected with BOARD (see hal/board.h).
+//
+#define QSPI_BASE_ADDR          (0x90000000)
+#ifndef QSPI_FLASH_SIZE
+#define QSPI_FLASH_SIZE         (BOARD_FLASH_SIZE)
+#endif
+#define QSPI_SECTOR_SIZE        (0x00001000)   // Smallest erase unit
+#define QSPI_PAGE_SIZE          (256)          // Program page
+//
+// Resumable sessions: the last QSPI sectors hold the progress journal of
+// an interrupted download and a scratch copy (see _JournalScan() in
+// FlashPrg.c). The journal has room for a 16 byte record per QSPI sector,
+// 8 journal sectors for 8 MB. They are not part of the flash device then.
+//
+#ifndef SUPPORT_JOURNAL
+#define SUPPORT_JOURNAL         (0)
+#endif
+#if SUPPORT_JOURNAL
+#define QSPI_JOURNAL_SECTORS    ((QSPI_FLASH_SIZE / QSPI_SECTOR_SIZE * 16 + QSPI_SECTOR_SIZE - 1) / QSPI_SECTOR_SIZE)
+#define QSPI_JOURNAL_SIZE       ((QSPI_JOURNAL_SECTORS + 1) * QSPI_SECTOR_SIZE)
+#else
+#define QSPI_JOURNAL_SECTORS    (0)
+#define QSPI_JOURNAL_SIZE       (0)
+#endif
+#define QSPI_DEVICE_SIZE        (QSPI_FLASH_SIZE - QSPI_JOURNAL_SIZE)
+#define QSPI_JOURNAL_ADDR       (QSPI_BASE_ADDR + QSPI_DEVICE_SIZE)              // First journal sector
+#define QSPI_SCRATCH_ADDR       (QSPI_JOURNAL_ADDR + QSPI_JOURNAL_SECTORS * QSPI_SECTOR_SIZE) // Scratch sector
+//
+// Combined loader, built by the Release_Combined configuration: FlashDevice
+// starts at the internal bank and runs up to the end of QSPI, the entry
+// points route by address. The 2 GB between the banks is described as one
+// dummy sector that EraseSector() skips and that no image has data in.
+//
+#ifndef SUPPORT_INTERNAL_FLASH
+#define SUPPORT_INTERNAL_FLASH  (0)
+#endif
+#define INTERNAL_BASE_ADDR      (0x08000000)
+#ifndef INTERNAL_FLASH_SIZE
+#define INTERNAL_FLASH_SIZE     (0x00020000)   // STM32H750: 1 * 128 KB, STM32H743: 2 MB
+#endif
+#define INTERNAL_SECTOR_SIZE    (0x00020000)   // Smallest erase unit
+#define INTERNAL_WORD_SIZE      (32)           // 256-bit flash word, smallest program unit
+#define INTERNAL_GAP_SIZE       (QSPI_BASE_ADDR - INTERNAL_BASE_ADDR - INTERNAL_FLASH_SIZE)
+//
+// Bytes passed to ProgramPage() per call: one QSPI page, which is also a
+// whole number of internal flash words
+//
+#define DEVICE_PAGE_SIZE        (QSPI_PAGE_SIZE)
+#if DEVICE_PAGE_SIZE % INTERNAL_WORD_SIZE
+#error "DEVICE_PAGE_SIZE must be a multiple of the internal flash word"
+#endif
+
+//
+// Cache state left for execute-in-place by UnInit (read mode, see
+// QSPI_XIP_* in qspi.h): 0 untouched, 1 I-cache, 2 I- and D-cache with
+// the QSPI window mapped cacheable by the MPU
+//
+#ifndef XIP_CACHE
+#define XIP_CACHE               (0)
+#endif
+
+#endif
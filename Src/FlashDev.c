@@ -9,15 +9,23 @@ Purpose : Flash device description Template
 --------  END-OF-HEADER  ---------------------------------------------
 */
 
-#include "FlashOS.H"
+#include "FlashOS.h"
+#include "FlashConf.h"
 
 struct FlashDevice const FlashDevice __attribute__ ((section ("DevDscr"))) =  {
   ALGO_VERSION,              // Algo version
+#if SUPPORT_INTERNAL_FLASH
+  "STM32H7 internal + QSPI", // Flash device name
+  ONCHIP,                    // Flash device type
+  INTERNAL_BASE_ADDR,        // Flash base address
+  QSPI_BASE_ADDR + QSPI_DEVICE_SIZE - INTERNAL_BASE_ADDR, // Total flash device size in Bytes (internal bank up to the end of QSPI)
+#else
   "STM32H7 QSPI", // Flash device name
   ONCHIP,                    // Flash device type
-  0x90000000,                // Flash base address
-  0x00800000,                // Total flash device size in Bytes (8 MB)
-  256,                       // Page Size (number of bytes that will be passed to ProgramPage(). May be multiple of min alignment in order to reduce overhead for calling ProgramPage multiple times
+  QSPI_BASE_ADDR,            // Flash base address
+  QSPI_DEVICE_SIZE,          // Total flash device size in Bytes (8 MB, less the journal)
+#endif
+  DEVICE_PAGE_SIZE,          // Page Size (number of bytes that will be passed to ProgramPage(). May be multiple of min alignment in order to reduce overhead for calling ProgramPage multiple times
   0,                         // Reserved, should be 0
   0xFF,                      // Flash erased value
   100,                       // Program page timeout in ms
@@ -25,6 +33,12 @@ struct FlashDevice const FlashDevice __attribute__ ((section ("DevDscr"))) =  {
   //
   // Flash sector layout definition
   //
-  0x00001000, 0x00000000,   // 4096 *  4 KB =  16 MB
+#if SUPPORT_INTERNAL_FLASH
+  INTERNAL_SECTOR_SIZE, 0x00000000,                   // Bank 0: internal flash, 128 KB sectors
+  INTERNAL_GAP_SIZE, INTERNAL_FLASH_SIZE,             // Gap up to QSPI, one dummy sector
+  QSPI_SECTOR_SIZE, QSPI_BASE_ADDR - INTERNAL_BASE_ADDR, // Bank 1: QSPI, 4 KB sectors
+#else
+  QSPI_SECTOR_SIZE, 0x00000000, // 4 KB sectors
+#endif
   0xFFFFFFFF, 0xFFFFFFFF    // Indicates the end of the flash sector layout. Must be present.
 };
\ No newline at end of file
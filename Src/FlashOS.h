@@ -51,4 +51,37 @@ extern U32 Verify      (U32 Addr, U32 NumBytes, U8 *pSrcBuff);
 //
 // SEGGER defined functions
 //
-extern int SEGGER_OPEN_Read (U32 Addr, U32 NumBytes, U8 *pDestBuff);
\ No newline at end of file
+extern int SEGGER_OPEN_Read (U32 Addr, U32 NumBytes, U8 *pDestBuff);
+
+//
+// Region descriptor of ProgramScatter()
+//
+struct SCATTER_DESC  {
+  U32 Addr;             // Destination address, page aligned (sector aligned with SCATTER_ERASE)
+  U32 NumBytes;         // Length of the region, the last page is padded with 0xFF
+  U32 SrcOff;           // Offset of the region data in the source buffer, unused with SCATTER_FILL
+  U32 Flags;            // SCATTER_* below
+  U32 Status;           // Set by the loader, SCATTER_STATUS_*
+};
+
+#define SCATTER_ERASE           (1 << 0)          // Erase the sectors of the region first
+#define SCATTER_SKIP_EQUAL      (1 << 1)          // Leave sectors (pages without SCATTER_ERASE) that already match alone
+#define SCATTER_FILL            (1 << 2)          // Program the fill byte instead of source data
+#define SCATTER_VERIFY          (1 << 3)          // Read programmed sectors back, during the next erase with SCATTER_ERASE
+#define SCATTER_FILL_VAL(x)     ((U32)(x) << 8)   // Fill byte for SCATTER_FILL
+
+#define SCATTER_STATUS_OK       0                 // Region programmed
+#define SCATTER_STATUS_EQUAL    1                 // Region already matched, nothing written
+#define SCATTER_STATUS_PARAM    2                 // Not in the QSPI bank or misaligned
+#define SCATTER_STATUS_PROGRAM  3                 // Program (or verify-on-write) error
+#define SCATTER_STATUS_VERIFY   4                 // SCATTER_VERIFY found a difference
+#define SCATTER_STATUS_PENDING  0xFFFFFFFF        // Not reached
+
+//
+// Loader extensions, not called by the J-Link DLL (use J-Link script / debugger)
+//
+extern int ProgramCompressed (U32 DestAddr, U32 NumBytes, U8 *pSrcBuff);
+extern int HashRegion        (U32 Addr, U32 NumBytes, U8 *pDigest);
+extern void DualCoreWorker   (void);
+extern int ProgramScatter    (U32 NumDescs, struct SCATTER_DESC *pDesc, U8 *pData);
+extern int FillRange         (U32 Addr, U32 NumBytes, U32 Pattern);
\ No newline at end of file
@@ -8,10 +8,23 @@ File    : FlashPrg.c
 Purpose : Implementation of RAMCode template
 --------  END-OF-HEADER  ---------------------------------------------
 */
-#include "FlashOS.H"
+#include "FlashOS.h"
+#include "FlashConf.h"
 #include "stm32h7_regs.h"
-#include "qspi.h"
-#include "gpio.h"
+#include "flash_bus.h"
+#include "flash.h"
+#include "cache.h"
+#include "board.h"
+#include "lz4_stream.h"
+#include "hash.h"
+#include "sha256.h"
+#include "crc32.h"
+#include "dual_core.h"
+#include "hsem.h"
+#include "erase_sched.h"
+#include "die_sched.h"
+#include "latency.h"
+#include "trace.h"
 
 void clock_setup(void);
 void qspi_init(void);
@@ -33,44 +46,1166 @@ void qspi_init(void);
 #define SUPPORT_NATIVE_VERIFY    (0)
 #define SUPPORT_NATIVE_READ_BACK (0)
 #define SUPPORT_BLANK_CHECK      (0)
+//
+// ProgramCompressed() accepts an LZ4 block stream (see Tools/lz4pack.c) and
+// decompresses it on-target, which cuts the amount of data sent over SWD.
+//
+#define SUPPORT_COMPRESSED_PROGRAM (1)
+//
+// HashRegion() computes a SHA-256 of a flash region on-target (HASH
+// peripheral if the board has one, software otherwise), so that only the
+// 32 byte digest has to be read back for image attestation.
+//
+#define SUPPORT_HASH_REGION      (1)
+//
+// On dual-core devices (STM32H745/H747/H755/H757) ProgramCompressed() can
+// hand decompression, erased page detection and a CRC-32 of the output to
+// the Cortex-M4, see DualCoreWorker(). Falls back to single-core when the
+// M4 does not answer. Needs SUPPORT_COMPRESSED_PROGRAM.
+//
+#define SUPPORT_DUAL_CORE        (0)
+//
+// ProgramScatter() runs a list of region descriptors (erase, program,
+// fill, skip unchanged) in one call, see struct SCATTER_DESC in FlashOS.h.
+//
+#define SUPPORT_SCATTER_PROGRAM  (1)
+//
+// On stacked-die parts (see quadspi_set_mode()) ProgramScatter() runs
+// consecutive SCATTER_ERASE regions without SCATTER_SKIP_EQUAL through
+// the die scheduler, so that one die erases while another programs.
+// Up to SCATTER_DIE_JOBS regions are scheduled together. Needs
+// SUPPORT_SCATTER_PROGRAM. Off by default: no stacked-die part is listed
+// for QUADSPI yet (the W25M512JV needs 4-byte addressing and a per-die
+// read back first), the scheduler only runs against the two-die flash
+// model on the host (Tools/dietest.c).
+//
+#ifndef SUPPORT_MULTI_DIE
+#define SUPPORT_MULTI_DIE        (0)
+#endif
+#define SCATTER_DIE_JOBS         (8)
+//
+// FillRange() programs a 32-bit pattern over a QSPI range from an
+// on-target page buffer, erasing only sectors the pattern cannot be
+// programmed over.
+//
+#define SUPPORT_FILL_RANGE       (1)
+//
+// LatencyMap() returns the per-sector erase times and the page program
+// histogram the bus drivers record with FLASH_BUS_LATENCY=1 (see
+// hal/latency.h) in one transfer, for production QA.
+//
+#define SUPPORT_LATENCY_MAP      (FLASH_BUS_LATENCY)
+//
+// Records every entry point call with its arguments, cycle counter and
+// result into the ring buffer Trace (see trace.h), to be read after a
+// download and replayed on the host with Tools/replay.c. The entry
+// points are compiled under internal names, the public ones at the end
+// of this file record the call around them.
+//
+#ifndef SUPPORT_TRACE
+#define SUPPORT_TRACE            (0)
+#endif
+
+#if SUPPORT_TRACE
+#define Init                     _TracedInit
+#define UnInit                   _TracedUnInit
+#define EraseSector              _TracedEraseSector
+#define ProgramPage              _TracedProgramPage
+#define Verify                   _TracedVerify
+#define BlankCheck               _TracedBlankCheck
+#define SEGGER_OPEN_Read         _TracedRead
+#define ProgramCompressed        _TracedProgramCompressed
+#define ProgramScatter           _TracedProgramScatter
+#define FillRange                _TracedFillRange
+#define HashRegion               _TracedHashRegion
+#define LatencyMap               _TracedLatencyMap
+#endif
+
+/*********************************************************************
+*
+*       Types
+*
+**********************************************************************
+*/
+typedef enum {
+  BANK_NONE,          // Address range not backed by a flash bank
+  BANK_INTERNAL,      // STM32H7 internal flash
+  BANK_QSPI           // External NOR flash on QUADSPI
+} FLASH_BANK;
+
+#if SUPPORT_JOURNAL
+//
+// Journal record, 16 bytes. Records are appended to the journal sectors by
+// programming the page that holds them again, the first one is a header.
+//
+typedef struct {
+  uint32_t Addr;      // Extent offset in the QSPI bank, JOURNAL_MAGIC for the header
+  uint32_t NumBytes;  // Extent length, QSPI_DEVICE_SIZE for the header
+  uint32_t Crc;       // CRC-32 of the extent content after programming
+  uint32_t Check;     // ~(Addr ^ NumBytes ^ Crc), catches torn records
+} JOURNAL_REC;
+
+#define JOURNAL_MAGIC     (0x4C4E524Au)    // "JRNL"
+#define JOURNAL_NUM_RECS  (QSPI_JOURNAL_SECTORS * QSPI_SECTOR_SIZE / sizeof(JOURNAL_REC))
+#define JOURNAL_NONE      (0xFFFFFFFFu)    // No sector in _JournalSector
+#define JOURNAL_RUNS      (8)              // Runs of deferred erases kept in RAM
+
+typedef struct {
+  U32 Start;          // First deferred sector (QSPI offset)
+  U32 End;            // End of the run, Start == End when empty
+} JOURNAL_RUN;
+#endif
+
+/*********************************************************************
+*
+*       Static data
+*
+**********************************************************************
+*/
+//
+// We use this dummy variable to make sure that the PrgData
+// section is present in the output elf-file as this section
+// is mandatory in current versions of the J-Link DLL 
+//
+static volatile int _Dummy;
+
+#if SUPPORT_COMPRESSED_PROGRAM
+static struct lz4_stream _Stream;     // Decoder state + staging window, kept across calls
+static U32 _StreamAddr;               // QSPI offset the current stream is written to
+static U8  _StreamActive;
+#endif
+
+#if SUPPORT_DUAL_CORE
+static struct lz4_stream _DualStream; // Decoder state of the M4
+static struct dual_shared _Dual;      // Job + page ring, shared with the M4
+static U8  _StreamDual;               // Current stream is decoded by the M4
+static U8  _DualNoWorker;             // M4 did not answer, stay single-core
+#endif
+
+#if SUPPORT_SCATTER_PROGRAM
+static U8 _aScatterPage[QSPI_PAGE_SIZE]; // Fill pattern or padded last page of a region
+static struct erase_sched _EraseSched;   // Runs the SCATTER_VERIFY work while erases are suspended
+static const struct SCATTER_DESC *_pVerifyDesc; // Region of the queued verify work
+static const U8 *_pScatterData;           // Source buffer of the current ProgramScatter() call
+static U32 _VerifyOff;                   // Next page to verify, relative to the region
+static U32 _VerifyEnd;                   // End of the programmed pages not verified yet
+static U8  _VerifyFail;
+#endif
+
+#if SUPPORT_MULTI_DIE
+static struct die_job _aDieJob[SCATTER_DIE_JOBS]; // Regions interleaved across the dies
+#endif
+
+#if SUPPORT_FILL_RANGE
+static U8 _aFillPage[QSPI_PAGE_SIZE];    // FillRange() pattern over one page
+static U8 _aFillEdge[QSPI_PAGE_SIZE];    // First/last page of a range, merged with the flash content
+#endif
+
+#if SUPPORT_JOURNAL
+static JOURNAL_REC _aJournalPage[QSPI_PAGE_SIZE / sizeof(JOURNAL_REC)]; // Journal page being appended to, page copied through scratch
+static JOURNAL_RUN _aJournalRun[JOURNAL_RUNS]; // Sectors whose erase was deferred, ascending
+static U32 _JournalNum;                  // Records in the journal, 0 = blank
+static U32 _JournalSector;               // QSPI offset of the sector ProgramPage() works on
+static U32 _JournalMask;                 // Pages of it written or found equal
+static U8  _JournalResume;               // It was completed by a previous session, compare instead of program
+static U8  _JournalError;                // A failed operation since Init(), keep the journal
+#endif
+
+/*********************************************************************
+*
+*       Public data
+*
+**********************************************************************
+*/
+#if FLASH_BUS_VERIFY_ON_WRITE
+//
+// First address that did not read back after programming. Valid when
+// ProgramPage() / ProgramCompressed() returned an error, for debugger scripts.
+//
+U32 ProgramErrorAddr;
+#endif
+
+#if SUPPORT_SCATTER_PROGRAM
+//
+// Erase and erase-suspend statistics of the last ProgramScatter() call.
+// recovered_us is the SCATTER_VERIFY time hidden in suspended erases.
+//
+struct erase_sched_stats EraseStats;
+#endif
+
+#if SUPPORT_MULTI_DIE
+//
+// Die scheduler statistics of the last ProgramScatter() call,
+// busy_us / elapsed_us is the number of dies kept busy on average.
+//
+struct die_sched_stats DieStats;
+#endif
+
+#if SUPPORT_TRACE
+//
+// Call trace of the session, read in one piece by the debugger
+//
+struct trace_buf Trace;
+#endif
+
+#if SUPPORT_JOURNAL
+//
+// Extents recorded by previous sessions, found by Init(), and the erases
+// and page programs skipped because of them since the loader was
+// downloaded. JournalDropped counts sectors that found the journal full,
+// which takes sectors recorded again by several resumed sessions.
+//
+U32 JournalExtents;
+U32 JournalSkippedErases;
+U32 JournalSkippedPages;
+U32 JournalDropped;
+#endif
+
+#if SUPPORT_DUAL_CORE
+//
+// CRC-32 (as zlib) of the pages of the current ProgramCompressed() stream
+// programmed so far, including the 0xFF padding of the last page. Only
+// computed when the stream is decoded by the M4.
+//
+U32 StreamCrc;
+#endif
+
+/*********************************************************************
+*
+*       Static code
+*
+**********************************************************************
+*/
+
+/*********************************************************************
+*
+*       _FeedWatchdog
+*
+*  Function description
+*    Feeds the watchdog. Needs to be called during RAMCode execution
+*    in case of an watchdog is active.
+*/
+static void _FeedWatchdog(void) {
+}
+
+#if SUPPORT_COMPRESSED_PROGRAM
+/*********************************************************************
+*
+*       _ProgramStaged
+*
+*  Function description
+*    Decoder sink, programs one decompressed page from the staging window.
+*/
+static int _ProgramStaged(uint32_t Offset, const uint8_t *pPage) {
+  int n;
+
+  n = flash_bus_write(_StreamAddr + Offset, (uint8_t *)pPage, LZ4_PAGE_SIZE);
+  if (n != LZ4_PAGE_SIZE) {
+#if FLASH_BUS_VERIFY_ON_WRITE
+    ProgramErrorAddr = QSPI_BASE_ADDR + _StreamAddr + Offset + n;
+#endif
+    return -1;
+  }
+  return 0;
+}
+#endif
+
+#if SUPPORT_DUAL_CORE
+/*********************************************************************
+*
+*       _DualRun
+*
+*  Function description
+*    Runs one job on the M4 and programs the pages it produces.
+*
+*  Return value
+*    0 O.K.
+*    1 Error
+*    DUAL_NO_WORKER The M4 did not take or finish the job
+*/
+static int _DualRun(U32 Cmd, const U8 *pSrc, U32 NumBytes) {
+  uint32_t Crc;
+  int r;
+
+  r = dual_run(&_Dual, Cmd, pSrc, NumBytes, _ProgramStaged, &Crc);
+  if (r == DUAL_NO_WORKER) {
+    return r;
+  }
+  StreamCrc = Crc;
+  return r ? 1 : 0;
+}
+
+/*********************************************************************
+*
+*       _DualStart
+*
+*  Function description
+*    Starts a new stream on the M4 with an empty job.
+*
+*  Return value
+*    1 The M4 decodes the stream
+*    0 No worker, decode on the M7
+*/
+static int _DualStart(void) {
+  if (_DualNoWorker) {
+    return 0;
+  }
+  hsem_init();
+  dual_init(&_Dual, &_DualStream);
+  if (_DualRun(DUAL_CMD_START, 0, 0) == DUAL_NO_WORKER) {
+    _DualNoWorker = 1;            // A late M4 must not see a reset ring
+    return 0;
+  }
+  return 1;
+}
+#endif
+
+#if FLASH_BUS_VERIFY_ON_WRITE && SUPPORT_INTERNAL_FLASH
+/*********************************************************************
+*
+*       _CompareMapped
+*
+*  Function description
+*    Compares memory mapped flash with the source buffer.
+*
+*  Return value
+*    Number of bytes that match before the first difference
+*/
+static U32 _CompareMapped(U32 Addr, U32 NumBytes, const U8 *pBuff) {
+  const volatile U8 *pFlash;
+  U32 i;
+
+  pFlash = (const volatile U8 *)Addr;
+  for (i = 0; i < NumBytes; i++) {
+    if (pFlash[i] != pBuff[i]) {
+      break;
+    }
+  }
+  return i;
+}
+#endif
+
+/*********************************************************************
+*
+*       _GetBank
+*
+*  Function description
+*    Routes an address range to the flash bank that contains it.
+*/
+static FLASH_BANK _GetBank(U32 Addr, U32 NumBytes) {
+  if (Addr >= QSPI_BASE_ADDR && Addr - QSPI_BASE_ADDR + NumBytes <= QSPI_DEVICE_SIZE) {
+    return BANK_QSPI;
+  }
+#if SUPPORT_INTERNAL_FLASH
+  if (Addr >= INTERNAL_BASE_ADDR && Addr - INTERNAL_BASE_ADDR + NumBytes <= INTERNAL_FLASH_SIZE) {
+    return BANK_INTERNAL;
+  }
+#endif
+  return BANK_NONE;
+}
+
+#if SUPPORT_SCATTER_PROGRAM
+/*********************************************************************
+*
+*       _ScatterPage
+*
+*  Function description
+*    Returns the content of one page of a region, staged in
+*    _aScatterPage unless it can be programmed from the source directly.
+*/
+static const U8 *_ScatterPage(const struct SCATTER_DESC *pDesc, const U8 *pData, U32 Off) {
+  const U8 *pSrc;
+  U32 n;
+  U32 i;
+
+  n = pDesc->NumBytes - Off;
+  if (n > QSPI_PAGE_SIZE) {
+    n = QSPI_PAGE_SIZE;
+  }
+  pSrc = pData + pDesc->SrcOff + Off;
+  if ((pDesc->Flags & SCATTER_FILL) == 0 && n == QSPI_PAGE_SIZE) {
+    return pSrc;
+  }
+  for (i = 0; i < QSPI_PAGE_SIZE; i++) {
+    if (i >= n) {
+      _aScatterPage[i] = 0xFF;
+    } else if (pDesc->Flags & SCATTER_FILL) {
+      _aScatterPage[i] = (U8)(pDesc->Flags >> 8);
+    } else {
+      _aScatterPage[i] = pSrc[i];
+    }
+  }
+  return _aScatterPage;
+}
+
+/*********************************************************************
+*
+*       _ScatterEqual
+*
+*  Function description
+*    Checks whether the memory mapped flash already holds the pages
+*    [Off, Off + NumBytes) of a region.
+*/
+static int _ScatterEqual(const struct SCATTER_DESC *pDesc, const U8 *pData, U32 Off, U32 NumBytes) {
+  const U8 *pPage;
+  const U8 *pFlash;
+  U32 End;
+  U32 i;
+
+  flash_bus_mmap();
+  End = Off + NumBytes;
+  for (; Off < End; Off += QSPI_PAGE_SIZE) {
+    pPage = _ScatterPage(pDesc, pData, Off);
+    pFlash = flash_bus_ptr(pDesc->Addr + Off);
+    for (i = 0; i < QSPI_PAGE_SIZE; i++) {
+      if (pFlash[i] != pPage[i]) {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+/*********************************************************************
+*
+*       _ScatterVerifyPage
+*
+*  Function description
+*    Work function of _EraseSched: compares the next queued page with
+*    the memory mapped flash. Never reads the sector being erased, as
+*    only programmed sectors are queued.
+*
+*  Return value
+*    0 Queue empty
+*    1 More pages queued
+*/
+static int _ScatterVerifyPage(void *pCtx) {
+  const U8 *pPage;
+  const U8 *pFlash;
+  U32 i;
+
+  (void)pCtx;
+  if (_VerifyOff >= _VerifyEnd) {
+    return 0;
+  }
+  pPage = _ScatterPage(_pVerifyDesc, _pScatterData, _VerifyOff);
+  flash_bus_mmap();
+  pFlash = flash_bus_ptr(_pVerifyDesc->Addr + _VerifyOff);
+  flash_bus_account_read(QSPI_PAGE_SIZE);
+  for (i = 0; i < QSPI_PAGE_SIZE; i++) {
+    if (pFlash[i] != pPage[i]) {
+      _VerifyFail = 1;
+#if FLASH_BUS_VERIFY_ON_WRITE
+      ProgramErrorAddr = _pVerifyDesc->Addr + _VerifyOff + i;
+#endif
+      break;
+    }
+  }
+  _VerifyOff += QSPI_PAGE_SIZE;
+  return _VerifyOff < _VerifyEnd;
+}
+
+/*********************************************************************
+*
+*       _ScatterQueueVerify
+*
+*  Function description
+*    Queues the programmed pages [Off, End) of a region for
+*    _ScatterVerifyPage(). Pages still queued that do not directly
+*    precede them are verified first.
+*/
+static void _ScatterQueueVerify(U32 Off, U32 End) {
+  if (_VerifyOff < _VerifyEnd && _VerifyEnd != Off) {
+    erase_sched_drain(&_EraseSched);
+  }
+  if (_VerifyOff >= _VerifyEnd) {
+    _VerifyOff = Off;
+  }
+  _VerifyEnd = End;
+  erase_sched_kick(&_EraseSched);
+}
+
+/*********************************************************************
+*
+*       _ScatterRegion
+*
+*  Function description
+*    Erases and programs one region, sector by sector with
+*    SCATTER_ERASE, page by page otherwise. With SCATTER_VERIFY the
+*    pages of a programmed sector are read back while the erase of
+*    the next one is suspended, the rest after the last sector.
+*
+*  Return value
+*    SCATTER_STATUS_*
+*/
+static U32 _ScatterRegion(const struct SCATTER_DESC *pDesc, const U8 *pData) {
+  const U8 *pPage;
+  U32 Off;
+  U32 End;
+  U32 Unit;
+  U32 PageOff;
+  U32 Written;
+  int n;
+
+  if (pDesc->NumBytes == 0) {
+    return SCATTER_STATUS_OK;
+  }
+  if (_GetBank(pDesc->Addr, pDesc->NumBytes) != BANK_QSPI || (pDesc->Addr & (QSPI_PAGE_SIZE - 1))) {
+    return SCATTER_STATUS_PARAM;
+  }
+  Unit = QSPI_PAGE_SIZE;
+  if (pDesc->Flags & SCATTER_ERASE) {
+    if ((pDesc->Addr | pDesc->NumBytes) & (QSPI_SECTOR_SIZE - 1)) {
+      return SCATTER_STATUS_PARAM;
+    }
+    Unit = QSPI_SECTOR_SIZE;
+  }
+  Written = 0;
+  _pVerifyDesc = pDesc;
+  _VerifyOff = 0;
+  _VerifyEnd = 0;
+  _VerifyFail = 0;
+  for (Off = 0; Off < pDesc->NumBytes; Off += Unit) {
+    End = Off + Unit;
+    if (End > pDesc->NumBytes) {
+      End = (pDesc->NumBytes + QSPI_PAGE_SIZE - 1) & ~(U32)(QSPI_PAGE_SIZE - 1);
+    }
+    if ((pDesc->Flags & SCATTER_SKIP_EQUAL) && _ScatterEqual(pDesc, pData, Off, End - Off)) {
+      continue;
+    }
+    if (pDesc->Flags & SCATTER_ERASE) {
+      erase_sched_sector(&_EraseSched, pDesc->Addr + Off - QSPI_BASE_ADDR);
+    }
+    for (PageOff = Off; PageOff < End; PageOff += QSPI_PAGE_SIZE) {
+      pPage = _ScatterPage(pDesc, pData, PageOff);
+      if (pDesc->Flags & SCATTER_ERASE) {
+        //
+        // Freshly erased, nothing to do for blank pages
+        //
+        for (n = 0; n < QSPI_PAGE_SIZE && pPage[n] == 0xFF; n++) {
+        }
+        if (n == QSPI_PAGE_SIZE) {
+          continue;
+        }
+      }
+      n = flash_bus_write(pDesc->Addr + PageOff - QSPI_BASE_ADDR, (uint8_t *)pPage, QSPI_PAGE_SIZE);
+      if (n != QSPI_PAGE_SIZE) {
+#if FLASH_BUS_VERIFY_ON_WRITE
+        ProgramErrorAddr = pDesc->Addr + PageOff + n;
+#endif
+        _VerifyEnd = 0;
+        erase_sched_drain(&_EraseSched);
+        return SCATTER_STATUS_PROGRAM;
+      }
+    }
+    if (pDesc->Flags & SCATTER_VERIFY) {
+      _ScatterQueueVerify(Off, End);
+    }
+    Written = 1;
+    _FeedWatchdog();
+  }
+  erase_sched_drain(&_EraseSched);
+  if (_VerifyFail) {
+    return SCATTER_STATUS_VERIFY;
+  }
+  return Written ? SCATTER_STATUS_OK : SCATTER_STATUS_EQUAL;
+}
+#endif
+
+#if SUPPORT_MULTI_DIE
+/*********************************************************************
+*
+*       _ScatterDiePage
+*
+*  Function description
+*    Page callback of die_sched_run(), 0 for blank pages.
+*/
+static const uint8_t *_ScatterDiePage(void *pCtx, uint32_t Off) {
+  const U8 *pPage;
+  int n;
+
+  pPage = _ScatterPage((const struct SCATTER_DESC *)pCtx, _pScatterData, Off);
+  for (n = 0; n < QSPI_PAGE_SIZE && pPage[n] == 0xFF; n++) {
+  }
+  return (n == QSPI_PAGE_SIZE) ? 0 : pPage;
+}
+
+/*********************************************************************
+*
+*       _ScatterIsDieJob
+*
+*  Function description
+*    Checks whether a region can be run by the die scheduler:
+*    SCATTER_ERASE without SCATTER_SKIP_EQUAL, sector aligned in the
+*    QSPI bank.
+*/
+static int _ScatterIsDieJob(const struct SCATTER_DESC *pDesc) {
+  if ((pDesc->Flags & (SCATTER_ERASE | SCATTER_SKIP_EQUAL)) != SCATTER_ERASE || pDesc->NumBytes == 0) {
+    return 0;
+  }
+  if (_GetBank(pDesc->Addr, pDesc->NumBytes) != BANK_QSPI) {
+    return 0;
+  }
+  if ((pDesc->Addr | pDesc->NumBytes) & (QSPI_SECTOR_SIZE - 1)) {
+    return 0;
+  }
+  return 1;
+}
+
+/*********************************************************************
+*
+*       _ScatterDieRun
+*
+*  Function description
+*    Erases and programs the regions queued in _aDieJob across the
+*    dies, then reads them back. Die scheduler writes are not verified
+*    on write, so FLASH_BUS_VERIFY_ON_WRITE implies SCATTER_VERIFY.
+*/
+static void _ScatterDieRun(U32 NumJobs) {
+  struct SCATTER_DESC *pDesc;
+  U32 i;
+
+  die_sched_run(_aDieJob, (int)NumJobs, _ScatterDiePage, &DieStats);
+  for (i = 0; i < NumJobs; i++) {
+    pDesc = (struct SCATTER_DESC *)_aDieJob[i].ctx;
+    pDesc->Status = SCATTER_STATUS_OK;
+    if ((pDesc->Flags & SCATTER_VERIFY) || FLASH_BUS_VERIFY_ON_WRITE) {
+      _pVerifyDesc = pDesc;
+      _VerifyOff = 0;
+      _VerifyEnd = pDesc->NumBytes;
+      _VerifyFail = 0;
+      erase_sched_kick(&_EraseSched);
+      erase_sched_drain(&_EraseSched);
+      if (_VerifyFail) {
+        pDesc->Status = (pDesc->Flags & SCATTER_VERIFY) ? SCATTER_STATUS_VERIFY : SCATTER_STATUS_PROGRAM;
+      }
+    }
+    _FeedWatchdog();
+  }
+}
+#endif
+
+#if SUPPORT_FILL_RANGE
+/*********************************************************************
+*
+*       _FillCheck
+*
+*  Function description
+*    Compares the memory mapped flash with the fill pattern.
+*
+*  Return value
+*    0 Flash already holds the pattern
+*    1 Pattern can be programmed over the flash content
+*    2 Needs an erase, the pattern has bits set that are 0 in flash
+*/
+static int _FillCheck(U32 Addr, U32 NumBytes) {
+  const U8 *pFlash;
+  U8 Pat;
+  U32 i;
+  int r;
+
+  flash_bus_mmap();
+  pFlash = flash_bus_ptr(Addr);
+  r = 0;
+  for (i = 0; i < NumBytes; i++) {
+    Pat = _aFillPage[(Addr + i) & (QSPI_PAGE_SIZE - 1)];
+    if (pFlash[i] != Pat) {
+      if ((pFlash[i] & Pat) != Pat) {
+        return 2;
+      }
+      r = 1;
+    }
+  }
+  return r;
+}
+
+/*********************************************************************
+*
+*       _FillSector
+*
+*  Function description
+*    Fills the part [Addr, Addr + NumBytes) of one sector with the
+*    pattern. Pages that already hold it are skipped, the sector is
+*    only erased when the pattern cannot be programmed over it.
+*
+*  Return value
+*    0 O.K.
+*    1 Error, or an erase would destroy data outside the range
+*/
+static int _FillSector(U32 Addr, U32 NumBytes) {
+  const U8 *pFlash;
+  const U8 *pPage;
+  U32 End;
+  U32 Page;
+  U32 From;
+  U32 To;
+  U32 i;
+  int Erased;
+  int n;
+
+  n = _FillCheck(Addr, NumBytes);
+  if (n == 0) {
+    return 0;
+  }
+  Erased = 0;
+  if (n == 2) {
+    if ((Addr | NumBytes) & (QSPI_SECTOR_SIZE - 1)) {
+      return 1;
+    }
+    flash_bus_erase_sector(Addr - QSPI_BASE_ADDR);
+    Erased = 1;
+  }
+  End = Addr + NumBytes;
+  for (Page = Addr & ~(U32)(QSPI_PAGE_SIZE - 1); Page < End; Page += QSPI_PAGE_SIZE) {
+    From = Page < Addr ? Addr : Page;
+    To = Page + QSPI_PAGE_SIZE > End ? End : Page + QSPI_PAGE_SIZE;
+    if (Erased) {
+      for (i = 0; i < QSPI_PAGE_SIZE && _aFillPage[i] == 0xFF; i++) {
+      }
+      if (i == QSPI_PAGE_SIZE) {
+        break;                          // Pattern is the erased value
+      }
+    } else if (_FillCheck(From, To - From) == 0) {
+      continue;
+    }
+    pPage = _aFillPage;
+    if (From != Page || To != Page + QSPI_PAGE_SIZE) {
+      //
+      // Edge of the range: reprogram the bytes outside with what they
+      // hold, which leaves them unchanged and lets verify-on-write pass
+      //
+      flash_bus_mmap();
+      pFlash = flash_bus_ptr(Page);
+      for (i = 0; i < QSPI_PAGE_SIZE; i++) {
+        _aFillEdge[i] = (Page + i >= From && Page + i < To) ? _aFillPage[i] : pFlash[i];
+      }
+      pPage = _aFillEdge;
+    }
+    n = flash_bus_write(Page - QSPI_BASE_ADDR, (uint8_t *)pPage, QSPI_PAGE_SIZE);
+    if (n != QSPI_PAGE_SIZE) {
+#if FLASH_BUS_VERIFY_ON_WRITE
+      ProgramErrorAddr = Page + n;
+#endif
+      return 1;
+    }
+  }
+  return 0;
+}
+#endif
+
+#if SUPPORT_JOURNAL
+/*********************************************************************
+*
+*       _JournalRec
+*
+*  Function description
+*    Returns a record of the journal, memory mapped.
+*/
+static const JOURNAL_REC *_JournalRec(U32 Index) {
+  return (const JOURNAL_REC *)flash_bus_ptr(QSPI_JOURNAL_ADDR + Index * sizeof(JOURNAL_REC));
+}
+
+/*********************************************************************
+*
+*       _JournalErase
+*
+*  Function description
+*    Erases the journal sectors that are not blank.
+*/
+static void _JournalErase(void) {
+  const U8 *pFlash;
+  U32 Addr;
+  U32 i;
+
+  for (Addr = QSPI_JOURNAL_ADDR; Addr < QSPI_SCRATCH_ADDR; Addr += QSPI_SECTOR_SIZE) {
+    flash_bus_mmap();
+    flash_bus_account_read(QSPI_SECTOR_SIZE);
+    pFlash = flash_bus_ptr(Addr);
+    for (i = 0; i < QSPI_SECTOR_SIZE && pFlash[i] == 0xFF; i++) {
+    }
+    if (i != QSPI_SECTOR_SIZE) {
+      flash_bus_erase_sector(Addr - QSPI_BASE_ADDR);
+    }
+  }
+}
+
+/*********************************************************************
+*
+*       _JournalScan
+*
+*  Function description
+*    Counts the records of the journal. A journal of another device
+*    layout or with a torn header is erased.
+*
+*  Return value
+*    Number of extents recorded
+*/
+static U32 _JournalScan(void) {
+  const JOURNAL_REC *pRec;
+  U32 i;
+
+  flash_bus_mmap();
+  pRec = _JournalRec(0);
+  _JournalNum = 0;
+  if (pRec->Addr == 0xFFFFFFFFu) {
+    return 0;
+  }
+  if (pRec->Addr != JOURNAL_MAGIC || pRec->NumBytes != QSPI_DEVICE_SIZE ||
+      pRec->Check != ~(pRec->Addr ^ pRec->NumBytes ^ pRec->Crc)) {
+    _JournalErase();
+    return 0;
+  }
+  for (i = 1; i < JOURNAL_NUM_RECS; i++) {
+    if (_JournalRec(i)->Addr == 0xFFFFFFFFu) {
+      break;
+    }
+  }
+  _JournalNum = i;
+  return i - 1;
+}
+
+/*********************************************************************
+*
+*       _JournalIntact
+*
+*  Function description
+*    Checks whether a sector was completed by a previous session and
+*    still holds the content recorded then. The latest record wins.
+*/
+static int _JournalIntact(U32 Off) {
+  const JOURNAL_REC *pRec;
+  U32 i;
+
+  flash_bus_mmap();
+  for (i = _JournalNum; i > 1; i--) {
+    pRec = _JournalRec(i - 1);
+    if (pRec->Addr != Off || pRec->NumBytes != QSPI_SECTOR_SIZE ||
+        pRec->Check != ~(pRec->Addr ^ pRec->NumBytes ^ pRec->Crc)) {
+      continue;
+    }
+    flash_bus_account_read(QSPI_SECTOR_SIZE);
+    return crc32(0, flash_bus_ptr(QSPI_BASE_ADDR + Off), QSPI_SECTOR_SIZE) == pRec->Crc;
+  }
+  return 0;
+}
+
+/*********************************************************************
+*
+*       _JournalWrite
+*
+*  Function description
+*    Programs one record. The page holding it is programmed again with
+*    its current content, only the new record clears bits.
+*
+*  Return value
+*    0 O.K., 1 Error
+*/
+static int _JournalWrite(U32 Index, U32 Addr, U32 NumBytes, U32 Crc) {
+  JOURNAL_REC *pRec;
+  const U8 *pFlash;
+  U8 *pPage;
+  U32 Page;
+  U32 i;
+
+  Page = QSPI_JOURNAL_ADDR + (Index * sizeof(JOURNAL_REC) & ~(U32)(QSPI_PAGE_SIZE - 1));
+  flash_bus_mmap();
+  pFlash = flash_bus_ptr(Page);
+  pPage = (U8 *)_aJournalPage;
+  for (i = 0; i < QSPI_PAGE_SIZE; i++) {
+    pPage[i] = pFlash[i];
+  }
+  pRec = &_aJournalPage[Index % (QSPI_PAGE_SIZE / sizeof(JOURNAL_REC))];
+  pRec->Addr = Addr;
+  pRec->NumBytes = NumBytes;
+  pRec->Crc = Crc;
+  pRec->Check = ~(Addr ^ NumBytes ^ Crc);
+  return flash_bus_write(Page - QSPI_BASE_ADDR, pPage, QSPI_PAGE_SIZE) != QSPI_PAGE_SIZE;
+}
+
+/*********************************************************************
+*
+*       _JournalAppend
+*
+*  Function description
+*    Records a completed sector, writing the header first on a blank
+*    journal. A failed write stops recording for the session and keeps
+*    the journal, a torn record fails its check word.
+*/
+static void _JournalAppend(U32 Off) {
+  U32 Crc;
+
+  if (_JournalNum == 0) {
+    if (_JournalWrite(0, JOURNAL_MAGIC, QSPI_DEVICE_SIZE, 0)) {
+      _JournalError = 1;
+      return;
+    }
+    _JournalNum = 1;
+  }
+  if (_JournalNum == JOURNAL_NUM_RECS) {
+    JournalDropped++;
+    return;
+  }
+  flash_bus_mmap();
+  flash_bus_account_read(QSPI_SECTOR_SIZE);
+  Crc = crc32(0, flash_bus_ptr(QSPI_BASE_ADDR + Off), QSPI_SECTOR_SIZE);
+  if (_JournalWrite(_JournalNum, Off, QSPI_SECTOR_SIZE, Crc)) {
+    _JournalError = 1;
+    return;
+  }
+  _JournalNum++;
+}
+
+/*********************************************************************
+*
+*       _JournalCopy
+*
+*  Function description
+*    Copies one page between QSPI sectors through _aJournalPage.
+*
+*  Return value
+*    0 O.K., 1 Error
+*/
+static int _JournalCopy(U32 Dest, U32 Src) {
+  const U8 *pFlash;
+  U8 *pPage;
+  U32 i;
+
+  flash_bus_mmap();
+  pFlash = flash_bus_ptr(QSPI_BASE_ADDR + Src);
+  pPage = (U8 *)_aJournalPage;
+  for (i = 0; i < QSPI_PAGE_SIZE; i++) {
+    pPage[i] = pFlash[i];
+  }
+  return flash_bus_write(Dest, pPage, QSPI_PAGE_SIZE) != QSPI_PAGE_SIZE;
+}
+
+/*********************************************************************
+*
+*       _JournalRestore
+*
+*  Function description
+*    Erases a sector whose erase was deferred, keeping the pages in
+*    Mask (already found equal to the new image) through the scratch
+*    sector.
+*
+*  Return value
+*    0 O.K., 1 Error
+*/
+static int _JournalRestore(U32 Off, U32 Mask) {
+  U32 Scratch;
+  U32 i;
+
+  Scratch = QSPI_SCRATCH_ADDR - QSPI_BASE_ADDR;
+  if (Mask) {
+    flash_bus_erase_sector(Scratch);
+    for (i = 0; i < QSPI_SECTOR_SIZE / QSPI_PAGE_SIZE; i++) {
+      if ((Mask & (1u << i)) && _JournalCopy(Scratch + i * QSPI_PAGE_SIZE, Off + i * QSPI_PAGE_SIZE)) {
+        return 1;
+      }
+    }
+  }
+  flash_bus_erase_sector(Off);
+  for (i = 0; i < QSPI_SECTOR_SIZE / QSPI_PAGE_SIZE; i++) {
+    if ((Mask & (1u << i)) && _JournalCopy(Off + i * QSPI_PAGE_SIZE, Scratch + i * QSPI_PAGE_SIZE)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*********************************************************************
+*
+*       _JournalDefer
+*
+*  Function description
+*    Defers the erase of a sector completed by a previous session, the
+*    program pass then compares instead of programming.
+*
+*  Return value
+*    1 Deferred, 0 Erase now
+*
+*  Notes
+*    (1) The deferred erases are done by ProgramPage() or UnInit(2), a
+*        session without a program phase leaves these sectors as they
+*        are. ProgramCompressed(), ProgramScatter() and FillRange() are
+*        not journaled.
+*/
+static int _JournalDefer(U32 Off) {
+  JOURNAL_RUN *pRun;
+  U32 i;
+
+  if (_JournalNum < 2 || !_JournalIntact(Off)) {
+    return 0;
+  }
+  for (i = 0; i < JOURNAL_RUNS; i++) {
+    pRun = &_aJournalRun[i];
+    if (pRun->Start != pRun->End && pRun->End == Off) {
+      pRun->End += QSPI_SECTOR_SIZE;
+      return 1;
+    }
+  }
+  for (i = 0; i < JOURNAL_RUNS; i++) {
+    pRun = &_aJournalRun[i];
+    if (pRun->Start == pRun->End) {
+      pRun->Start = Off;
+      pRun->End = Off + QSPI_SECTOR_SIZE;
+      return 1;
+    }
+  }
+  return 0;
+}
 
 /*********************************************************************
 *
-*       Types
+*       _JournalTake
 *
-**********************************************************************
+*  Function description
+*    Called when programming reaches a sector. Deferred sectors below
+*    it were passed over by the program pass and are erased now.
+*
+*  Return value
+*    1 The erase of the sector was deferred
+*    0 Regular sector
+*   -1 Error
 */
+static int _JournalTake(U32 Off) {
+  JOURNAL_RUN *pRun;
+  U32 i;
+  int r;
+
+  r = 0;
+  for (i = 0; i < JOURNAL_RUNS; i++) {
+    pRun = &_aJournalRun[i];
+    while (pRun->Start != pRun->End && pRun->Start <= Off) {
+      if (pRun->Start == Off) {
+        r = 1;
+      } else if (_JournalRestore(pRun->Start, 0)) {
+        return -1;
+      }
+      pRun->Start += QSPI_SECTOR_SIZE;
+    }
+  }
+  return r;
+}
 
 /*********************************************************************
 *
-*       Static data
+*       _JournalClose
 *
-**********************************************************************
+*  Function description
+*    Finishes the sector ProgramPage() worked on. A resumed sector with
+*    pages the session did not program gets them erased, as a regular
+*    erase would have. A programmed sector is recorded.
 */
-//
-// We use this dummy variable to make sure that the PrgData
-// section is present in the output elf-file as this section
-// is mandatory in current versions of the J-Link DLL 
-//
-static volatile int _Dummy;
+static void _JournalClose(void) {
+  const U8 *pFlash;
+  U32 i;
+  U32 j;
+
+  if (_JournalSector == JOURNAL_NONE) {
+    return;
+  }
+  for (i = 0; _JournalResume && i < QSPI_SECTOR_SIZE / QSPI_PAGE_SIZE; i++) {
+    if (_JournalMask & (1u << i)) {
+      continue;
+    }
+    flash_bus_mmap();
+    pFlash = flash_bus_ptr(QSPI_BASE_ADDR + _JournalSector + i * QSPI_PAGE_SIZE);
+    for (j = 0; j < QSPI_PAGE_SIZE && pFlash[j] == 0xFF; j++) {
+    }
+    if (j != QSPI_PAGE_SIZE) {
+      _JournalResume = 0;
+      if (_JournalRestore(_JournalSector, _JournalMask)) {
+        _JournalError = 1;
+      }
+    }
+  }
+  if (!_JournalResume && !_JournalError) {
+    _JournalAppend(_JournalSector);
+  }
+  _JournalSector = JOURNAL_NONE;
+}
 
 /*********************************************************************
 *
-*       Static code
+*       _JournalProgram
 *
-**********************************************************************
+*  Function description
+*    ProgramPage() for the QSPI bank with the journal. Pages of a
+*    resumed sector that match are skipped, the first one that does not
+*    turns it back into a regular sector.
+*
+*  Return value
+*    Number of bytes programmed or skipped
 */
+static U32 _JournalProgram(U32 Addr, U32 NumBytes, U8 *pSrc) {
+  const U8 *pFlash;
+  U32 Done;
+  U32 Off;
+  U32 Page;
+  U32 i;
+  int r;
+
+  for (Done = 0; Done < NumBytes; Done += QSPI_PAGE_SIZE) {
+    Off = Addr + Done - QSPI_BASE_ADDR;
+    if ((Off & ~(U32)(QSPI_SECTOR_SIZE - 1)) != _JournalSector) {
+      _JournalClose();
+      _JournalSector = Off & ~(U32)(QSPI_SECTOR_SIZE - 1);
+      _JournalMask = 0;
+      r = _JournalTake(_JournalSector);
+      if (r < 0) {
+        _JournalError = 1;
+        return Done;
+      }
+      _JournalResume = (U8)r;
+    }
+    Page = 1u << ((Off - _JournalSector) / QSPI_PAGE_SIZE);
+    if (_JournalResume) {
+      flash_bus_mmap();
+      flash_bus_account_read(QSPI_PAGE_SIZE);
+      pFlash = flash_bus_ptr(Addr + Done);
+      for (i = 0; i < QSPI_PAGE_SIZE && pFlash[i] == pSrc[Done + i]; i++) {
+      }
+      if (i == QSPI_PAGE_SIZE) {
+        _JournalMask |= Page;
+        JournalSkippedPages++;
+        continue;
+      }
+      _JournalResume = 0;
+      if (_JournalRestore(_JournalSector, _JournalMask)) {
+        _JournalError = 1;
+        return Done;
+      }
+    }
+    _JournalMask |= Page;
+    i = flash_bus_write(Off, pSrc + Done, QSPI_PAGE_SIZE);
+    if (i != QSPI_PAGE_SIZE) {
+      _JournalError = 1;
+      return Done + i;
+    }
+  }
+  return NumBytes;
+}
 
 /*********************************************************************
 *
-*       _FeedWatchdog
+*       _JournalFinish
 *
 *  Function description
-*    Feeds the watchdog. Needs to be called during RAMCode execution
-*    in case of an watchdog is active.
+*    End of a program pass: erases deferred sectors it did not reach
+*    and clears the journal unless something failed.
 */
-static void _FeedWatchdog(void) {
+static void _JournalFinish(void) {
+  _JournalClose();
+  if (_JournalTake(QSPI_DEVICE_SIZE) < 0) {
+    _JournalError = 1;
+  }
+  if (!_JournalError && _JournalNum) {
+    _JournalErase();
+    _JournalNum = 0;
+  }
 }
+#endif
 
 /*********************************************************************
 *
@@ -102,19 +1237,37 @@ int Init(U32 Addr, U32 Freq, U32 Func) {
   //
   // Init code
   //
+#if XIP_CACHE
+  cache_disable();   // Left on by a previous UnInit(), flash content is about to change
+#endif
   clock_setup();
 
-  gpio_set_qspi(GPIOA_BASE,'B',2,GPIOx_PUPDR_NOPULL, 0x9);
-  gpio_set_qspi(GPIOA_BASE,'B',6,GPIOx_PUPDR_NOPULL, 0xA);
-  gpio_set_qspi(GPIOA_BASE,'D',11,GPIOx_PUPDR_NOPULL, 0x9);
-  gpio_set_qspi(GPIOA_BASE,'D',12,GPIOx_PUPDR_NOPULL, 0x9);
-  gpio_set_qspi(GPIOA_BASE,'D',13,GPIOx_PUPDR_NOPULL, 0x9);
-  gpio_set_qspi(GPIOA_BASE,'E',2,GPIOx_PUPDR_NOPULL, 0x9);
+  board_init_flash_pins();
+#if SUPPORT_LATENCY_MAP
+  dwt_enable();      // Busy times are taken with CYCCNT
+#endif
 
-  quadspi_init(0, (void *)QUADSPI_BASE);
+  flash_bus_init();
+  //
+  // Pick the fastest erase/program command mode the memory supports
+  //
+  if (Func != 3) {
+    flash_bus_select_mode();
+  }
 
   if(Func != 1 )
-    quadspi_mmap();
+    flash_bus_mmap();
+#if SUPPORT_JOURNAL
+  //
+  // Pick up the extents of an interrupted session. Deferred erases of the
+  // erase phase are kept for the program phase.
+  //
+  if (Func != 3) {
+    JournalExtents = _JournalScan();
+    _JournalSector = JOURNAL_NONE;
+    _JournalError = 0;
+  }
+#endif
 
   return 0;
 }
@@ -138,9 +1291,27 @@ int UnInit(U32 Func) {
   //
   // Uninit code
   //
-  quadspi_init(0, (void *)QUADSPI_BASE);
-
-  quadspi_mmap();
+#if SUPPORT_JOURNAL
+  //
+  // The program phase is done: finish the deferred erases and clear the
+  // journal unless something failed
+  //
+  if (Func == 2) {
+    _JournalFinish();
+  }
+#endif
+#if SUPPORT_INTERNAL_FLASH
+  flash_lock();
+#endif
+  //
+  // Hand the memory over for execute-in-place in the fastest read mode
+  // that reads back correctly. The controller is still set up by Init(),
+  // no re-init and no memory reset on the way out.
+  //
+  flash_bus_handoff();
+#if XIP_CACHE
+  cache_enable(QSPI_BASE_ADDR, QSPI_FLASH_SIZE, XIP_CACHE > 1);
+#endif
 
   return 0;
 }
@@ -160,9 +1331,26 @@ int UnInit(U32 Func) {
 *    1 Error
 */
 int EraseSector(U32 SectorAddr) {
-
-  SectorAddr -= 0x90000000;
-  quadspi_erase_sector(SectorAddr);
+  switch (_GetBank(SectorAddr, 1)) {
+  case BANK_QSPI:
+#if SUPPORT_JOURNAL
+    if (_JournalDefer(SectorAddr - QSPI_BASE_ADDR)) {
+      JournalSkippedErases++;
+      break;
+    }
+#endif
+    flash_bus_erase_sector(SectorAddr - QSPI_BASE_ADDR);
+    break;
+#if SUPPORT_INTERNAL_FLASH
+  case BANK_INTERNAL:
+    if (flash_erase_sector(SectorAddr - INTERNAL_BASE_ADDR)) {
+      return 1;
+    }
+    break;
+#endif
+  default:
+    break;   // Dummy sector between the banks, nothing to erase
+  }
   //_FeedWatchdog();
   return 0;
 }
@@ -182,14 +1370,370 @@ int EraseSector(U32 SectorAddr) {
 *  Return value 
 *    0 O.K.
 *    1 Error
+*
+*  Notes
+*    (1) With FLASH_BUS_VERIFY_ON_WRITE each page is read back right
+*        after programming and compared with pSrcBuff, the first failing
+*        address is left in ProgramErrorAddr. The separate verify pass
+*        can then be switched off in the J-Link settings.
 */
 int ProgramPage(U32 DestAddr, U32 NumBytes, U8 *pSrcBuff) {
-  
+  U32 n;
+
+  switch (_GetBank(DestAddr, NumBytes)) {
+  case BANK_QSPI:
+#if SUPPORT_JOURNAL
+    n = _JournalProgram(DestAddr, NumBytes, pSrcBuff);
+#else
+    n = flash_bus_write(DestAddr - QSPI_BASE_ADDR, pSrcBuff, NumBytes);
+#endif
+    break;
+#if SUPPORT_INTERNAL_FLASH
+  case BANK_INTERNAL:
+    if (flash_write(DestAddr - INTERNAL_BASE_ADDR, pSrcBuff, NumBytes)) {
+      return 1;
+    }
+#if FLASH_BUS_VERIFY_ON_WRITE
+    n = _CompareMapped(DestAddr, NumBytes, pSrcBuff);
+#else
+    n = NumBytes;
+#endif
+    break;
+#endif
+  default:
+    return 1;
+  }
+  if (n != NumBytes) {
+#if FLASH_BUS_VERIFY_ON_WRITE
+    ProgramErrorAddr = DestAddr + n;
+#endif
+    return 1;
+  }
+  return 0;
+}
+
+/*********************************************************************
+*
+*       ProgramCompressed
+*
+*  Function description
+*    Decompresses an LZ4 block stream and programs the result.
+*    The stream may be split across any number of calls, the target
+*    area must have been erased before.
+*
+*  Parameters
+*    DestAddr: Destination address of the stream (page aligned) on the first call, 0 to continue
+*    NumBytes: Number of compressed bytes in the source buffer, 0 to finish the stream
+*    pSrcBuff: Point to the compressed data
+*
+*  Return value
+*    0 O.K.
+*    1 Error
+*/
+#if SUPPORT_COMPRESSED_PROGRAM
+int ProgramCompressed(U32 DestAddr, U32 NumBytes, U8 *pSrcBuff) {
+#if SUPPORT_DUAL_CORE
+  int r;
+#endif
+
+  if (DestAddr) {
+    if ((DestAddr & (LZ4_PAGE_SIZE - 1)) || _GetBank(DestAddr, 1) != BANK_QSPI) {
+      return 1;
+    }
+    _StreamAddr = DestAddr - QSPI_BASE_ADDR;
+    _StreamActive = 1;
+    lz4_stream_init(&_Stream, _ProgramStaged);
+#if SUPPORT_DUAL_CORE
+    _StreamDual = _DualStart();
+#endif
+  }
+  if (_StreamActive == 0) {
+    return 1;
+  }
+#if SUPPORT_DUAL_CORE
+  if (_StreamDual) {
+    if (NumBytes == 0) {
+      _StreamActive = 0;
+      r = _DualRun(DUAL_CMD_FINISH, 0, 0);
+    } else {
+      r = _DualRun(DUAL_CMD_DECODE, pSrcBuff, NumBytes);
+    }
+    if (r == DUAL_NO_WORKER) {
+      _DualNoWorker = 1;          // M4 stopped answering, later streams decode on the M7
+    }
+    if (r) {
+      _StreamActive = 0;
+      return 1;
+    }
+    return 0;
+  }
+#endif
+  if (NumBytes == 0) {
+    _StreamActive = 0;
+    return lz4_stream_finish(&_Stream, 0xFF) ? 1 : 0;
+  }
+  if (lz4_stream_decode(&_Stream, pSrcBuff, NumBytes)) {
+    _StreamActive = 0;
+    return 1;
+  }
+  return 0;
+}
+#endif
+
+/*********************************************************************
+*
+*       ProgramScatter
+*
+*  Function description
+*    Erases and programs a list of QSPI regions back-to-back, so that a
+*    multi-region deploy needs a single loader call. Call Init() with
+*    Func 2 (program) first.
+*
+*  Parameters
+*    NumDescs: Number of descriptors
+*    pDesc: Pointer to the descriptor list in RAM, Status is filled in
+*    pData: Source buffer the SrcOff of the descriptors refer to
+*
+*  Return value
+*    0 O.K., all regions programmed or already equal
+*    1 Error, see the Status of the descriptors
+*
+*  Notes
+*    (1) A failing region does not stop the list, the remaining
+*        regions are still processed.
+*    (2) SCATTER_SKIP_EQUAL compares against the memory mapped flash,
+*        unchanged sectors are neither erased nor programmed.
+*    (3) The erase statistics of the call are left in EraseStats,
+*        those of the die scheduler in DieStats.
+*/
+#if SUPPORT_SCATTER_PROGRAM
+int ProgramScatter(U32 NumDescs, struct SCATTER_DESC *pDesc, U8 *pData) {
+  U32 i;
+#if SUPPORT_MULTI_DIE
+  U32 NumJobs;
+#endif
+  int r;
+
+  for (i = 0; i < NumDescs; i++) {
+    pDesc[i].Status = SCATTER_STATUS_PENDING;
+  }
+  erase_sched_init(&_EraseSched, _ScatterVerifyPage, 0, &EraseStats);
+  _pScatterData = pData;
+#if SUPPORT_MULTI_DIE
+  NumJobs = 0;
+  DieStats.erases = 0;
+  DieStats.pages = 0;
+  DieStats.busy_us = 0;
+  DieStats.elapsed_us = 0;
+#endif
+  for (i = 0; i < NumDescs; i++) {
+#if SUPPORT_MULTI_DIE
+    //
+    // Consecutive die scheduler regions are run together, the list
+    // order is kept for everything else
+    //
+    if (flash_bus_num_dies() > 1 && _ScatterIsDieJob(&pDesc[i])) {
+      if (NumJobs == SCATTER_DIE_JOBS) {
+        _ScatterDieRun(NumJobs);
+        NumJobs = 0;
+      }
+      _aDieJob[NumJobs].addr = pDesc[i].Addr - QSPI_BASE_ADDR;
+      _aDieJob[NumJobs].len = pDesc[i].NumBytes;
+      _aDieJob[NumJobs].ctx = &pDesc[i];
+      NumJobs++;
+      continue;
+    }
+    if (NumJobs) {
+      _ScatterDieRun(NumJobs);
+      NumJobs = 0;
+    }
+#endif
+    pDesc[i].Status = _ScatterRegion(&pDesc[i], pData);
+  }
+#if SUPPORT_MULTI_DIE
+  if (NumJobs) {
+    _ScatterDieRun(NumJobs);
+  }
+#endif
+  r = 0;
+  for (i = 0; i < NumDescs; i++) {
+    if (pDesc[i].Status > SCATTER_STATUS_EQUAL) {
+      r = 1;
+    }
+  }
+  return r;
+}
+#endif
+
+/*********************************************************************
+*
+*       FillRange
+*
+*  Function description
+*    Fills a QSPI range with a repeated 32-bit pattern generated
+*    on-target, so that only the parameters cross the debug link.
+*    Call Init() with Func 2 (program) first.
+*
+*  Parameters
+*    Addr: Start address of the range
+*    NumBytes: Number of bytes to be filled
+*    Pattern: Fill pattern, the byte at address A is bits 8 * (A % 4)
+*             of Pattern (little endian words)
+*
+*  Return value
+*    0 O.K.
+*    1 Error
+*
+*  Notes
+*    (1) Sectors are only erased where the pattern has bits set that
+*        are 0 in flash (e.g. a 0x00 fill is programmed over anything).
+*        A sector that needs an erase must lie completely within the
+*        range, otherwise the call fails without touching it.
+*/
+#if SUPPORT_FILL_RANGE
+int FillRange(U32 Addr, U32 NumBytes, U32 Pattern) {
+  U32 n;
+  U32 i;
+
+  if (NumBytes == 0) {
+    return 0;
+  }
+  if (_GetBank(Addr, NumBytes) != BANK_QSPI) {
+    return 1;
+  }
+  for (i = 0; i < QSPI_PAGE_SIZE; i++) {
+    _aFillPage[i] = (U8)(Pattern >> (8 * (i & 3)));
+  }
+  while (NumBytes) {
+    n = QSPI_SECTOR_SIZE - (Addr & (QSPI_SECTOR_SIZE - 1));
+    if (n > NumBytes) {
+      n = NumBytes;
+    }
+    if (_FillSector(Addr, n)) {
+      return 1;
+    }
+    _FeedWatchdog();
+    Addr += n;
+    NumBytes -= n;
+  }
+  return 0;
+}
+#endif
+
+/*********************************************************************
+*
+*       DualCoreWorker
+*
+*  Function description
+*    Entry point of the Cortex-M4 on dual-core devices, runs the
+*    decompression side of ProgramCompressed(). Never returns.
+*
+*  Notes
+*    (1) The debugger script starts the M4 after the RAMCode has been
+*        downloaded, with PC = DualCoreWorker and SP at the end of a
+*        free D2 SRAM area (e.g. 0x30048000). The RAMCode is built for
+*        the M7 but only uses ARMv7E-M integer instructions here.
+*    (2) The shared data lives in the RAMCode data in AXI SRAM, which
+*        both cores reach. The D-cache of the M7 is off while the
+*        loader runs.
+*/
+#if SUPPORT_DUAL_CORE
+void DualCoreWorker(void) {
+  hsem_init();
+  dual_worker(&_Dual);
+}
+#endif
+
+/*********************************************************************
+*
+*       HashRegion
+*
+*  Function description
+*    Computes the SHA-256 digest of a flash region on-target.
+*    The QSPI flash is read through the memory mapped window, it is
+*    mapped here, so any Init() may come first.
+*
+*  Parameters
+*    Addr: Start address of the region
+*    NumBytes: Number of bytes to be hashed
+*    pDigest: Pointer to a 32 byte RAM buffer that receives the digest
+*
+*  Return value
+*    0 O.K.
+*    1 Error
+*
+*  Notes
+*    (1) Falls back to the software implementation when the HASH
+*        peripheral does not respond.
+*/
+#if SUPPORT_HASH_REGION
+int HashRegion(U32 Addr, U32 NumBytes, U8 *pDigest) {
+  struct sha256_ctx Ctx;
+  const U8 *pData;
 
-  DestAddr -= 0x90000000;
-  quadspi_write(DestAddr,pSrcBuff,NumBytes);
+  switch (_GetBank(Addr, NumBytes)) {
+  case BANK_QSPI:
+    flash_bus_mmap();
+    break;
+  case BANK_NONE:
+    return 1;
+  default:
+    break;
+  }
+  pData = flash_bus_ptr(Addr);
+#if BOARD_HASH && (FLASH_BUS_SIM == 0)
+  if (hash_sha256(pData, NumBytes, pDigest) == 0) {
+    return 0;
+  }
+#endif
+  sha256_init(&Ctx);
+  sha256_update(&Ctx, pData, NumBytes);
+  sha256_final(&Ctx, pDigest);
   return 0;
 }
+#endif
+
+/*********************************************************************
+*
+*       LatencyMap
+*
+*  Function description
+*    Copies the busy time map of the QSPI flash (struct latency_map in
+*    hal/latency.h) to a RAM buffer, so that the station reads it
+*    with one memory read.
+*
+*  Parameters
+*    pDest: Pointer to the RAM buffer that receives the map
+*    NumBytes: Size of the buffer, the copy is cut to it
+*    Clear: != 0 starts a new map after the copy
+*
+*  Return value
+*    Size of the map in bytes
+*
+*  Notes
+*    (1) The map holds min, max and last erase time of each sector of a
+*        window of LATENCY_SECTORS sectors and a histogram of all page
+*        program times, taken from the end of the command to WIP clear.
+*        It is not touched by Init() / UnInit().
+*/
+#if SUPPORT_LATENCY_MAP
+int LatencyMap(U8 *pDest, U32 NumBytes, U32 Clear) {
+  const U8 *pMap;
+  U32 i;
+
+  pMap = (const U8 *)latency_get();
+  if (NumBytes > sizeof(struct latency_map)) {
+    NumBytes = sizeof(struct latency_map);
+  }
+  for (i = 0; i < NumBytes; i++) {
+    pDest[i] = pMap[i];
+  }
+  if (Clear) {
+    latency_clear();
+  }
+  return sizeof(struct latency_map);
+}
+#endif
 
 /*********************************************************************
 *
@@ -214,6 +1758,13 @@ U32 Verify(U32 Addr, U32 NumBytes, U8 *pBuff) {
   unsigned char *pFlash;
   unsigned long r;
 
+  //
+  // Both banks are memory mapped (QSPI after Init() for verify),
+  // only reject ranges that are not backed by a bank
+  //
+  if (_GetBank(Addr, NumBytes) == BANK_NONE) {
+    return Addr;
+  }
   pFlash = (unsigned char *)Addr;
   r = Addr + NumBytes;
   do {
@@ -249,7 +1800,15 @@ U32 Verify(U32 Addr, U32 NumBytes, U8 *pBuff) {
 #if SUPPORT_BLANK_CHECK
 int BlankCheck(U32 Addr, U32 NumBytes, U8 BlankData) {
   U8* pData;
-  
+
+  if (_GetBank(Addr, NumBytes) == BANK_NONE) {
+#if SUPPORT_INTERNAL_FLASH
+    if (Addr >= INTERNAL_BASE_ADDR + INTERNAL_FLASH_SIZE && Addr - INTERNAL_BASE_ADDR + NumBytes <= QSPI_BASE_ADDR - INTERNAL_BASE_ADDR) {
+      return 0;   // Dummy sector between the banks, never needs an erase
+    }
+#endif
+    return -1;
+  }
   pData = (U8 *)Addr;
   do {
     if (*pData++ != BlankData) {
@@ -286,3 +1845,179 @@ int SEGGER_OPEN_Read(U32 Addr, U32 NumBytes, U8 *pDestBuff) {
   return NumBytes;
 }
 #endif
+
+#if SUPPORT_TRACE
+#undef Init
+#undef UnInit
+#undef EraseSector
+#undef ProgramPage
+#undef Verify
+#undef BlankCheck
+#undef SEGGER_OPEN_Read
+#undef ProgramCompressed
+#undef ProgramScatter
+#undef FillRange
+#undef HashRegion
+#undef LatencyMap
+
+/*********************************************************************
+*
+*       Traced entry points
+*
+*  Function description
+*    Public entry points with SUPPORT_TRACE. Each one records the call
+*    in Trace around the implementation above.
+*/
+int Init(U32 Addr, U32 Freq, U32 Func) {
+  U32 Start;
+  int r;
+
+  Start = trace_enter();
+  r = _TracedInit(Addr, Freq, Func);
+  trace_leave(&Trace, TRACE_INIT, Addr, Freq, Func, r, Start);
+  return r;
+}
+
+int UnInit(U32 Func) {
+  U32 Start;
+  int r;
+
+  Start = trace_enter();
+  r = _TracedUnInit(Func);
+  trace_leave(&Trace, TRACE_UNINIT, 0, 0, Func, r, Start);
+  return r;
+}
+
+int EraseSector(U32 SectorAddr) {
+  U32 Start;
+  U32 NumBytes;
+  int r;
+
+  Start = trace_enter();
+  r = _TracedEraseSector(SectorAddr);
+  switch (_GetBank(SectorAddr, 1)) {
+  case BANK_QSPI:
+    NumBytes = QSPI_SECTOR_SIZE;
+    break;
+#if SUPPORT_INTERNAL_FLASH
+  case BANK_INTERNAL:
+    NumBytes = FLASH_SECTOR_SIZE;
+    break;
+#endif
+  default:
+    NumBytes = 0;
+    break;
+  }
+  trace_leave(&Trace, TRACE_ERASE_SECTOR, SectorAddr, NumBytes, 0, r, Start);
+  return r;
+}
+
+int ProgramPage(U32 DestAddr, U32 NumBytes, U8 *pSrcBuff) {
+  U32 Start;
+  int r;
+
+  Start = trace_enter();
+  r = _TracedProgramPage(DestAddr, NumBytes, pSrcBuff);
+  trace_leave(&Trace, TRACE_PROGRAM_PAGE, DestAddr, NumBytes, 0, r, Start);
+  return r;
+}
+
+#if SUPPORT_NATIVE_VERIFY
+U32 Verify(U32 Addr, U32 NumBytes, U8 *pBuff) {
+  U32 Start;
+  U32 r;
+
+  Start = trace_enter();
+  r = _TracedVerify(Addr, NumBytes, pBuff);
+  trace_leave(&Trace, TRACE_VERIFY, Addr, NumBytes, 0, r, Start);
+  return r;
+}
+#endif
+
+#if SUPPORT_BLANK_CHECK
+int BlankCheck(U32 Addr, U32 NumBytes, U8 BlankData) {
+  U32 Start;
+  int r;
+
+  Start = trace_enter();
+  r = _TracedBlankCheck(Addr, NumBytes, BlankData);
+  trace_leave(&Trace, TRACE_BLANK_CHECK, Addr, NumBytes, BlankData, r, Start);
+  return r;
+}
+#endif
+
+#if SUPPORT_NATIVE_READ_BACK
+int SEGGER_OPEN_Read(U32 Addr, U32 NumBytes, U8 *pDestBuff) {
+  U32 Start;
+  int r;
+
+  Start = trace_enter();
+  r = _TracedRead(Addr, NumBytes, pDestBuff);
+  //
+  // Returns NumBytes when O.K., recorded as 0 so that reads merge
+  //
+  trace_leave(&Trace, TRACE_READ, Addr, NumBytes, 0, (U32)r == NumBytes ? 0 : (U32)r, Start);
+  return r;
+}
+#endif
+
+#if SUPPORT_COMPRESSED_PROGRAM
+int ProgramCompressed(U32 DestAddr, U32 NumBytes, U8 *pSrcBuff) {
+  U32 Start;
+  int r;
+
+  Start = trace_enter();
+  r = _TracedProgramCompressed(DestAddr, NumBytes, pSrcBuff);
+  trace_leave(&Trace, TRACE_PROGRAM_COMPRESSED, DestAddr, NumBytes, 0, r, Start);
+  return r;
+}
+#endif
+
+#if SUPPORT_SCATTER_PROGRAM
+int ProgramScatter(U32 NumDescs, struct SCATTER_DESC *pDesc, U8 *pData) {
+  U32 Start;
+  int r;
+
+  Start = trace_enter();
+  r = _TracedProgramScatter(NumDescs, pDesc, pData);
+  trace_leave(&Trace, TRACE_PROGRAM_SCATTER, 0, NumDescs, 0, r, Start);
+  return r;
+}
+#endif
+
+#if SUPPORT_FILL_RANGE
+int FillRange(U32 Addr, U32 NumBytes, U32 Pattern) {
+  U32 Start;
+  int r;
+
+  Start = trace_enter();
+  r = _TracedFillRange(Addr, NumBytes, Pattern);
+  trace_leave(&Trace, TRACE_FILL_RANGE, Addr, NumBytes, Pattern, r, Start);
+  return r;
+}
+#endif
+
+#if SUPPORT_HASH_REGION
+int HashRegion(U32 Addr, U32 NumBytes, U8 *pDigest) {
+  U32 Start;
+  int r;
+
+  Start = trace_enter();
+  r = _TracedHashRegion(Addr, NumBytes, pDigest);
+  trace_leave(&Trace, TRACE_HASH_REGION, Addr, NumBytes, 0, r, Start);
+  return r;
+}
+#endif
+
+#if SUPPORT_LATENCY_MAP
+int LatencyMap(U8 *pDest, U32 NumBytes, U32 Clear) {
+  U32 Start;
+  int r;
+
+  Start = trace_enter();
+  r = _TracedLatencyMap(pDest, NumBytes, Clear);
+  trace_leave(&Trace, TRACE_LATENCY_MAP, 0, NumBytes, Clear, r, Start);
+  return r;
+}
+#endif
+#endif
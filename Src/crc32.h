@@ -0,0 +1,12 @@
+#ifndef _CRC32_H
+#define _CRC32_H
+
+#include <stdint.h>
+
+/*
+ * CRC-32 (IEEE 802.3, as zlib). Start with 0 and pass the previous result
+ * to continue over the next piece. Nibble table, 64 bytes of constants.
+ */
+uint32_t crc32(uint32_t crc, const uint8_t *data, uint32_t len);
+
+#endif /* _CRC32_H */
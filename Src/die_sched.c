@@ -0,0 +1,105 @@
+#include <stdint.h>
+#include "die_sched.h"
+#include "flash_bus.h"
+#include "dwt.h"
+
+/* Position of one die in the job list */
+struct die_cursor {
+	int job;
+	uint32_t off;		/* sector of the job being programmed */
+	uint32_t page;		/* next page of it, SECTOR_SIZE = sector done */
+	uint32_t start;		/* cycles when the running operation was issued */
+	int busy;
+	int done;
+};
+
+/* Issue the next operation of a die, returns 0 when it has none left */
+static int die_sched_next(struct die_cursor *c, int die,
+			  const struct die_job *jobs, int njobs, die_page_t page,
+			  struct die_sched_stats *stats)
+{
+	const struct die_job *job;
+	const uint8_t *data;
+	int d;
+
+	while (c->page < DIE_SCHED_SECTOR_SIZE) {
+		job = &jobs[c->job];
+		data = page(job->ctx, c->off + c->page);
+		c->page += DIE_SCHED_PAGE_SIZE;
+		if (data) {
+			flash_bus_die_write_start(job->addr + c->off + c->page -
+						  DIE_SCHED_PAGE_SIZE, data);
+			stats->pages++;
+			return 1;
+		}
+	}
+
+	/* Next sector on this die, jobs are ascending so stop at a higher die */
+	for (c->off += DIE_SCHED_SECTOR_SIZE; c->job < njobs; c->job++, c->off = 0) {
+		job = &jobs[c->job];
+		for (; c->off < job->len; c->off += DIE_SCHED_SECTOR_SIZE) {
+			d = flash_bus_die_of(job->addr + c->off);
+			if (d > die)
+				break;
+			if (d == die) {
+				flash_bus_die_erase_start(job->addr + c->off);
+				stats->erases++;
+				c->page = 0;
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+void die_sched_run(const struct die_job *jobs, int njobs, die_page_t page,
+		   struct die_sched_stats *stats)
+{
+	struct die_cursor cursor[DIE_SCHED_MAX_DIES], *c;
+	int dies = flash_bus_num_dies();
+	uint32_t t0;
+	int die, active;
+
+	if (dies > DIE_SCHED_MAX_DIES)
+		dies = DIE_SCHED_MAX_DIES;
+
+	dwt_enable();
+	t0 = dwt_cycles();
+
+	for (die = 0; die < dies; die++) {
+		c = &cursor[die];
+		c->job = 0;
+		c->off = -DIE_SCHED_SECTOR_SIZE;	/* wraps to 0 on the first sector */
+		c->page = DIE_SCHED_SECTOR_SIZE;
+		c->busy = 0;
+		c->done = 0;
+	}
+
+	do {
+		active = 0;
+		for (die = 0; die < dies; die++) {
+			c = &cursor[die];
+			if (c->busy) {
+				if (flash_bus_die_busy(die)) {
+					active = 1;
+					continue;
+				}
+				stats->busy_us += DWT_US(dwt_cycles() - c->start);
+				c->busy = 0;
+			}
+			if (c->done)
+				continue;
+
+			c->start = dwt_cycles();
+			if (die_sched_next(c, die, jobs, njobs, page, stats)) {
+				c->busy = 1;
+				active = 1;
+			} else {
+				c->done = 1;
+			}
+		}
+	} while (active);
+
+	stats->elapsed_us += DWT_US(dwt_cycles() - t0);
+}
@@ -0,0 +1,42 @@
+#ifndef _DIE_SCHED_H
+#define _DIE_SCHED_H
+
+#include <stdint.h>
+
+/*
+ * Erase/program scheduler for stacked-die NOR parts. die_sched_run()
+ * erases and programs a list of sector aligned jobs with one cursor per
+ * die: whenever a die is idle, its next operation (erase of its next
+ * sector, or the next non-blank page of the sector just erased) is issued
+ * and the scheduler moves on to the other dies, so that the erase and
+ * program times of the dies overlap. Operations on one die keep the
+ * order of the jobs.
+ *
+ * Writes do not wait for the page, there is no verify-on-write: read the
+ * jobs back once die_sched_run() returned and all dies are idle.
+ */
+
+#define DIE_SCHED_SECTOR_SIZE	0x1000
+#define DIE_SCHED_PAGE_SIZE		256
+#define DIE_SCHED_MAX_DIES		4
+
+struct die_job {
+	uint32_t addr;		/* flash bus offset, sector aligned */
+	uint32_t len;		/* multiple of DIE_SCHED_SECTOR_SIZE */
+	void *ctx;
+};
+
+/* Page of a job at offset off, NULL when blank (not programmed) */
+typedef const uint8_t *(*die_page_t)(void *ctx, uint32_t off);
+
+struct die_sched_stats {
+	uint32_t erases;
+	uint32_t pages;
+	uint32_t busy_us;	/* erase/program time summed over the dies */
+	uint32_t elapsed_us;	/* busy_us / elapsed_us is the overlap */
+};
+
+void die_sched_run(const struct die_job *jobs, int njobs, die_page_t page,
+		   struct die_sched_stats *stats);
+
+#endif /* _DIE_SCHED_H */
@@ -0,0 +1,195 @@
+#include <stdint.h>
+#include "dual_core.h"
+#include "crc32.h"
+#include "hsem.h"
+
+#define DUAL_RING_MASK		(DUAL_RING_SLOTS - 1)
+
+/*
+ * Index publication between the cores. Release makes the slot contents
+ * visible before the index, acquire orders slot reads after it (DMB on
+ * the Cortex-M, real fences with threads on the host).
+ */
+#define dual_load(p)		__atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define dual_store(p, v)	__atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+/*
+ * Spin-wait body and timeout clock: DWT CYCCNT on the target, the
+ * monotonic clock in microseconds for the host test threads, which may
+ * share one CPU.
+ */
+#ifdef __arm__
+#include "dwt.h"
+#define dual_relax()		do { } while (0)
+#define dual_clock_init()	dwt_enable()
+#define dual_clock()		dwt_cycles()
+#define DUAL_TIMEOUT		DWT_CYCLES(DUAL_TIMEOUT_US)
+#else
+#include <sched.h>
+#include <time.h>
+#define dual_relax()		sched_yield()
+#define dual_clock_init()	((void)0)
+#define DUAL_TIMEOUT		DUAL_TIMEOUT_US
+
+static uint32_t dual_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000u + ts.tv_nsec / 1000;
+}
+#endif
+
+/* Shared state of the job dual_worker_poll() runs, for the decoder sink */
+static struct dual_shared *dual_sh;
+
+void dual_init(struct dual_shared *sh, struct lz4_stream *stream)
+{
+	uint32_t *p = (uint32_t *)sh;
+	uint32_t i;
+
+	/* Not memset(), the loader links without the C library */
+	for (i = 0; i < sizeof(*sh) / sizeof(*p); i++)
+		p[i] = 0;
+	sh->stream = stream;
+	dual_clock_init();
+}
+
+/* Producer side: wait for a free slot */
+static struct dual_slot *dual_slot_get(struct dual_shared *sh)
+{
+	while (sh->head - dual_load(&sh->tail) == DUAL_RING_SLOTS)
+		dual_relax();
+
+	return &sh->slot[sh->head & DUAL_RING_MASK];
+}
+
+static void dual_slot_put(struct dual_shared *sh)
+{
+	dual_store(&sh->head, sh->head + 1);
+}
+
+/* Decoder sink on the M4: classify the page and queue it for the M7 */
+static int dual_push(uint32_t offset, const uint8_t *page)
+{
+	struct dual_shared *sh = dual_sh;
+	struct dual_slot *slot = dual_slot_get(sh);
+	int i;
+
+	slot->offset = offset;
+	slot->flags = DUAL_SLOT_ERASED;
+	for (i = 0; i < LZ4_PAGE_SIZE; i++) {
+		slot->data[i] = page[i];
+		if (page[i] != 0xff)
+			slot->flags = 0;
+	}
+	sh->crc = crc32(sh->crc, page, LZ4_PAGE_SIZE);
+
+	dual_slot_put(sh);
+	return 0;
+}
+
+/*
+ * Run one posted job, if any. Returns 1 when a job was run. The M4 calls
+ * this in a loop, the host test from a thread.
+ */
+int dual_worker_poll(struct dual_shared *sh)
+{
+	struct dual_slot *slot;
+	uint32_t seq;
+	int ret = 0;
+
+	if (!hsem_event(DUAL_HSEM_JOB))
+		return 0;
+
+	seq = dual_load(&sh->job_seq);
+	if (seq == sh->ack_seq)
+		return 0;
+	dual_store(&sh->ack_seq, seq);
+
+	dual_sh = sh;
+	switch (sh->cmd) {
+	case DUAL_CMD_START:
+		lz4_stream_init(sh->stream, dual_push);
+		sh->crc = 0;
+		/* fall through */
+	case DUAL_CMD_DECODE:
+		if (sh->len)
+			ret = lz4_stream_decode(sh->stream, sh->src, sh->len);
+		break;
+	case DUAL_CMD_FINISH:
+		ret = lz4_stream_finish(sh->stream, 0xff);
+		break;
+	}
+
+	slot = dual_slot_get(sh);
+	slot->flags = DUAL_SLOT_END | (ret ? DUAL_SLOT_ERROR : 0);
+	slot->crc = sh->crc;
+	dual_slot_put(sh);
+
+	return 1;
+}
+
+void dual_worker(struct dual_shared *sh)
+{
+	for (;;)
+		dual_worker_poll(sh);
+}
+
+/*
+ * M7 side: post a job to the M4 and program the pages it produces until
+ * the job ends. Pages marked erased are skipped. After a program error
+ * the ring is still drained to keep both sides in step. crc receives the
+ * CRC-32 of all pages of the stream so far. DUAL_NO_WORKER is returned
+ * when the doorbell cannot be rung or the M4 goes quiet for
+ * DUAL_TIMEOUT_US, before taking the job or in the middle of it.
+ */
+int dual_run(struct dual_shared *sh, uint32_t cmd, const uint8_t *src,
+	     uint32_t len, lz4_sink_t program, uint32_t *crc)
+{
+	struct dual_slot *slot;
+	uint32_t seq, start, flags;
+	int ret = 0;
+
+	sh->cmd = cmd;
+	sh->src = src;
+	sh->len = len;
+	seq = sh->job_seq + 1;
+	dual_store(&sh->job_seq, seq);
+	if (hsem_notify(DUAL_HSEM_JOB))
+		return DUAL_NO_WORKER;
+
+	/* An idle ring at this point means the M4 has not started the job */
+	start = dual_clock();
+	while (dual_load(&sh->ack_seq) != seq) {
+		if (dual_clock() - start > DUAL_TIMEOUT)
+			return DUAL_NO_WORKER;
+		dual_relax();
+	}
+
+	for (;;) {
+		/* Timed from the last slot, not counting the program time */
+		start = dual_clock();
+		while (sh->tail == dual_load(&sh->head)) {
+			if (dual_clock() - start > DUAL_TIMEOUT)
+				return DUAL_NO_WORKER;
+			dual_relax();
+		}
+
+		slot = &sh->slot[sh->tail & DUAL_RING_MASK];
+		flags = slot->flags;
+		if (flags & DUAL_SLOT_END) {
+			*crc = slot->crc;
+			if (flags & DUAL_SLOT_ERROR)
+				ret = DUAL_ERROR;
+			dual_store(&sh->tail, sh->tail + 1);
+			return ret;
+		}
+
+		if (!ret && !(flags & DUAL_SLOT_ERASED) &&
+		    program(slot->offset, slot->data))
+			ret = DUAL_ERROR;
+
+		dual_store(&sh->tail, sh->tail + 1);
+	}
+}
@@ -0,0 +1,86 @@
+#ifndef _DUAL_CORE_H
+#define _DUAL_CORE_H
+
+#include <stdint.h>
+#include "lz4_stream.h"
+
+/*
+ * Dual-core pipeline for ProgramCompressed() on STM32H745/H747/H755/H757.
+ *
+ * The Cortex-M4 runs dual_worker(): it decompresses the stream, marks
+ * erased (all 0xFF) pages, keeps a CRC-32 of the output and hands the
+ * pages to the Cortex-M7 through a single-producer/single-consumer ring
+ * in AXI SRAM. The M7 drains the ring into the flash bus with
+ * dual_run(). head and tail are free running counters, each written by
+ * one side only. Jobs are announced with an HSEM doorbell, the end of a
+ * job travels through the ring so that it is ordered with the pages.
+ *
+ * The CRC is taken over the decompressed pages rather than the
+ * compressed source buffer: that is what ends up in the flash, so it
+ * compares directly against a CRC read back from the programmed range,
+ * and the compressed chunks the J-Link hands over are not kept anyway.
+ */
+
+#ifndef DUAL_RING_SLOTS
+#define DUAL_RING_SLOTS		8
+#endif
+
+#if DUAL_RING_SLOTS & (DUAL_RING_SLOTS - 1)
+#error "DUAL_RING_SLOTS must be a power of two"
+#endif
+
+#define DUAL_HSEM_JOB		0	/* released by the M7 when a job is posted */
+
+/*
+ * Time the M7 waits for the M4 to take a job or to hand over the next
+ * slot. A page takes microseconds to decode, so running out of it means
+ * the M4 faulted or was halted mid-job.
+ */
+#ifndef DUAL_TIMEOUT_US
+#define DUAL_TIMEOUT_US		100000
+#endif
+
+/* dual_slot.flags */
+#define DUAL_SLOT_ERASED	(1 << 0)	/* all 0xFF, nothing to program */
+#define DUAL_SLOT_END		(1 << 1)	/* end of job, no page, crc valid */
+#define DUAL_SLOT_ERROR		(1 << 2)	/* with END: corrupt stream */
+
+struct dual_slot {
+	uint32_t offset;	/* stream offset of the page */
+	uint32_t flags;
+	uint32_t crc;		/* END: CRC-32 of all pages of the stream so far */
+	uint8_t data[LZ4_PAGE_SIZE];
+};
+
+/* Job commands */
+#define DUAL_CMD_START		1	/* new stream, then decode src/len */
+#define DUAL_CMD_DECODE		2	/* decode src/len */
+#define DUAL_CMD_FINISH		3	/* pad and hand over the last page */
+
+/* dual_run() results besides 0 */
+#define DUAL_ERROR			-1	/* corrupt stream or program error */
+#define DUAL_NO_WORKER		-2	/* the M4 did not take or finish the job */
+
+struct dual_shared {
+	/* Written by the M7 */
+	uint32_t cmd;
+	const uint8_t *src;
+	uint32_t len;
+	uint32_t job_seq;
+	uint32_t tail;
+
+	/* Written by the M4 */
+	uint32_t ack_seq;
+	uint32_t head;
+	uint32_t crc;
+	struct lz4_stream *stream;
+	struct dual_slot slot[DUAL_RING_SLOTS];
+};
+
+void dual_init(struct dual_shared *sh, struct lz4_stream *stream);
+int dual_run(struct dual_shared *sh, uint32_t cmd, const uint8_t *src,
+	     uint32_t len, lz4_sink_t program, uint32_t *crc);
+int dual_worker_poll(struct dual_shared *sh);
+void dual_worker(struct dual_shared *sh);
+
+#endif /* _DUAL_CORE_H */
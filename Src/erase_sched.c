@@ -0,0 +1,74 @@
+#include <stdint.h>
+#include "erase_sched.h"
+#include "flash_bus.h"
+#include "dwt.h"
+
+void erase_sched_init(struct erase_sched *es, erase_work_t work, void *ctx,
+		      struct erase_sched_stats *stats)
+{
+	es->work = work;
+	es->ctx = ctx;
+	es->pending = 0;
+	es->stats = stats;
+	*stats = (struct erase_sched_stats){ 0 };
+
+	dwt_enable();
+}
+
+/* New work was queued */
+void erase_sched_kick(struct erase_sched *es)
+{
+	es->pending = 1;
+}
+
+static void erase_sched_run(struct erase_sched *es)
+{
+	es->pending = es->work(es->ctx);
+	es->stats->work_items++;
+}
+
+/* Erase one sector, running queued work in suspends while it runs */
+void erase_sched_sector(struct erase_sched *es, uint32_t sector)
+{
+#if FLASH_BUS_ERASE_SUSPEND
+	uint32_t resumed, suspended, t;
+#endif
+
+	flash_bus_erase_start(sector);
+	es->stats->erases++;
+
+#if FLASH_BUS_ERASE_SUSPEND
+	resumed = dwt_cycles();
+	while (flash_bus_busy()) {
+		if (!es->pending ||
+		    dwt_cycles() - resumed < DWT_CYCLES(ERASE_SCHED_MIN_PROGRESS_US))
+			continue;
+
+		/*
+		 * WIP is clear once suspended, and also when the erase ended
+		 * during tSUS: the resume below is then ignored by the part.
+		 */
+		suspended = dwt_cycles();
+		flash_bus_erase_suspend();
+		es->stats->suspends++;
+
+		t = dwt_cycles();
+		do
+			erase_sched_run(es);
+		while (es->pending &&
+		       dwt_cycles() - t < DWT_CYCLES(ERASE_SCHED_SLICE_US));
+		es->stats->recovered_us += DWT_US(dwt_cycles() - t);
+
+		flash_bus_erase_resume();
+		resumed = dwt_cycles();
+		es->stats->suspended_us += DWT_US(resumed - suspended);
+	}
+#endif
+}
+
+/* Run the remaining work with the flash idle */
+void erase_sched_drain(struct erase_sched *es)
+{
+	while (es->pending)
+		erase_sched_run(es);
+}
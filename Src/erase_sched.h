@@ -0,0 +1,51 @@
+#ifndef _ERASE_SCHED_H
+#define _ERASE_SCHED_H
+
+#include <stdint.h>
+
+/*
+ * Erase-suspend pipelining. erase_sched_sector() starts a sector erase and,
+ * while it runs, suspends it from time to time to run slices of queued
+ * read-only work (verify, CRC, blank check of other sectors) through the
+ * memory mapped window, then resumes it. Each erase makes at least
+ * ERASE_SCHED_MIN_PROGRESS_US of progress between two suspends, so that
+ * it still finishes and the tRS minimum of the part is kept, and one
+ * suspend lasts about ERASE_SCHED_SLICE_US.
+ *
+ * Work must not touch the sector being erased. Without
+ * FLASH_BUS_ERASE_SUSPEND the erase blocks and the work waits for
+ * erase_sched_drain(). erase_sched_init() clears the statistics.
+ */
+
+#ifndef ERASE_SCHED_MIN_PROGRESS_US
+#define ERASE_SCHED_MIN_PROGRESS_US	1000
+#endif
+#ifndef ERASE_SCHED_SLICE_US
+#define ERASE_SCHED_SLICE_US		200
+#endif
+
+struct erase_sched_stats {
+	uint32_t erases;
+	uint32_t suspends;
+	uint32_t work_items;	/* work calls, in and out of suspends */
+	uint32_t recovered_us;	/* work run inside suspended erases */
+	uint32_t suspended_us;	/* erases spent suspended, incl. tSUS */
+};
+
+/* Runs one item of work, returns non-zero while more is queued */
+typedef int (*erase_work_t)(void *ctx);
+
+struct erase_sched {
+	erase_work_t work;
+	void *ctx;
+	int pending;
+	struct erase_sched_stats *stats;
+};
+
+void erase_sched_init(struct erase_sched *es, erase_work_t work, void *ctx,
+		      struct erase_sched_stats *stats);
+void erase_sched_kick(struct erase_sched *es);
+void erase_sched_sector(struct erase_sched *es, uint32_t sector);
+void erase_sched_drain(struct erase_sched *es);
+
+#endif /* _ERASE_SCHED_H */
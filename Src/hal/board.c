@@ -0,0 +1,13 @@
+#include <stdint.h>
+#include "stm32h7_regs.h"
+#include "gpio.h"
+#include "board.h"
+
+static const struct gpio_pin board_flash_pins[] = { BOARD_FLASH_PINS };
+
+void board_init_flash_pins(void)
+{
+	gpio_set_alt_pins(GPIOA_BASE, board_flash_pins,
+		sizeof(board_flash_pins) / sizeof(board_flash_pins[0]),
+		GPIOx_OSPEEDR_OSPEEDRy_HIGH);
+}
@@ -0,0 +1,100 @@
+#ifndef _BOARD_H
+#define _BOARD_H
+
+/*
+ * Board descriptors, one is selected at build time with BOARD=<id>.
+ * A board gives the flash bus pins with their alternate functions, the
+ * flash size, the bus backend and mode, the fastest flash clock it
+ * is routed for, the core clock of its part and whether the part has
+ * the HASH peripheral. The
+ * drivers only use the BOARD_* values, a new board is a new block below.
+ *
+ * Backend and mode are defaults, FLASH_BUS_OCTOSPI / QSPI_PROG_MODE /
+ * OSPI_MODE given on the command line still win.
+ */
+#define BOARD_H750_QSPI				0	/* STM32H750/H743, QUADSPI bank 1 */
+#define BOARD_H7A3_OSPI				1	/* STM32H7A3/H7B0, OCTOSPI1 quad */
+#define BOARD_H7A3_OSPI_OCTAL		2	/* STM32H7A3/H7B0, OCTOSPI1 8D-8D-8D */
+
+#ifndef BOARD
+#define BOARD						BOARD_H750_QSPI
+#endif
+
+/* CLK PB2, NCS PB6, IO0-IO3 PD11, PD12, PE2, PD13 */
+#define BOARD_QUAD_PINS \
+	{ 'B',  2, 0x9, GPIOx_PUPDR_NOPULL }, \
+	{ 'B',  6, 0xA, GPIOx_PUPDR_NOPULL }, \
+	{ 'D', 11, 0x9, GPIOx_PUPDR_NOPULL }, \
+	{ 'D', 12, 0x9, GPIOx_PUPDR_NOPULL }, \
+	{ 'D', 13, 0x9, GPIOx_PUPDR_NOPULL }, \
+	{ 'E',  2, 0x9, GPIOx_PUPDR_NOPULL }
+
+#if BOARD == BOARD_H750_QSPI
+
+#define BOARD_FLASH_PINS			BOARD_QUAD_PINS
+#define BOARD_FLASH_SIZE_LOG2		23			/* 8 MB */
+#define BOARD_FLASH_MAX_HZ			80000000
+#define BOARD_PLL1_DIVN				80			/* 8 MHz x 80 / 2 = 320 MHz */
+#define BOARD_HASH					1			/* HASH peripheral on H750/H753 */
+#ifndef FLASH_BUS_OCTOSPI
+#define FLASH_BUS_OCTOSPI			0
+#endif
+#ifndef QSPI_PROG_MODE
+#define QSPI_PROG_MODE				QSPI_MODE_1_1_4
+#endif
+
+#elif BOARD == BOARD_H7A3_OSPI
+
+#define BOARD_FLASH_PINS			BOARD_QUAD_PINS
+#define BOARD_FLASH_SIZE_LOG2		23			/* 8 MB */
+#define BOARD_FLASH_MAX_HZ			80000000
+#define BOARD_PLL1_DIVN				70			/* 280 MHz, the H7A3 maximum */
+#define BOARD_HASH					0
+#ifndef FLASH_BUS_OCTOSPI
+#define FLASH_BUS_OCTOSPI			1
+#endif
+#ifndef OSPI_MODE
+#define OSPI_MODE					OSPI_MODE_1_4_4
+#endif
+
+#elif BOARD == BOARD_H7A3_OSPI_OCTAL
+
+/* Upper data lines IO4-IO7 on PE7-PE10 and DQS on PC5 */
+#define BOARD_FLASH_PINS			BOARD_QUAD_PINS, \
+	{ 'E',  7, 0xA, GPIOx_PUPDR_NOPULL }, \
+	{ 'E',  8, 0xA, GPIOx_PUPDR_NOPULL }, \
+	{ 'E',  9, 0xA, GPIOx_PUPDR_NOPULL }, \
+	{ 'E', 10, 0xA, GPIOx_PUPDR_NOPULL }, \
+	{ 'C',  5, 0xA, GPIOx_PUPDR_NOPULL }
+#define BOARD_FLASH_SIZE_LOG2		23			/* 8 MB */
+#define BOARD_FLASH_MAX_HZ			80000000
+#define BOARD_PLL1_DIVN				70			/* 280 MHz, the H7A3 maximum */
+#define BOARD_HASH					0
+#ifndef FLASH_BUS_OCTOSPI
+#define FLASH_BUS_OCTOSPI			1
+#endif
+#ifndef OSPI_MODE
+#define OSPI_MODE					OSPI_MODE_8D_8D_8D
+#endif
+
+#else
+#error "Unknown BOARD"
+#endif
+
+#define BOARD_FLASH_SIZE			(1UL << BOARD_FLASH_SIZE_LOG2)
+
+/*
+ * Clocks as set up by clock_setup(): PLL1 from the 64 MHz HSI / 8, P
+ * output / 2 for the core, the AHB prescaler halves it for the flash
+ * controller kernel clock (rcc_hclk3)
+ */
+#define BOARD_CPU_HZ				(8000000UL * BOARD_PLL1_DIVN / 2)
+#define BOARD_FLASH_KER_HZ			(BOARD_CPU_HZ / 2)
+
+/* Kernel clock divider - 1 for the QUADSPI/OCTOSPI prescaler fields */
+#define BOARD_FLASH_PRESCALER \
+	((BOARD_FLASH_KER_HZ + BOARD_FLASH_MAX_HZ - 1) / BOARD_FLASH_MAX_HZ - 1)
+
+void board_init_flash_pins(void);
+
+#endif /* _BOARD_H */
@@ -0,0 +1,89 @@
+#include <stdint.h>
+#include "cache.h"
+
+#define AXI_SRAM_BASE		0x24000000
+#define AXI_SRAM_SIZE_LOG2	19	/* 512 KB */
+
+static void cache_barrier(void)
+{
+	__asm volatile ("dsb\n\tisb" ::: "memory");
+}
+
+static int cache_log2(uint32_t size)
+{
+	int n = 0;
+
+	while ((1UL << n) < size)
+		n++;
+	return n;
+}
+
+/* Apply a set/way maintenance operation to the whole L1 data cache */
+static void cache_dcache_all(volatile unsigned long *op)
+{
+	uint32_t ccsidr, sets, ways, set, way;
+
+	SCB_CSSELR = 0;
+	cache_barrier();
+	ccsidr = SCB_CCSIDR;
+	sets = ((ccsidr >> 13) & 0x7fff) + 1;
+	ways = ((ccsidr >> 3) & 0x3ff) + 1;
+
+	/* Cortex-M7: 32 byte lines, 4 ways */
+	for (set = 0; set < sets; set++)
+		for (way = 0; way < ways; way++)
+			*op = (set << 5) | (way << 30);
+	cache_barrier();
+}
+
+/*
+ * Enable the caches for execute-in-place from the memory mapped flash.
+ * With the data cache, the MPU maps the flash window as read-only
+ * write-through and the AXI SRAM as non-cacheable: the debugger writes
+ * the RAMCode and its buffers around the core, which must stay coherent
+ * for the next loader session.
+ */
+void cache_enable(uint32_t xip_base, uint32_t xip_size, int dcache)
+{
+	if (dcache) {
+		MPU_CTRL = 0;
+		cache_barrier();
+
+		MPU_RNR = 0;
+		MPU_RBAR = xip_base;
+		MPU_RASR = MPU_RASR_AP_RO | MPU_RASR_C | MPU_RASR_TEX(0) |
+			MPU_RASR_SIZE(cache_log2(xip_size) - 1) | MPU_RASR_ENABLE;
+
+		MPU_RNR = 1;
+		MPU_RBAR = AXI_SRAM_BASE;
+		MPU_RASR = MPU_RASR_AP_FULL | MPU_RASR_TEX(1) |
+			MPU_RASR_SIZE(AXI_SRAM_SIZE_LOG2 - 1) | MPU_RASR_ENABLE;
+
+		MPU_CTRL = MPU_CTRL_PRIVDEFENA | MPU_CTRL_ENABLE;
+		cache_barrier();
+
+		cache_dcache_all(&SCB_DCISW);
+		SCB_CCR |= SCB_CCR_DC;
+	}
+
+	SCB_ICIALLU = 0;
+	cache_barrier();
+	SCB_CCR |= SCB_CCR_IC;
+	cache_barrier();
+}
+
+/* Undo cache_enable(), the flash content is about to change */
+void cache_disable(void)
+{
+	if (SCB_CCR & SCB_CCR_DC) {
+		SCB_CCR &= ~SCB_CCR_DC;
+		cache_barrier();
+		cache_dcache_all(&SCB_DCCISW);
+		MPU_CTRL = 0;
+	}
+
+	SCB_CCR &= ~SCB_CCR_IC;
+	cache_barrier();
+	SCB_ICIALLU = 0;
+	cache_barrier();
+}
@@ -0,0 +1,40 @@
+
+#ifndef _CACHE_H
+#define _CACHE_H
+
+#include <stdint.h>
+
+/* SCB */
+#define SCB_CCR			(*(volatile unsigned long *)0xE000ED14)
+#define SCB_CCSIDR		(*(volatile unsigned long *)0xE000ED80)
+#define SCB_CSSELR		(*(volatile unsigned long *)0xE000ED84)
+#define SCB_ICIALLU		(*(volatile unsigned long *)0xE000EF50)
+#define SCB_DCISW		(*(volatile unsigned long *)0xE000EF60)
+#define SCB_DCCISW		(*(volatile unsigned long *)0xE000EF74)
+
+#define SCB_CCR_DC				(1 << 16)
+#define SCB_CCR_IC				(1 << 17)
+
+/* MPU */
+#define MPU_CTRL		(*(volatile unsigned long *)0xE000ED94)
+#define MPU_RNR			(*(volatile unsigned long *)0xE000ED98)
+#define MPU_RBAR		(*(volatile unsigned long *)0xE000ED9C)
+#define MPU_RASR		(*(volatile unsigned long *)0xE000EDA0)
+
+#define MPU_CTRL_ENABLE			(1 << 0)
+#define MPU_CTRL_PRIVDEFENA		(1 << 2)
+
+#define MPU_RASR_ENABLE			(1 << 0)
+#define MPU_RASR_SIZE(x)		((x) << 1)	/* region size 2^(x+1) */
+#define MPU_RASR_B				(1 << 16)
+#define MPU_RASR_C				(1 << 17)
+#define MPU_RASR_TEX(x)			((x) << 19)
+#define MPU_RASR_AP(x)			((x) << 24)
+
+#define MPU_RASR_AP_FULL		MPU_RASR_AP(3)
+#define MPU_RASR_AP_RO			MPU_RASR_AP(6)
+
+void cache_enable(uint32_t xip_base, uint32_t xip_size, int dcache);
+void cache_disable(void);
+
+#endif /* _CACHE_H */
@@ -0,0 +1,47 @@
+#ifndef _DWT_H
+#define _DWT_H
+
+#include <stdint.h>
+#include "flash_bus.h"
+
+/*
+ * Cycle counter for timing flash operations: DWT CYCCNT on the target,
+ * the virtual clock of the flash model with FLASH_BUS_SIM=1.
+ */
+#if FLASH_BUS_SIM
+
+#define DWT_CPU_HZ					SIM_CPU_HZ
+#define dwt_enable()				((void)0)
+#define dwt_cycles()				flash_sim_cycles()
+
+#else
+
+#ifndef DWT_CPU_HZ
+#define DWT_CPU_HZ					BOARD_CPU_HZ	/* after clock_setup() */
+#endif
+
+#define DEMCR		(*(volatile unsigned long *)0xe000edfc)
+#define DWT_CTRL	(*(volatile unsigned long *)0xe0001000)
+#define DWT_CYCCNT	(*(volatile unsigned long *)0xe0001004)
+#define DWT_LAR		(*(volatile unsigned long *)0xe0001fb0)
+
+#define DEMCR_TRCENA				(1UL << 24)
+#define DWT_CTRL_CYCCNTENA			(1UL << 0)
+#define DWT_LAR_KEY					0xc5acce55
+
+/* Start CYCCNT unless the debugger or the application already did */
+#define dwt_enable() do {							\
+	if (!(DWT_CTRL & DWT_CTRL_CYCCNTENA)) {				\
+		DEMCR |= DEMCR_TRCENA;					\
+		DWT_LAR = DWT_LAR_KEY;					\
+		DWT_CTRL |= DWT_CTRL_CYCCNTENA;				\
+	}								\
+} while (0)
+#define dwt_cycles()				((uint32_t)DWT_CYCCNT)
+
+#endif
+
+#define DWT_CYCLES(us)				((uint32_t)(us) * (DWT_CPU_HZ / 1000000))
+#define DWT_US(cycles)				((cycles) / (DWT_CPU_HZ / 1000000))
+
+#endif /* _DWT_H */
@@ -0,0 +1,102 @@
+#include <stdint.h>
+#include "stm32h7_regs.h"
+#include "flash.h"
+
+/* Banks unlocked by this loader, relocked by flash_lock() */
+static uint32_t flash_unlocked;
+
+static int flash_bank(uint32_t offset)
+{
+	return offset >= FLASH_BANK_SIZE;
+}
+
+static void flash_unlock_bank(int bank)
+{
+	if (FLASH_CR(bank) & FLASH_CR_LOCK) {
+		FLASH_KEYR(bank) = FLASH_KEY1;
+		FLASH_KEYR(bank) = FLASH_KEY2;
+		flash_unlocked |= 1 << bank;
+	}
+	FLASH_CCR(bank) = FLASH_SR_ERRORS | FLASH_SR_EOP;
+}
+
+static int flash_wait(int bank)
+{
+	uint32_t sr;
+
+	while (FLASH_SR(bank) & (FLASH_SR_QW | FLASH_SR_BSY | FLASH_SR_WBNE));
+
+	sr = FLASH_SR(bank);
+	FLASH_CCR(bank) = sr & (FLASH_SR_ERRORS | FLASH_SR_EOP);
+
+	return (sr & FLASH_SR_ERRORS) ? -1 : 0;
+}
+
+void flash_lock(void)
+{
+	int bank;
+
+	for (bank = 0; bank < 2; bank++)
+		if (flash_unlocked & (1 << bank))
+			FLASH_CR(bank) |= FLASH_CR_LOCK;
+	flash_unlocked = 0;
+}
+
+int flash_erase_sector(uint32_t offset)
+{
+	int bank = flash_bank(offset);
+	uint32_t snb = (offset % FLASH_BANK_SIZE) / FLASH_SECTOR_SIZE;
+	int ret;
+
+	flash_unlock_bank(bank);
+	if (flash_wait(bank))
+		return -1;
+
+	FLASH_CR(bank) = FLASH_CR_SER | FLASH_CR_PSIZE_X64 | FLASH_CR_SNB(snb);
+	FLASH_CR(bank) |= FLASH_CR_START;
+
+	ret = flash_wait(bank);
+	FLASH_CR(bank) &= ~(FLASH_CR_SER | FLASH_CR_SNB(7));
+
+	return ret;
+}
+
+/*
+ * Program whole 256-bit flash words, offset and len must be multiples of
+ * 32. data has no alignment guarantee, every word is staged on the stack.
+ */
+int flash_write(uint32_t offset, const uint8_t *data, int len)
+{
+	int bank = flash_bank(offset);
+	volatile uint32_t *dst = (volatile uint32_t *)(FLASH_MEM_BASE + offset);
+	uint32_t word[FLASH_WORD_SIZE / 4];
+	int i, ret = 0;
+
+	if ((offset | (uint32_t)len) % FLASH_WORD_SIZE)
+		return -1;
+
+	flash_unlock_bank(bank);
+	if (flash_wait(bank))
+		return -1;
+
+	FLASH_CR(bank) = FLASH_CR_PG | FLASH_CR_PSIZE_X64;
+
+	while (len > 0) {
+		for (i = 0; i < FLASH_WORD_SIZE; i++)
+			((uint8_t *)word)[i] = data[i];
+		for (i = 0; i < FLASH_WORD_SIZE / 4; i++)
+			*dst++ = word[i];
+		__asm volatile ("dsb" ::: "memory");
+
+		ret = flash_wait(bank);
+		if (ret)
+			break;
+
+		data += FLASH_WORD_SIZE;
+		len -= FLASH_WORD_SIZE;
+	}
+
+	FLASH_CR(bank) &= ~FLASH_CR_PG;
+
+	return ret;
+}
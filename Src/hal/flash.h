@@ -0,0 +1,50 @@
+#ifndef _FLASH_H
+#define _FLASH_H
+
+#include <stdint.h>
+
+/* FLASH_CRx */
+#define FLASH_CR_LOCK				(1 << 0)
+#define FLASH_CR_PG					(1 << 1)
+#define FLASH_CR_SER				(1 << 2)
+#define FLASH_CR_BER				(1 << 3)
+#define FLASH_CR_PSIZE(x)			((x) << 4)
+#define FLASH_CR_FW					(1 << 6)
+#define FLASH_CR_START				(1 << 7)
+#define FLASH_CR_SNB(x)				((x) << 8)
+
+#define FLASH_CR_PSIZE_X64			FLASH_CR_PSIZE(3)
+
+/* FLASH_SRx / FLASH_CCRx */
+#define FLASH_SR_BSY				(1 << 0)
+#define FLASH_SR_WBNE				(1 << 1)
+#define FLASH_SR_QW					(1 << 2)
+#define FLASH_SR_EOP				(1 << 16)
+#define FLASH_SR_WRPERR				(1 << 17)
+#define FLASH_SR_PGSERR				(1 << 18)
+#define FLASH_SR_STRBERR			(1 << 19)
+#define FLASH_SR_INCERR				(1 << 21)
+#define FLASH_SR_OPERR				(1 << 22)
+
+#define FLASH_SR_ERRORS		(FLASH_SR_WRPERR | FLASH_SR_PGSERR | \
+		FLASH_SR_STRBERR | FLASH_SR_INCERR | FLASH_SR_OPERR)
+
+#define FLASH_KEY1					0x45670123
+#define FLASH_KEY2					0xCDEF89AB
+
+/* Bank 2 registers are at +0x100 from the bank 1 ones */
+#define FLASH_KEYR(b)	(*(volatile unsigned long *)(FLASH_BASE + (b) * 0x100 + 0x04))
+#define FLASH_CR(b)		(*(volatile unsigned long *)(FLASH_BASE + (b) * 0x100 + 0x0c))
+#define FLASH_SR(b)		(*(volatile unsigned long *)(FLASH_BASE + (b) * 0x100 + 0x10))
+#define FLASH_CCR(b)	(*(volatile unsigned long *)(FLASH_BASE + (b) * 0x100 + 0x14))
+
+#define FLASH_MEM_BASE				0x08000000
+#define FLASH_BANK_SIZE				0x00100000
+#define FLASH_SECTOR_SIZE			0x00020000
+#define FLASH_WORD_SIZE				32	/* 256-bit flash word */
+
+void flash_lock(void);
+int flash_erase_sector(uint32_t offset);
+int flash_write(uint32_t offset, const uint8_t *data, int len);
+
+#endif /* _FLASH_H */
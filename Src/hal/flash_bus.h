@@ -0,0 +1,134 @@
+#ifndef _FLASH_BUS_H
+#define _FLASH_BUS_H
+
+/*
+ * Common interface of the external flash bus drivers. The backend is
+ * selected at build time:
+ *   FLASH_BUS_OCTOSPI=0  QUADSPI (STM32H74x/H75x), default
+ *   FLASH_BUS_OCTOSPI=1  OCTOSPI1 (STM32H7A3/H7B0/H72x/H73x), bus mode
+ *                        selected with OSPI_MODE (see ospi.h)
+ *   FLASH_BUS_SIM=1      host model of a QUADSPI NOR (Tools/sim), for
+ *                        building the loader and main.c on Linux
+ *
+ * flash_bus_write() programs whole 256 byte pages and returns the number
+ * of bytes written. With FLASH_BUS_VERIFY_ON_WRITE=1 each page is read
+ * back in indirect mode as soon as the memory is ready again and compared
+ * with the source, the count then stops at the first byte that differs.
+ * This replaces the separate verify pass of the J-Link DLL.
+ *
+ * flash_bus_mmap_mode() selects one of FLASH_BUS_NUM_READ_MODES memory
+ * mapped read modes, 0 being the fastest. flash_bus_ptr() turns a memory
+ * mapped address into a pointer the CPU can read.
+ *
+ * With FLASH_BUS_ERASE_SUSPEND=1 flash_bus_erase_start() returns while the
+ * erase runs, flash_bus_busy() polls it and flash_bus_erase_suspend() /
+ * flash_bus_erase_resume() pause it for reads of other sectors. Without,
+ * flash_bus_erase_start() erases before it returns.
+ *
+ * Stacked-die parts have flash_bus_num_dies() > 1. flash_bus_die_erase_start()
+ * and flash_bus_die_write_start() (one page) then only keep the die of the
+ * address busy until flash_bus_die_busy() returns 0 for it, and the other
+ * dies can be used meanwhile. With one die they block.
+ *
+ * With FLASH_BUS_LATENCY=1 the drivers record the busy time of blocking
+ * erases and page programs in a per-sector map, see latency.h.
+ */
+#include "board.h"	/* backend and mode defaults of the board */
+
+#ifndef FLASH_BUS_OCTOSPI
+#define FLASH_BUS_OCTOSPI			0
+#endif
+#ifndef FLASH_BUS_SIM
+#define FLASH_BUS_SIM				0
+#endif
+#ifndef FLASH_BUS_VERIFY_ON_WRITE
+#define FLASH_BUS_VERIFY_ON_WRITE	0
+#endif
+#ifndef FLASH_BUS_LATENCY
+#define FLASH_BUS_LATENCY			0
+#endif
+
+#if FLASH_BUS_SIM
+
+#include "qspi.h"	/* QSPI_MODE_* and QSPI_XIP_* only */
+#include "flash_sim.h"
+
+#define flash_bus_init()			flash_sim_init()
+#define flash_bus_select_mode()		flash_sim_set_mode(QSPI_PROG_MODE)
+#define flash_bus_erase_sector(a)	((void)flash_sim_erase_sector(a))
+#define flash_bus_write(a, d, n)	flash_sim_write(a, d, n)
+#define flash_bus_mmap()			flash_sim_mmap_mode(QSPI_XIP_1_4_4_CONT)
+#define flash_bus_mmap_mode(m)		flash_sim_mmap_mode(m)
+#define flash_bus_handoff()			flash_sim_mmap_mode(QSPI_XIP_MODE)
+#define flash_bus_ptr(a)			flash_sim_ptr(a)
+#define flash_bus_account_read(n)	flash_sim_account_read(n)
+#define flash_bus_erase_start(a)	((void)flash_sim_erase_start(a))
+#define flash_bus_busy()			flash_sim_busy()
+#define flash_bus_erase_suspend()	flash_sim_erase_suspend()
+#define flash_bus_erase_resume()	flash_sim_erase_resume()
+#define flash_bus_num_dies()		flash_sim_num_dies()
+#define flash_bus_die_of(a)			flash_sim_die_of(a)
+#define flash_bus_die_erase_start(a)	((void)flash_sim_erase_start(a))
+#define flash_bus_die_write_start(a, d)	((void)flash_sim_write_start(a, d))
+#define flash_bus_die_busy(die)		flash_sim_die_busy(die)
+#define FLASH_BUS_NUM_READ_MODES	4
+#define FLASH_BUS_ERASE_SUSPEND		1
+
+#elif FLASH_BUS_OCTOSPI
+
+#include "ospi.h"
+
+#define flash_bus_init()			octospi_init()
+#define flash_bus_select_mode()		octospi_set_mode()
+#define flash_bus_erase_sector(a)	octospi_erase_sector(a)
+#define flash_bus_write(a, d, n)	octospi_write(a, d, n)
+#define flash_bus_mmap()			octospi_mmap()
+#define flash_bus_mmap_mode(m)		octospi_mmap()
+#define flash_bus_handoff()			octospi_mmap()
+#define flash_bus_erase_start(a)	octospi_erase_sector(a)
+#define flash_bus_busy()			0
+#define flash_bus_erase_suspend()	((void)0)
+#define flash_bus_erase_resume()	((void)0)
+#define flash_bus_num_dies()		1
+#define flash_bus_die_of(a)			0
+#define flash_bus_die_erase_start(a)	octospi_erase_sector(a)
+#define flash_bus_die_write_start(a, d)	((void)octospi_write(a, (uint8_t *)(d), 256))
+#define flash_bus_die_busy(die)		0
+#define FLASH_BUS_NUM_READ_MODES	1
+#define FLASH_BUS_ERASE_SUSPEND		0	/* not wired up for the octal parts */
+
+#else
+
+#include "qspi.h"
+
+#define flash_bus_init()			quadspi_init(0, (void *)QUADSPI_BASE)
+#define flash_bus_select_mode()		((void)quadspi_set_mode(QSPI_PROG_MODE))
+#define flash_bus_erase_sector(a)	quadspi_erase_sector(a)
+#define flash_bus_write(a, d, n)	quadspi_write(a, d, n)
+#define flash_bus_mmap()			quadspi_mmap()
+#define flash_bus_mmap_mode(m)		quadspi_mmap_mode(m)
+#define flash_bus_handoff()			((void)quadspi_handoff())
+#define flash_bus_erase_start(a)	quadspi_erase_start(a)
+#define flash_bus_busy()			quadspi_busy()
+#define flash_bus_erase_suspend()	quadspi_erase_suspend()
+#define flash_bus_erase_resume()	quadspi_erase_resume()
+#define flash_bus_num_dies()		quadspi_num_dies()
+#define flash_bus_die_of(a)			quadspi_die_of(a)
+#define flash_bus_die_erase_start(a)	quadspi_die_erase_start(a)
+#define flash_bus_die_write_start(a, d)	quadspi_die_write_start(a, d)
+#define flash_bus_die_busy(die)		quadspi_die_busy(die)
+#define FLASH_BUS_NUM_READ_MODES	4	/* QSPI_XIP_* */
+#ifndef FLASH_BUS_ERASE_SUSPEND
+#define FLASH_BUS_ERASE_SUSPEND		1	/* 0 for parts without erase suspend */
+#endif
+
+#endif
+
+#ifndef flash_bus_ptr
+#define flash_bus_ptr(a)			((const uint8_t *)(a))
+#endif
+#ifndef flash_bus_account_read
+#define flash_bus_account_read(n)	((void)0)	/* host model timing only */
+#endif
+
+#endif /* _FLASH_BUS_H */
@@ -57,6 +57,58 @@ void gpio_set_qspi(void *base, char bank, uint8_t port, uint8_t pupd, uint8_t al
 	gpio_set_alt(base, bank, port, 0, GPIOx_OSPEEDR_OSPEEDRy_HIGH, pupd, altfunc);
 }
 
+/*
+ * Push-pull alternate function setup of a set of pins. The fields of all
+ * pins of a port are merged so that each register of the port sees a
+ * single read-modify-write, MODER last so the pins only switch over once
+ * AF, speed and pull are in place.
+ */
+void gpio_set_alt_pins(void *base, const struct gpio_pin *pins, int num,
+	uint8_t ospeed)
+{
+	volatile uint32_t *GPIOx_base, *GPIOx_MODER, *GPIOx_OTYPER;
+	volatile uint32_t *GPIOx_OSPEEDR, *GPIOx_PUPDR, *GPIOx_AFR;
+	uint32_t mask1, mask2, mode, speed, pupd, afmask[2], af[2];
+	int i, j, k;
+
+	for (i = 0; i < num; i++) {
+		/* Each port once, at its first pin */
+		for (j = 0; j < i && pins[j].bank != pins[i].bank; j++);
+		if (j < i)
+			continue;
+
+		mask1 = mask2 = mode = speed = pupd = 0;
+		afmask[0] = afmask[1] = af[0] = af[1] = 0;
+		for (j = i; j < num; j++) {
+			if (pins[j].bank != pins[i].bank)
+				continue;
+			k = pins[j].port;
+			mask1 |= 1UL << k;
+			mask2 |= GPIOx_MODER_MODERy_MASK << (k * 2);
+			mode |= GPIOx_MODER_MODERy_ALTFUNC << (k * 2);
+			speed |= (uint32_t)ospeed << (k * 2);
+			pupd |= (uint32_t)pins[j].pupd << (k * 2);
+			afmask[k / 8] |= GPIOx_AFRy_MASK << ((k % 8) * 4);
+			af[k / 8] |= (uint32_t)pins[j].altfunc << ((k % 8) * 4);
+		}
+
+		GPIOx_base = base + (pins[i].bank - 'A') * 0x400;
+		GPIOx_MODER   = (void *)GPIOx_base + 0x00;
+		GPIOx_OTYPER  = (void *)GPIOx_base + 0x04;
+		GPIOx_OSPEEDR = (void *)GPIOx_base + 0x08;
+		GPIOx_PUPDR   = (void *)GPIOx_base + 0x0C;
+		GPIOx_AFR     = (void *)GPIOx_base + 0x20;
+
+		for (k = 0; k < 2; k++)
+			if (afmask[k])
+				GPIOx_AFR[k] = (GPIOx_AFR[k] & ~afmask[k]) | af[k];
+		*GPIOx_OTYPER &= ~mask1;
+		*GPIOx_OSPEEDR = (*GPIOx_OSPEEDR & ~mask2) | speed;
+		*GPIOx_PUPDR = (*GPIOx_PUPDR & ~mask2) | pupd;
+		*GPIOx_MODER = (*GPIOx_MODER & ~mask2) | mode;
+	}
+}
+
 void gpio_set_usart(void *base, char bank, uint8_t port, uint8_t altfunc)
 {
 	gpio_set_alt(base, bank, port, 0, GPIOx_OSPEEDR_OSPEEDRy_FAST, 1, altfunc);
@@ -18,12 +18,22 @@
 
 #define GPIOx_AFRy_MASK	0xfUL
 
+/* One alternate function pin, see gpio_set_alt_pins() */
+struct gpio_pin {
+	char bank;
+	uint8_t port;
+	uint8_t altfunc;
+	uint8_t pupd;
+};
+
 void gpio_set(void *base, char bank, uint8_t port, uint8_t otype, uint8_t mode,
 		uint8_t ospeed, uint8_t pupd);
 void gpio_set_alt(void *base, char bank, uint8_t port, uint8_t otype, uint8_t ospeed,
 		uint8_t pupd, uint8_t altfunc);
 void gpio_set_fmc(void *base, char bank, uint8_t port);
-void gpio_set_qspi(void *base, char bank, uint8_t port, uint8_t altfunc, uint8_t pupd);
+void gpio_set_qspi(void *base, char bank, uint8_t port, uint8_t pupd, uint8_t altfunc);
+void gpio_set_alt_pins(void *base, const struct gpio_pin *pins, int num,
+		uint8_t ospeed);
 void gpio_set_usart(void *base, char bank, uint8_t port, uint8_t altfunc);
 
 #endif /* _GPIO_H */
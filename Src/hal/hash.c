@@ -0,0 +1,61 @@
+#include <stdint.h>
+#include "stm32h7_regs.h"
+#include "hash.h"
+
+static uint32_t hash_load(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/*
+ * SHA-256 of a buffer with the HASH peripheral (STM32H750/H753 and other
+ * parts with the crypto option). Data is fed by the CPU in 32-bit words,
+ * byte swapped by the peripheral; DIN stalls the bus while a block is
+ * being processed, so there is no FIFO handling. The source is usually
+ * the memory mapped flash, whose read rate bounds the throughput.
+ * Returns -1 when the peripheral does not respond (not present).
+ */
+int hash_sha256(const uint8_t *data, uint32_t len, uint8_t *digest)
+{
+	uint32_t i, word, timeout;
+
+	RCC_AHB2ENR |= RCC_AHB2ENR_HASHEN;
+	(void)RCC_AHB2ENR;
+
+	HASH_CR = HASH_CR_ALGO_SHA256 | HASH_CR_DATATYPE_8BITS | HASH_CR_INIT;
+	if ((HASH_CR & HASH_CR_ALGO_SHA256) != HASH_CR_ALGO_SHA256)
+		return -1;
+
+	HASH_STR = HASH_STR_NBLW((len % 4) * 8);
+
+	if (((uintptr_t)data & 3) == 0) {
+		for (i = 0; i + 4 <= len; i += 4)
+			HASH_DIN = *(const uint32_t *)(data + i);
+	} else {
+		for (i = 0; i + 4 <= len; i += 4)
+			HASH_DIN = hash_load(data + i);
+	}
+
+	if (len % 4) {
+		/* Valid bytes in the low lanes, NBLW tells how many bits count */
+		for (word = 0; i < len; i++)
+			word |= (uint32_t)data[i] << ((i % 4) * 8);
+		HASH_DIN = word;
+	}
+
+	HASH_STR |= HASH_STR_DCAL;
+
+	for (timeout = HASH_TIMEOUT; !(HASH_SR & HASH_SR_DCIS); timeout--)
+		if (!timeout)
+			return -1;
+
+	for (i = 0; i < 8; i++) {
+		word = HASH_HR(i);
+		digest[4 * i] = word >> 24;
+		digest[4 * i + 1] = word >> 16;
+		digest[4 * i + 2] = word >> 8;
+		digest[4 * i + 3] = word;
+	}
+
+	return 0;
+}
@@ -0,0 +1,37 @@
+#ifndef _HASH_H
+#define _HASH_H
+
+#include <stdint.h>
+
+/* HASH_CR */
+#define HASH_CR_INIT				(1 << 2)
+#define HASH_CR_DATATYPE(x)			((x) << 4)
+#define HASH_CR_ALGO0				(1 << 7)
+#define HASH_CR_ALGO1				(1 << 18)
+
+#define HASH_CR_DATATYPE_8BITS		HASH_CR_DATATYPE(2)	/* byte swapped */
+#define HASH_CR_ALGO_SHA256			(HASH_CR_ALGO1 | HASH_CR_ALGO0)
+
+/* HASH_STR */
+#define HASH_STR_NBLW(x)			((x) << 0)
+#define HASH_STR_DCAL				(1 << 8)
+
+/* HASH_SR */
+#define HASH_SR_DINIS				(1 << 0)
+#define HASH_SR_DCIS				(1 << 1)
+#define HASH_SR_BUSY				(1 << 3)
+
+#define HASH_CR		(*(volatile unsigned long *)(HASH_BASE + 0x000))
+#define HASH_DIN	(*(volatile unsigned long *)(HASH_BASE + 0x004))
+#define HASH_STR	(*(volatile unsigned long *)(HASH_BASE + 0x008))
+#define HASH_SR		(*(volatile unsigned long *)(HASH_BASE + 0x024))
+#define HASH_HR(x)	(*(volatile unsigned long *)(HASH_BASE + 0x310 + (x) * 4))
+
+#define RCC_AHB2ENR	(*(volatile unsigned long *)(RCC_BASE_REG + 0xdc))
+
+/* Polls of HASH_SR before the peripheral is taken as not responding */
+#define HASH_TIMEOUT				0x100000
+
+int hash_sha256(const uint8_t *data, uint32_t len, uint8_t *digest);
+
+#endif /* _HASH_H */
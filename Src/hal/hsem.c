@@ -0,0 +1,51 @@
+#include <stdint.h>
+#include "stm32h7_regs.h"
+#include "hsem.h"
+
+/*
+ * Hardware semaphores as doorbells between the Cortex-M7 (core 1) and the
+ * Cortex-M4 (core 2) of the dual-core STM32H7. Releasing a semaphore sets
+ * its bit in the status register of both cores, the receiving core polls
+ * and clears its own bit. No interrupts are used.
+ */
+
+static int hsem_is_cm4(void)
+{
+	return SCB_CPUID_PARTNO(SCB_CPUID) == SCB_CPUID_PARTNO_CM4;
+}
+
+void hsem_init(void)
+{
+	RCC_AHB4ENR |= RCC_AHB4ENR_HSEMEN;
+	(void)RCC_AHB4ENR;
+}
+
+/* Take and release semaphore id, returns -1 when the peer holds it */
+int hsem_notify(int id)
+{
+	uint32_t coreid = hsem_is_cm4() ? HSEM_COREID_CM4 : HSEM_COREID_CM7;
+
+	/* One-step lock, the read returns the owner */
+	if (HSEM_RLR(id) != (HSEM_R_LOCK | HSEM_R_COREID(coreid)))
+		return -1;
+
+	HSEM_R(id) = HSEM_R_COREID(coreid);
+	return 0;
+}
+
+/* Semaphore id was released since the last call */
+int hsem_event(int id)
+{
+	uint32_t bit = 1UL << id;
+
+	if (hsem_is_cm4()) {
+		if (!(HSEM_C2ISR & bit))
+			return 0;
+		HSEM_C2ICR = bit;
+	} else {
+		if (!(HSEM_C1ISR & bit))
+			return 0;
+		HSEM_C1ICR = bit;
+	}
+	return 1;
+}
@@ -0,0 +1,35 @@
+#ifndef _HSEM_H
+#define _HSEM_H
+
+#include <stdint.h>
+
+/* HSEM_Rx / HSEM_RLRx */
+#define HSEM_R_PROCID(x)			((x) << 0)
+#define HSEM_R_COREID(x)			((x) << 8)
+#define HSEM_R_LOCK					(1UL << 31)
+
+#define HSEM_R_COREID_MASK			HSEM_R_COREID(0xf)
+
+/* COREID of the bus masters */
+#define HSEM_COREID_CM7				3
+#define HSEM_COREID_CM4				1
+
+#define HSEM_R(x)	(*(volatile unsigned long *)(HSEM_BASE + 0x000 + (x) * 4))
+#define HSEM_RLR(x)	(*(volatile unsigned long *)(HSEM_BASE + 0x080 + (x) * 4))
+#define HSEM_C1ICR	(*(volatile unsigned long *)(HSEM_BASE + 0x104))
+#define HSEM_C1ISR	(*(volatile unsigned long *)(HSEM_BASE + 0x108))
+#define HSEM_C2ICR	(*(volatile unsigned long *)(HSEM_BASE + 0x114))
+#define HSEM_C2ISR	(*(volatile unsigned long *)(HSEM_BASE + 0x118))
+
+#define RCC_AHB4ENR	(*(volatile unsigned long *)(RCC_BASE_REG + 0x0e0))
+
+/* SCB_CPUID part number of the core running the code */
+#define SCB_CPUID	(*(volatile unsigned long *)0xe000ed00)
+#define SCB_CPUID_PARTNO(x)			(((x) >> 4) & 0xfff)
+#define SCB_CPUID_PARTNO_CM4		0xc24
+
+void hsem_init(void);
+int hsem_notify(int id);
+int hsem_event(int id);
+
+#endif /* _HSEM_H */
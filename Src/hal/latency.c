@@ -0,0 +1,75 @@
+#include <stdint.h>
+#include "latency.h"
+
+#if FLASH_BUS_LATENCY
+
+static struct latency_map latency_map;
+
+/* Units of 'unit' us, rounded up so that 0 stays "not recorded" */
+static uint8_t latency_units(uint32_t us, uint32_t unit)
+{
+	us = (us + unit - 1) / unit;
+	if (!us)
+		return 1;
+	return us > 255 ? 255 : us;
+}
+
+void latency_erase(uint32_t address, uint32_t start)
+{
+	uint32_t us = DWT_US(dwt_cycles() - start);
+	uint32_t sector = (address >> LATENCY_SECTOR_SHIFT) - LATENCY_FIRST_SECTOR;
+	struct latency_map *m = &latency_map;
+	uint8_t t;
+
+	m->erases++;
+	if (us > m->erase_max_us)
+		m->erase_max_us = us;
+
+	/* Unsigned, sectors below the window wrap above it */
+	if (sector >= LATENCY_SECTORS)
+		return;
+
+	t = latency_units(us, LATENCY_ERASE_UNIT_US);
+	if (!m->erase_min[sector] || t < m->erase_min[sector])
+		m->erase_min[sector] = t;
+	if (t > m->erase_max[sector])
+		m->erase_max[sector] = t;
+	m->erase_last[sector] = t;
+}
+
+void latency_page(uint32_t start)
+{
+	uint32_t us = DWT_US(dwt_cycles() - start);
+	uint32_t bin = us / LATENCY_PAGE_BIN_US;
+	struct latency_map *m = &latency_map;
+
+	m->pages++;
+	if (us > m->page_max_us)
+		m->page_max_us = us;
+	m->page_hist[bin < LATENCY_PAGE_BINS ? bin : LATENCY_PAGE_BINS - 1]++;
+}
+
+const struct latency_map *latency_get(void)
+{
+	struct latency_map *m = &latency_map;
+
+	m->magic = LATENCY_MAGIC;
+	m->size = sizeof(*m);
+	m->sectors = LATENCY_SECTORS;
+	m->first_sector = LATENCY_FIRST_SECTOR;
+	m->erase_unit_us = LATENCY_ERASE_UNIT_US;
+	m->page_bin_us = LATENCY_PAGE_BIN_US;
+
+	return m;
+}
+
+void latency_clear(void)
+{
+	uint8_t *p = (uint8_t *)&latency_map;
+	uint32_t i;
+
+	for (i = 0; i < sizeof(latency_map); i++)
+		p[i] = 0;
+}
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef _LATENCY_H
+#define _LATENCY_H
+
+#include <stdint.h>
+#include "dwt.h"
+
+/*
+ * Busy time map of the external flash, FLASH_BUS_LATENCY=1. The bus
+ * drivers time every blocking sector erase and page program from the end
+ * of the command transfer to WIP clear with the cycle counter and record
+ * it here: min, max and last erase time of each sector of a window of
+ * LATENCY_SECTORS sectors, and a histogram of all page programs.
+ *
+ * Times are stored in units, rounded up and saturated at 255, so that 0
+ * marks a sector that was not erased. Erases are kept in 2 ms units, up
+ * to 510 ms covers the 400 ms tSE max of the common 4KB sector parts.
+ * Erases running in the background (erase_sched.c, die_sched.c on a
+ * stacked-die part) are not recorded, their time includes suspends or
+ * is only seen at the next status read.
+ *
+ * The map lives as long as the loader stays downloaded, over all Init() /
+ * UnInit() of a session. The station reads it in one transfer
+ * (LatencyMap() in FlashPrg.c), the header makes it self-describing.
+ */
+#ifndef LATENCY_SECTORS
+#define LATENCY_SECTORS				512			/* 2 MB of 4KB sectors */
+#endif
+#ifndef LATENCY_FIRST_SECTOR
+#define LATENCY_FIRST_SECTOR		0
+#endif
+#ifndef LATENCY_ERASE_UNIT_US
+#define LATENCY_ERASE_UNIT_US		2000
+#endif
+#ifndef LATENCY_PAGE_BIN_US
+#define LATENCY_PAGE_BIN_US			50
+#endif
+#define LATENCY_PAGE_BINS			16			/* last bin: everything above */
+#define LATENCY_SECTOR_SHIFT		12
+
+#define LATENCY_MAGIC				0x4d54414c	/* "LATM" */
+
+struct latency_map {
+	uint32_t magic;
+	uint16_t size;				/* of this struct */
+	uint16_t sectors;			/* LATENCY_SECTORS */
+	uint32_t first_sector;		/* LATENCY_FIRST_SECTOR */
+	uint16_t erase_unit_us;
+	uint16_t page_bin_us;
+	uint32_t erases;			/* all recorded, also outside the window */
+	uint32_t erase_max_us;		/* slowest of them */
+	uint32_t pages;
+	uint32_t page_max_us;
+	uint32_t page_hist[LATENCY_PAGE_BINS];
+	uint8_t erase_min[LATENCY_SECTORS];
+	uint8_t erase_max[LATENCY_SECTORS];
+	uint8_t erase_last[LATENCY_SECTORS];
+};
+
+#if FLASH_BUS_LATENCY
+
+/* start = dwt_cycles() taken when the operation was issued */
+#define latency_start()				dwt_cycles()
+
+void latency_erase(uint32_t address, uint32_t start);
+void latency_page(uint32_t start);
+const struct latency_map *latency_get(void);
+void latency_clear(void);
+
+#else
+
+#define latency_start()				0
+#define latency_erase(a, start)		((void)(start))
+#define latency_page(start)			((void)(start))
+
+#endif
+
+#endif /* _LATENCY_H */
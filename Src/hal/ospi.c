@@ -0,0 +1,382 @@
+#include <stdint.h>
+#include "stm32h7_regs.h"
+#include "flash_bus.h"
+#include "latency.h"
+
+#if FLASH_BUS_OCTOSPI
+
+#include "qspi.h"
+
+#define RCC_AHB3ENR  (*(volatile unsigned long *)(RCC_BASE_REG + 0xd4))
+
+#define SPI_INSTR	(OCTOSPI_CCR_IMODE(OCTOSPI_LINES_1) | OCTOSPI_CCR_ISIZE_8BITS)
+#define SPI_ADDR24	(OCTOSPI_CCR_ADMODE(OCTOSPI_LINES_1) | OCTOSPI_CCR_ADSIZE_24BITS)
+#define SPI_DATA	OCTOSPI_CCR_DMODE(OCTOSPI_LINES_1)
+
+/* Single line commands, used in all modes until the memory is switched */
+static const struct ospi_cmd spi_wren = {
+	SPI_INSTR, OCTOSPI_TCR_SSHIFT, WRITE_ENABLE_CMD
+};
+static const struct ospi_cmd spi_rdsr = {
+	SPI_INSTR | SPI_DATA, OCTOSPI_TCR_SSHIFT, READ_STATUS_REG_CMD
+};
+static const struct ospi_cmd spi_rsten = {
+	SPI_INSTR, OCTOSPI_TCR_SSHIFT, RESET_ENABLE_CMD
+};
+static const struct ospi_cmd spi_rst = {
+	SPI_INSTR, OCTOSPI_TCR_SSHIFT, RESET_MEMORY_CMD
+};
+
+#if OSPI_MODE == OSPI_MODE_8D_8D_8D
+
+#define OPI_INSTR	(OCTOSPI_CCR_IMODE(OCTOSPI_LINES_8) | OCTOSPI_CCR_IDTR | \
+		OCTOSPI_CCR_ISIZE_16BITS)
+#define OPI_ADDR	(OCTOSPI_CCR_ADMODE(OCTOSPI_LINES_8) | OCTOSPI_CCR_ADDTR | \
+		OCTOSPI_CCR_ADSIZE_32BITS)
+#define OPI_DATA	(OCTOSPI_CCR_DMODE(OCTOSPI_LINES_8) | OCTOSPI_CCR_DDTR)
+
+#define OSPI_MTYP		OCTOSPI_DCR1_MTYP_MACRONIX
+#define OSPI_STATUS_LEN	2	/* DTR returns the status byte twice */
+
+static const struct ospi_cmd spi_wrcr2 = {
+	SPI_INSTR | OCTOSPI_CCR_ADMODE(OCTOSPI_LINES_1) | OCTOSPI_CCR_ADSIZE_32BITS |
+		SPI_DATA, OCTOSPI_TCR_SSHIFT, WRITE_CFG_REG2_CMD
+};
+static const struct ospi_cmd opi_rsten = {
+	OPI_INSTR, OCTOSPI_TCR_DHQC, OPI_RESET_ENABLE_CMD
+};
+static const struct ospi_cmd opi_rst = {
+	OPI_INSTR, OCTOSPI_TCR_DHQC, OPI_RESET_MEMORY_CMD
+};
+static const struct ospi_cmd ospi_wren = {
+	OPI_INSTR, OCTOSPI_TCR_DHQC, OPI_WRITE_ENABLE_CMD
+};
+static const struct ospi_cmd ospi_rdsr = {
+	OPI_INSTR | OPI_ADDR | OPI_DATA,
+	OCTOSPI_TCR_DHQC | OCTOSPI_TCR_DCYC(OPI_STATUS_DUMMY_CYCLES),
+	OPI_READ_STATUS_REG_CMD
+};
+static const struct ospi_cmd ospi_erase = {
+	OPI_INSTR | OPI_ADDR, OCTOSPI_TCR_DHQC, OPI_SECTOR_ERASE_4K_CMD
+};
+static const struct ospi_cmd ospi_prog = {
+	OPI_INSTR | OPI_ADDR | OPI_DATA, OCTOSPI_TCR_DHQC, OPI_PAGE_PROG_CMD
+};
+static const struct ospi_cmd ospi_read = {
+	OPI_INSTR | OPI_ADDR | OPI_DATA | OCTOSPI_CCR_DQSE,
+	OCTOSPI_TCR_DHQC | OCTOSPI_TCR_DCYC(OPI_READ_DUMMY_CYCLES),
+	OPI_DTR_READ_CMD
+};
+
+#else
+
+#define OSPI_MTYP		OCTOSPI_DCR1_MTYP_STANDARD
+#define OSPI_STATUS_LEN	1
+
+#define ospi_wren		spi_wren
+#define ospi_rdsr		spi_rdsr
+
+static const struct ospi_cmd ospi_erase = {
+	SPI_INSTR | SPI_ADDR24, OCTOSPI_TCR_SSHIFT, SECTOR_ERASE_4K_CMD
+};
+
+#if OSPI_MODE == OSPI_MODE_1_4_4
+#define QUAD_ADDR24	(OCTOSPI_CCR_ADMODE(OCTOSPI_LINES_4) | OCTOSPI_CCR_ADSIZE_24BITS)
+#define QUAD_DATA	OCTOSPI_CCR_DMODE(OCTOSPI_LINES_4)
+
+/*
+ * 0x38 is only a quad I/O page program on Macronix and ISSI parts,
+ * Winbond uses it to enter QPI: octospi_set_mode() checks the JEDEC
+ * vendor, the 1-1-4 0x32 program is used until then and otherwise.
+ */
+static const struct ospi_cmd spi_rdid = {
+	SPI_INSTR | SPI_DATA, OCTOSPI_TCR_SSHIFT, READ_JEDEC_ID_CMD
+};
+static const struct ospi_cmd ospi_prog_1_4_4 = {
+	SPI_INSTR | QUAD_ADDR24 | QUAD_DATA, OCTOSPI_TCR_SSHIFT,
+	QUAD_IO_PAGE_PROG_CMD
+};
+static const struct ospi_cmd ospi_prog = {
+	SPI_INSTR | SPI_ADDR24 | QUAD_DATA, OCTOSPI_TCR_SSHIFT,
+	QUAD_PAGE_PROG_CMD
+};
+/* Mode byte in the alternate bytes, instruction only sent once (as QUADSPI) */
+static const struct ospi_cmd ospi_read = {
+	SPI_INSTR | QUAD_ADDR24 | OCTOSPI_CCR_ABMODE(OCTOSPI_LINES_4) |
+		OCTOSPI_CCR_ABSIZE_8BITS | QUAD_DATA | OCTOSPI_CCR_SIOO,
+	OCTOSPI_TCR_SSHIFT | OCTOSPI_TCR_DCYC(4), QUAD_IO_FAST_READ_CMD
+};
+#else
+static const struct ospi_cmd ospi_prog = {
+	SPI_INSTR | SPI_ADDR24 | SPI_DATA, OCTOSPI_TCR_SSHIFT, PAGE_PROG_CMD
+};
+static const struct ospi_cmd ospi_read = {
+	SPI_INSTR | SPI_ADDR24 | SPI_DATA, OCTOSPI_TCR_SSHIFT | OCTOSPI_TCR_DCYC(8),
+	FAST_READ_CMD
+};
+#endif
+
+#endif /* OSPI_MODE */
+
+static const struct ospi_cmd *octospi_prog = &ospi_prog;
+
+static void octospi_busy_wait(void)
+{
+	while (OCTOSPI_SR & OCTOSPI_SR_BUSY);
+}
+
+static void octospi_wait_flag(uint32_t flag)
+{
+	while (!(OCTOSPI_SR & flag));
+	OCTOSPI_FCR = flag;
+}
+
+/* Memory mapped mode keeps BUSY set, it is only left by abort */
+static void octospi_leave_mmap(void)
+{
+	if ((OCTOSPI_CR & OCTOSPI_CR_FMODE_MASK) == OCTOSPI_CR_FMODE_MEMMAP) {
+		OCTOSPI_CR |= OCTOSPI_CR_ABORT;
+		while (OCTOSPI_CR & OCTOSPI_CR_ABORT);
+	}
+}
+
+/* Program the command registers, the last write starts the transfer */
+static void octospi_command(const struct ospi_cmd *cmd, uint32_t fmode,
+	uint32_t address, uint32_t len)
+{
+	octospi_leave_mmap();
+	octospi_busy_wait();
+
+	OCTOSPI_CR = (OCTOSPI_CR & ~OCTOSPI_CR_FMODE_MASK) | fmode;
+	if (len)
+		OCTOSPI_DLR = len - 1;
+	OCTOSPI_TCR = cmd->tcr;
+	OCTOSPI_CCR = cmd->ccr;
+	OCTOSPI_IR = cmd->ir;
+	if (cmd->ccr & OCTOSPI_CCR_ADMODE_MASK)
+		OCTOSPI_AR = address;
+}
+
+static void octospi_poll_status(const struct ospi_cmd *rdsr, uint32_t len,
+	uint32_t mask, uint32_t match)
+{
+	octospi_leave_mmap();
+	octospi_busy_wait();
+
+	OCTOSPI_PSMAR = match;
+	OCTOSPI_PSMKR = mask;
+	OCTOSPI_PIR = 0x10;
+	OCTOSPI_CR |= OCTOSPI_CR_APMS;
+
+	octospi_command(rdsr, OCTOSPI_CR_FMODE_AUTO_POLL, 0, len);
+
+	octospi_wait_flag(OCTOSPI_SR_SMF);
+}
+
+static void octospi_memory_ready(void)
+{
+	octospi_poll_status(&ospi_rdsr, OSPI_STATUS_LEN, N25Q512A_SR_WIP, 0);
+}
+
+static void octospi_write_enable(void)
+{
+	octospi_command(&ospi_wren, OCTOSPI_CR_FMODE_IND_WR, 0, 0);
+	octospi_wait_flag(OCTOSPI_SR_TCF);
+
+	octospi_poll_status(&ospi_rdsr, OSPI_STATUS_LEN, N25Q512A_SR_WREN,
+		N25Q512A_SR_WREN);
+}
+
+static void octospi_reset_memory(void)
+{
+#if OSPI_MODE == OSPI_MODE_8D_8D_8D
+	/* The memory may still be in octal mode from a previous session */
+	octospi_command(&opi_rsten, OCTOSPI_CR_FMODE_IND_WR, 0, 0);
+	octospi_wait_flag(OCTOSPI_SR_TCF);
+	octospi_command(&opi_rst, OCTOSPI_CR_FMODE_IND_WR, 0, 0);
+	octospi_wait_flag(OCTOSPI_SR_TCF);
+#endif
+	octospi_command(&spi_rsten, OCTOSPI_CR_FMODE_IND_WR, 0, 0);
+	octospi_wait_flag(OCTOSPI_SR_TCF);
+	octospi_command(&spi_rst, OCTOSPI_CR_FMODE_IND_WR, 0, 0);
+	octospi_wait_flag(OCTOSPI_SR_TCF);
+
+	octospi_poll_status(&spi_rdsr, 1, N25Q512A_SR_WIP, 0);
+}
+
+#if OSPI_MODE == OSPI_MODE_8D_8D_8D
+static void octospi_enter_opi(void)
+{
+	octospi_command(&spi_wren, OCTOSPI_CR_FMODE_IND_WR, 0, 0);
+	octospi_wait_flag(OCTOSPI_SR_TCF);
+	octospi_poll_status(&spi_rdsr, 1, N25Q512A_SR_WREN, N25Q512A_SR_WREN);
+
+	octospi_command(&spi_wrcr2, OCTOSPI_CR_FMODE_IND_WR, 0, 1);
+	*(volatile uint8_t *)&OCTOSPI_DR = CFG_REG2_DTR_OPI;
+	octospi_wait_flag(OCTOSPI_SR_TCF);
+
+	octospi_memory_ready();
+}
+#endif
+
+void octospi_erase_sector(uint32_t sector)
+{
+	uint32_t start;
+
+	octospi_write_enable();
+
+	octospi_command(&ospi_erase, OCTOSPI_CR_FMODE_IND_WR, sector, 0);
+	octospi_wait_flag(OCTOSPI_SR_TCF);
+	start = latency_start();
+
+	octospi_memory_ready();
+	latency_erase(sector, start);
+}
+
+#if FLASH_BUS_VERIFY_ON_WRITE
+/*
+ * Read a programmed page back with the mode's read command and compare it
+ * with the source. Returns the offset of the first byte that differs, 256
+ * when the page matches.
+ */
+static int octospi_verify_page(uint32_t address, const uint8_t *data)
+{
+	volatile uint8_t *data_reg = (volatile uint8_t *)&OCTOSPI_DR;
+	int i;
+
+	OCTOSPI_ABR = 0xff;	/* no continuous read, the next command is a write enable */
+	octospi_command(&ospi_read, OCTOSPI_CR_FMODE_IND_RD, address, 256);
+
+	for (i = 0; i < 256; i++) {
+		while (!(OCTOSPI_SR & (OCTOSPI_SR_FTF | OCTOSPI_SR_TCF)));
+		if (*data_reg != data[i]) {
+			OCTOSPI_CR |= OCTOSPI_CR_ABORT;
+			while (OCTOSPI_CR & OCTOSPI_CR_ABORT);
+			return i;
+		}
+	}
+
+	octospi_wait_flag(OCTOSPI_SR_TCF);
+
+	return 256;
+}
+#endif
+
+/*
+ * Program whole pages. Returns the number of bytes programmed, with
+ * FLASH_BUS_VERIFY_ON_WRITE the count stops at the first byte that does
+ * not read back.
+ */
+int octospi_write(uint32_t address, uint8_t *data, int len)
+{
+	int txCount, done = 0;
+	uint32_t start;
+
+	while (done < len) {
+		octospi_write_enable();
+
+		octospi_command(octospi_prog, OCTOSPI_CR_FMODE_IND_WR, address, 256);
+
+		/* FIFO threshold is 4 bytes, push whole words */
+		txCount = 256 / 4;
+		while (txCount-- > 0) {
+			while (!(OCTOSPI_SR & OCTOSPI_SR_FTF));
+			OCTOSPI_DR = data[0] | (data[1] << 8) | (data[2] << 16) |
+				((uint32_t)data[3] << 24);
+			data += 4;
+		}
+
+		octospi_wait_flag(OCTOSPI_SR_TCF);
+		start = latency_start();
+
+		octospi_memory_ready();
+		latency_page(start);
+
+#if FLASH_BUS_VERIFY_ON_WRITE
+		txCount = octospi_verify_page(address, data - 256);
+		if (txCount < 256)
+			return done + txCount;
+#endif
+
+		done += 256;
+		address += 256;
+	}
+
+	return len;
+}
+
+void octospi_mmap(void)
+{
+	octospi_leave_mmap();
+	octospi_busy_wait();
+
+	OCTOSPI_CR = (OCTOSPI_CR & ~OCTOSPI_CR_FMODE_MASK) | OCTOSPI_CR_FMODE_MEMMAP;
+	OCTOSPI_ABR = 0x20;
+	OCTOSPI_TCR = ospi_read.tcr;
+	OCTOSPI_CCR = ospi_read.ccr;
+	OCTOSPI_IR = ospi_read.ir;
+
+	octospi_busy_wait();
+}
+
+#if OSPI_MODE == OSPI_MODE_1_4_4
+static uint32_t octospi_read_id(void)
+{
+	volatile uint8_t *data_reg = (volatile uint8_t *)&OCTOSPI_DR;
+	uint32_t id;
+
+	octospi_command(&spi_rdid, OCTOSPI_CR_FMODE_IND_RD, 0, 3);
+	octospi_wait_flag(OCTOSPI_SR_TCF);
+
+	id = *data_reg << 16;
+	id |= *data_reg << 8;
+	id |= *data_reg;
+
+	return id;
+}
+#endif
+
+/*
+ * Pick the page program command, see ospi_prog_1_4_4. The other modes
+ * have one program command each, octal DTR is only built for Macronix
+ * parts.
+ */
+void octospi_set_mode(void)
+{
+#if OSPI_MODE == OSPI_MODE_1_4_4
+	uint32_t vendor = octospi_read_id() >> 16;
+
+	if (vendor == JEDEC_VENDOR_MACRONIX || vendor == JEDEC_VENDOR_ISSI)
+		octospi_prog = &ospi_prog_1_4_4;
+	else
+		octospi_prog = &ospi_prog;
+#endif
+}
+
+void octospi_init(void)
+{
+	RCC_AHB3ENR |= RCC_AHB3ENR_IOMNGREN;
+
+	/* Left in memory mapped mode by a previous session */
+	octospi_leave_mmap();
+
+	OCTOSPI_CR = 0;
+
+	octospi_busy_wait();
+
+	OCTOSPI_DCR1 = OSPI_MTYP | OCTOSPI_DCR1_DEVSIZE(BOARD_FLASH_SIZE_LOG2 - 1) |
+		OCTOSPI_DCR1_CSHT(1) | OCTOSPI_DCR1_DLYBYP;
+	OCTOSPI_DCR2 = OCTOSPI_DCR2_PRESCALER(BOARD_FLASH_PRESCALER);
+
+	OCTOSPI_CR = OCTOSPI_CR_FTHRES(3) | OCTOSPI_CR_EN;
+
+	octospi_reset_memory();
+
+#if OSPI_MODE == OSPI_MODE_8D_8D_8D
+	octospi_enter_opi();
+#endif
+
+	octospi_busy_wait();
+}
+
+#endif /* FLASH_BUS_OCTOSPI */
@@ -0,0 +1,131 @@
+
+#ifndef _OSPI_H
+#define _OSPI_H
+
+#include <stdint.h>
+
+/* Bus modes (instruction-address-data lines, D = DTR) */
+#define OSPI_MODE_1_1_1				0
+#define OSPI_MODE_1_4_4				1
+#define OSPI_MODE_8D_8D_8D			2
+
+#ifndef OSPI_MODE
+#define OSPI_MODE					OSPI_MODE_1_4_4
+#endif
+
+/* OCTOSPI_CR */
+#define OCTOSPI_CR_EN				(1 << 0)
+#define OCTOSPI_CR_ABORT			(1 << 1)
+#define OCTOSPI_CR_TCEN				(1 << 3)
+#define OCTOSPI_CR_FTHRES(x)		((x) << 8)
+#define OCTOSPI_CR_APMS				(1 << 22)
+#define OCTOSPI_CR_FMODE(x)			((x) << 28)
+
+#define OCTOSPI_CR_FMODE_MASK		OCTOSPI_CR_FMODE(3)
+#define OCTOSPI_CR_FMODE_IND_WR		OCTOSPI_CR_FMODE(0)
+#define OCTOSPI_CR_FMODE_IND_RD		OCTOSPI_CR_FMODE(1)
+#define OCTOSPI_CR_FMODE_AUTO_POLL	OCTOSPI_CR_FMODE(2)
+#define OCTOSPI_CR_FMODE_MEMMAP		OCTOSPI_CR_FMODE(3)
+
+/* OCTOSPI_DCR1 */
+#define OCTOSPI_DCR1_DLYBYP			(1 << 3)
+#define OCTOSPI_DCR1_CSHT(x)		((x) << 8)
+#define OCTOSPI_DCR1_DEVSIZE(x)		((x) << 16)
+#define OCTOSPI_DCR1_MTYP(x)		((x) << 24)
+
+#define OCTOSPI_DCR1_DEVSIZE_8MB	OCTOSPI_DCR1_DEVSIZE(22)
+#define OCTOSPI_DCR1_MTYP_MACRONIX	OCTOSPI_DCR1_MTYP(1)
+#define OCTOSPI_DCR1_MTYP_STANDARD	OCTOSPI_DCR1_MTYP(2)
+
+/* OCTOSPI_DCR2 */
+#define OCTOSPI_DCR2_PRESCALER(x)	((x) << 0)
+
+/* OCTOSPI_SR */
+#define OCTOSPI_SR_TEF				(1 << 0)
+#define OCTOSPI_SR_TCF				(1 << 1)
+#define OCTOSPI_SR_FTF				(1 << 2)
+#define OCTOSPI_SR_SMF				(1 << 3)
+#define OCTOSPI_SR_BUSY				(1 << 5)
+
+/* OCTOSPI_CCR */
+#define OCTOSPI_CCR_IMODE(x)		((x) << 0)
+#define OCTOSPI_CCR_IDTR			(1 << 3)
+#define OCTOSPI_CCR_ISIZE(x)		((x) << 4)
+#define OCTOSPI_CCR_ADMODE(x)		((x) << 8)
+#define OCTOSPI_CCR_ADDTR			(1 << 11)
+#define OCTOSPI_CCR_ADSIZE(x)		((x) << 12)
+#define OCTOSPI_CCR_ABMODE(x)		((x) << 16)
+#define OCTOSPI_CCR_ABDTR			(1 << 19)
+#define OCTOSPI_CCR_ABSIZE(x)		((x) << 20)
+#define OCTOSPI_CCR_DMODE(x)		((x) << 24)
+#define OCTOSPI_CCR_DDTR			(1 << 27)
+#define OCTOSPI_CCR_DQSE			(1 << 29)
+#define OCTOSPI_CCR_SIOO			(1 << 31)
+
+#define OCTOSPI_CCR_ADMODE_MASK		OCTOSPI_CCR_ADMODE(7)
+
+/* Line counts for the *MODE fields */
+#define OCTOSPI_LINES_1				1
+#define OCTOSPI_LINES_4				3
+#define OCTOSPI_LINES_8				4
+
+#define OCTOSPI_CCR_ISIZE_8BITS		OCTOSPI_CCR_ISIZE(0)
+#define OCTOSPI_CCR_ISIZE_16BITS	OCTOSPI_CCR_ISIZE(1)
+#define OCTOSPI_CCR_ADSIZE_24BITS	OCTOSPI_CCR_ADSIZE(2)
+#define OCTOSPI_CCR_ADSIZE_32BITS	OCTOSPI_CCR_ADSIZE(3)
+#define OCTOSPI_CCR_ABSIZE_8BITS	OCTOSPI_CCR_ABSIZE(0)
+
+/* OCTOSPI_TCR */
+#define OCTOSPI_TCR_DCYC(x)			((x) << 0)
+#define OCTOSPI_TCR_DHQC			(1 << 28)
+#define OCTOSPI_TCR_SSHIFT			(1 << 30)
+
+#define OCTOSPI_CR	 (*(volatile unsigned long *)(OCTOSPI1_BASE + 0x000))
+#define OCTOSPI_DCR1 (*(volatile unsigned long *)(OCTOSPI1_BASE + 0x008))
+#define OCTOSPI_DCR2 (*(volatile unsigned long *)(OCTOSPI1_BASE + 0x00c))
+#define OCTOSPI_SR	 (*(volatile unsigned long *)(OCTOSPI1_BASE + 0x020))
+#define OCTOSPI_FCR	 (*(volatile unsigned long *)(OCTOSPI1_BASE + 0x024))
+#define OCTOSPI_DLR	 (*(volatile unsigned long *)(OCTOSPI1_BASE + 0x040))
+#define OCTOSPI_AR	 (*(volatile unsigned long *)(OCTOSPI1_BASE + 0x048))
+#define OCTOSPI_DR	 (*(volatile unsigned long *)(OCTOSPI1_BASE + 0x050))
+#define OCTOSPI_PSMKR (*(volatile unsigned long *)(OCTOSPI1_BASE + 0x080))
+#define OCTOSPI_PSMAR (*(volatile unsigned long *)(OCTOSPI1_BASE + 0x088))
+#define OCTOSPI_PIR	 (*(volatile unsigned long *)(OCTOSPI1_BASE + 0x090))
+#define OCTOSPI_CCR	 (*(volatile unsigned long *)(OCTOSPI1_BASE + 0x100))
+#define OCTOSPI_TCR	 (*(volatile unsigned long *)(OCTOSPI1_BASE + 0x108))
+#define OCTOSPI_IR	 (*(volatile unsigned long *)(OCTOSPI1_BASE + 0x110))
+#define OCTOSPI_ABR	 (*(volatile unsigned long *)(OCTOSPI1_BASE + 0x120))
+
+/*
+ * Octal DTR commands (Macronix MX25LM/MX25UM style, the second byte is the
+ * inverted opcode)
+ */
+#define OPI_WRITE_ENABLE_CMD		0x06f9
+#define OPI_READ_STATUS_REG_CMD		0x05fa
+#define OPI_SECTOR_ERASE_4K_CMD		0x21de
+#define OPI_PAGE_PROG_CMD			0x12ed
+#define OPI_DTR_READ_CMD			0xee11
+#define OPI_RESET_ENABLE_CMD		0x6699
+#define OPI_RESET_MEMORY_CMD		0x9966
+
+/* SPI commands used to reach octal DTR mode */
+#define WRITE_CFG_REG2_CMD			0x72
+#define CFG_REG2_DTR_OPI			0x02
+
+#define OPI_READ_DUMMY_CYCLES		20
+#define OPI_STATUS_DUMMY_CYCLES		4
+
+/* One flash command: register values programmed before it is issued */
+struct ospi_cmd {
+	uint32_t ccr;
+	uint32_t tcr;
+	uint32_t ir;
+};
+
+void octospi_init(void);
+void octospi_set_mode(void);
+void octospi_erase_sector(uint32_t sector);
+int octospi_write(uint32_t address, uint8_t *data, int len);
+void octospi_mmap(void);
+
+#endif /* _OSPI_H */
@@ -1,7 +1,331 @@
 #include <stdint.h>
 #include "stm32h7_regs.h"
-#include "qspi.h"
+#include "flash_bus.h"
+#include "latency.h"
+
+#if !FLASH_BUS_OCTOSPI
+
+#define IND_WR_1_LINE	(QUADSPI_CCR_FMODE_IND_WR | QUADSPI_CCR_IDMOD_1_LINE)
+#define POLL_1_LINE		(QUADSPI_CCR_FMODE_AUTO_POLL | QUADSPI_CCR_DMODE_1_LINE | \
+		QUADSPI_CCR_IDMOD_1_LINE)
+#define IND_WR_4_LINES	(QUADSPI_CCR_FMODE_IND_WR | QUADSPI_CCR_IDMOD_4_LINE)
+#define POLL_4_LINES	(QUADSPI_CCR_FMODE_AUTO_POLL | QUADSPI_CCR_DMODE_4_LINES | \
+		QUADSPI_CCR_IDMOD_4_LINE)
+
+/*
+ * Command records, everything is known at compile time. The address is
+ * the only per-call operand and is passed to quadspi_run() / quadspi_issue().
+ */
+static const struct qspi_cmd qspi_wren = {
+	.ccr = IND_WR_1_LINE | WRITE_ENABLE_CMD,
+	.flag = QUADSPI_SR_TCF,
+};
+
+static const struct qspi_cmd qspi_poll_wel = {
+	.ccr = POLL_1_LINE | READ_STATUS_REG_CMD,
+	.dlr = 0,
+	.psmkr = N25Q512A_SR_WREN,
+	.psmar = N25Q512A_SR_WREN,
+	.flag = QUADSPI_SR_SMF,
+};
+
+static const struct qspi_cmd qspi_poll_wip = {
+	.ccr = POLL_1_LINE | READ_STATUS_REG_CMD,
+	.dlr = 0,
+	.psmkr = N25Q512A_SR_WIP,
+	.psmar = 0,
+	.flag = QUADSPI_SR_SMF,
+};
+
+static const struct qspi_cmd qspi_erase_4k = {
+	.ccr = IND_WR_1_LINE | QUADSPI_CCR_ADSIZE_24BITS | QUADSPI_CCR_ADMOD_1_LINE |
+		SECTOR_ERASE_4K_CMD,
+	.flag = QUADSPI_SR_TCF,
+};
+
+static const struct qspi_cmd qspi_rdsr = {
+	.ccr = QUADSPI_CCR_FMODE_IND_RD | QUADSPI_CCR_IDMOD_1_LINE |
+		QUADSPI_CCR_DMODE_1_LINE | READ_STATUS_REG_CMD,
+	.dlr = 0,
+	.flag = QUADSPI_SR_TCF,
+};
+
+static const struct qspi_cmd qspi_suspend = {
+	.ccr = IND_WR_1_LINE | QSPI_ERASE_SUSPEND_CMD,
+	.flag = QUADSPI_SR_TCF,
+};
+
+static const struct qspi_cmd qspi_resume = {
+	.ccr = IND_WR_1_LINE | QSPI_ERASE_RESUME_CMD,
+	.flag = QUADSPI_SR_TCF,
+};
+
+static const struct qspi_cmd qspi_die_select = {
+	.ccr = IND_WR_1_LINE | QUADSPI_CCR_DMODE_1_LINE | SOFTWARE_DIE_SELECT_CMD,
+	.dlr = 0,
+	.flag = QUADSPI_SR_TCF,
+};
+
+static const struct qspi_cmd qspi_page_prog = {
+	.ccr = IND_WR_1_LINE | QUADSPI_CCR_DCYC(0) | QUADSPI_CCR_ADSIZE_24BITS |
+		QUADSPI_CCR_DMODE_4_LINES | QUADSPI_CCR_ADMOD_1_LINE | QUAD_PAGE_PROG_CMD,
+	.dlr = 255,
+	.flag = QUADSPI_SR_TCF,
+};
+
+static const struct qspi_cmd qspi_page_prog_144 = {
+	.ccr = IND_WR_1_LINE | QUADSPI_CCR_ADSIZE_24BITS | QUADSPI_CCR_ADMOD_4_LINE |
+		QUADSPI_CCR_DMODE_4_LINES | QUAD_IO_PAGE_PROG_CMD,
+	.dlr = 255,
+	.flag = QUADSPI_SR_TCF,
+};
+
+/* QPI (4-4-4) variants, instruction, address and status on four lines */
+static const struct qspi_cmd qspi_qpi_wren = {
+	.ccr = IND_WR_4_LINES | WRITE_ENABLE_CMD,
+	.flag = QUADSPI_SR_TCF,
+};
+
+static const struct qspi_cmd qspi_qpi_poll_wel = {
+	.ccr = POLL_4_LINES | READ_STATUS_REG_CMD,
+	.dlr = 0,
+	.psmkr = N25Q512A_SR_WREN,
+	.psmar = N25Q512A_SR_WREN,
+	.flag = QUADSPI_SR_SMF,
+};
+
+static const struct qspi_cmd qspi_qpi_poll_wip = {
+	.ccr = POLL_4_LINES | READ_STATUS_REG_CMD,
+	.dlr = 0,
+	.psmkr = N25Q512A_SR_WIP,
+	.psmar = 0,
+	.flag = QUADSPI_SR_SMF,
+};
+
+static const struct qspi_cmd qspi_qpi_erase_4k = {
+	.ccr = IND_WR_4_LINES | QUADSPI_CCR_ADSIZE_24BITS | QUADSPI_CCR_ADMOD_4_LINE |
+		SECTOR_ERASE_4K_CMD,
+	.flag = QUADSPI_SR_TCF,
+};
+
+static const struct qspi_cmd qspi_qpi_rdsr = {
+	.ccr = QUADSPI_CCR_FMODE_IND_RD | QUADSPI_CCR_IDMOD_4_LINE |
+		QUADSPI_CCR_DMODE_4_LINES | READ_STATUS_REG_CMD,
+	.dlr = 0,
+	.flag = QUADSPI_SR_TCF,
+};
+
+static const struct qspi_cmd qspi_qpi_suspend = {
+	.ccr = IND_WR_4_LINES | QSPI_ERASE_SUSPEND_CMD,
+	.flag = QUADSPI_SR_TCF,
+};
+
+static const struct qspi_cmd qspi_qpi_resume = {
+	.ccr = IND_WR_4_LINES | QSPI_ERASE_RESUME_CMD,
+	.flag = QUADSPI_SR_TCF,
+};
+
+static const struct qspi_cmd qspi_qpi_die_select = {
+	.ccr = IND_WR_4_LINES | QUADSPI_CCR_DMODE_4_LINES | SOFTWARE_DIE_SELECT_CMD,
+	.dlr = 0,
+	.flag = QUADSPI_SR_TCF,
+};
+
+static const struct qspi_cmd qspi_qpi_page_prog = {
+	.ccr = IND_WR_4_LINES | QUADSPI_CCR_ADSIZE_24BITS | QUADSPI_CCR_ADMOD_4_LINE |
+		QUADSPI_CCR_DMODE_4_LINES | PAGE_PROG_CMD,
+	.dlr = 255,
+	.flag = QUADSPI_SR_TCF,
+};
+
+static const struct qspi_cmd qspi_qpi_enter = {
+	.ccr = IND_WR_1_LINE | QSPI_QPI_ENTER_CMD,
+	.flag = QUADSPI_SR_TCF,
+};
+
+static const struct qspi_cmd qspi_qpi_exit = {
+	.ccr = IND_WR_4_LINES | QSPI_QPI_EXIT_CMD,
+	.flag = QUADSPI_SR_TCF,
+};
+
+static const struct qspi_cmd qspi_qpi_rsten = {
+	.ccr = IND_WR_4_LINES | RESET_ENABLE_CMD,
+	.flag = QUADSPI_SR_TCF,
+};
+
+static const struct qspi_cmd qspi_qpi_rst = {
+	.ccr = IND_WR_4_LINES | RESET_MEMORY_CMD,
+	.flag = QUADSPI_SR_TCF,
+};
+
+static const struct qspi_cmd qspi_rdid = {
+	.ccr = QUADSPI_CCR_FMODE_IND_RD | QUADSPI_CCR_IDMOD_1_LINE |
+		QUADSPI_CCR_DMODE_1_LINE | READ_JEDEC_ID_CMD,
+	.dlr = 2,
+	.flag = QUADSPI_SR_TCF,
+};
+
+static const struct qspi_cmd qspi_qpi_rdid = {
+	.ccr = QUADSPI_CCR_FMODE_IND_RD | QUADSPI_CCR_IDMOD_4_LINE |
+		QUADSPI_CCR_DMODE_4_LINES | READ_JEDEC_ID_CMD,
+	.dlr = 2,
+	.flag = QUADSPI_SR_TCF,
+};
+
+static const struct qspi_cmd qspi_rsten = {
+	.ccr = IND_WR_1_LINE | RESET_ENABLE_CMD,
+	.flag = QUADSPI_SR_TCF,
+};
+
+static const struct qspi_cmd qspi_rst = {
+	.ccr = IND_WR_1_LINE | RESET_MEMORY_CMD,
+	.flag = QUADSPI_SR_TCF,
+};
+
+static const struct qspi_cmd qspi_wrsr2 = {
+	.ccr = IND_WR_1_LINE | QUADSPI_CCR_DMODE_1_LINE | 0x31,
+	.dlr = 0,
+	.flag = QUADSPI_SR_TCF,
+};
+
+/* Memory mapped read modes, fastest first, see quadspi_handoff() */
+static const struct qspi_cmd qspi_xip_modes[] = {
+	[QSPI_XIP_1_4_4_CONT] = {
+		.ccr = QUADSPI_CCR_FMODE_MEMMAP | QUADSPI_CCR_DMODE_4_LINES |
+			QUADSPI_CCR_DCYC(4) | QUADSPI_CCR_ADSIZE_24BITS |
+			QUADSPI_CCR_ADMOD_4_LINE | QUADSPI_CCR_ABMOD_4_LINE | QUADSPI_CCR_ABSIZE_8BITS |
+			QUADSPI_CCR_IDMOD_1_LINE | QUAD_IO_FAST_READ_CMD | QUADSPI_CCR_SIOMODE_ONCE,
+		.abr = QSPI_XIP_MODE_BYTE,
+	},
+	[QSPI_XIP_1_4_4] = {
+		.ccr = QUADSPI_CCR_FMODE_MEMMAP | QUADSPI_CCR_DMODE_4_LINES |
+			QUADSPI_CCR_DCYC(4) | QUADSPI_CCR_ADSIZE_24BITS |
+			QUADSPI_CCR_ADMOD_4_LINE | QUADSPI_CCR_ABMOD_4_LINE | QUADSPI_CCR_ABSIZE_8BITS |
+			QUADSPI_CCR_IDMOD_1_LINE | QUAD_IO_FAST_READ_CMD,
+		.abr = 0xff,	/* no continuous read for any vendor */
+	},
+	[QSPI_XIP_1_1_4] = {
+		.ccr = QUADSPI_CCR_FMODE_MEMMAP | QUADSPI_CCR_DMODE_4_LINES |
+			QUADSPI_CCR_DCYC(8) | QUADSPI_CCR_ADSIZE_24BITS |
+			QUADSPI_CCR_ADMOD_1_LINE | QUADSPI_CCR_IDMOD_1_LINE | QUAD_OUTPUT_FAST_READ_CMD,
+	},
+	[QSPI_XIP_1_1_1] = {
+		.ccr = QUADSPI_CCR_FMODE_MEMMAP | QUADSPI_CCR_DMODE_1_LINE |
+			QUADSPI_CCR_DCYC(8) | QUADSPI_CCR_ADSIZE_24BITS |
+			QUADSPI_CCR_ADMOD_1_LINE | QUADSPI_CCR_IDMOD_1_LINE | FAST_READ_CMD,
+	},
+};
+
+/* Reference read for the handoff check, plain 1-1-1 fast read */
+static const struct qspi_cmd qspi_read_ref = {
+	.ccr = QUADSPI_CCR_FMODE_IND_RD | QUADSPI_CCR_DMODE_1_LINE |
+		QUADSPI_CCR_DCYC(8) | QUADSPI_CCR_ADSIZE_24BITS |
+		QUADSPI_CCR_ADMOD_1_LINE | QUADSPI_CCR_IDMOD_1_LINE | FAST_READ_CMD,
+	.dlr = QSPI_XIP_CHECK_SIZE - 1,
+	.flag = QUADSPI_SR_TCF,
+};
+
+/*
+ * Page read back for verify-on-write, 1-1-4. A QPI read cannot be used
+ * instead, its dummy cycles differ per vendor, and leaving QPI for the
+ * read and entering it again for the next page would cost two mode
+ * switches per page, so verify-on-write is not offered with QPI.
+ */
+#if FLASH_BUS_VERIFY_ON_WRITE
+#if QSPI_PROG_MODE == QSPI_MODE_QPI
+#error FLASH_BUS_VERIFY_ON_WRITE needs QSPI_PROG_MODE 1-1-4 or 1-4-4
+#endif
+static const struct qspi_cmd qspi_read_page = {
+	.ccr = QUADSPI_CCR_FMODE_IND_RD | QUADSPI_CCR_DMODE_4_LINES |
+		QUADSPI_CCR_DCYC(8) | QUADSPI_CCR_ADSIZE_24BITS |
+		QUADSPI_CCR_ADMOD_1_LINE | QUADSPI_CCR_IDMOD_1_LINE | QUAD_OUTPUT_FAST_READ_CMD,
+	.dlr = 255,
+	.flag = QUADSPI_SR_TCF,
+};
+#endif
 
+/*
+ * All four lines high for 8 clocks (issued with address 0xffffff): a memory
+ * in continuous read mode takes this as address + mode bits != 0x20 and
+ * returns to command mode, any other memory sees an unused 0xff opcode.
+ */
+static const struct qspi_cmd qspi_mode_reset = {
+	.ccr = IND_WR_4_LINES | QUADSPI_CCR_ADMOD_4_LINE | QUADSPI_CCR_ADSIZE_24BITS | 0xff,
+	.flag = QUADSPI_SR_TCF,
+};
+
+/* Commands used for program/erase, one set per QSPI_MODE_* */
+struct qspi_cmd_set {
+	const struct qspi_cmd *wren;
+	const struct qspi_cmd *poll_wel;
+	const struct qspi_cmd *poll_wip;
+	const struct qspi_cmd *erase;
+	const struct qspi_cmd *prog;
+	const struct qspi_cmd *rdsr;
+	const struct qspi_cmd *suspend;
+	const struct qspi_cmd *resume;
+	const struct qspi_cmd *die_sel;
+};
+
+static const struct qspi_cmd_set qspi_sets[] = {
+	[QSPI_MODE_1_1_4] = {
+		&qspi_wren, &qspi_poll_wel, &qspi_poll_wip,
+		&qspi_erase_4k, &qspi_page_prog,
+		&qspi_rdsr, &qspi_suspend, &qspi_resume,
+		&qspi_die_select
+	},
+	[QSPI_MODE_1_4_4] = {
+		&qspi_wren, &qspi_poll_wel, &qspi_poll_wip,
+		&qspi_erase_4k, &qspi_page_prog_144,
+		&qspi_rdsr, &qspi_suspend, &qspi_resume,
+		&qspi_die_select
+	},
+	[QSPI_MODE_QPI] = {
+		&qspi_qpi_wren, &qspi_qpi_poll_wel, &qspi_qpi_poll_wip,
+		&qspi_qpi_erase_4k, &qspi_qpi_page_prog,
+		&qspi_qpi_rdsr, &qspi_qpi_suspend, &qspi_qpi_resume,
+		&qspi_qpi_die_select
+	},
+};
+
+static const struct qspi_cmd_set *quadspi_set = &qspi_sets[QSPI_MODE_1_1_4];
+static int quadspi_mode = QSPI_MODE_1_1_4;
+static int quadspi_qpi_active;
+
+/*
+ * Stacked-die parts with a software die select (0xc2), identified by
+ * their JEDEC ID. Every die has its own WIP, so one can erase or program
+ * while another one is busy.
+ *
+ * A part may only be listed when every die is reachable with 24-bit
+ * addresses inside the QUADSPI_DCR FSIZE window, and memory mapped reads
+ * only ever see die 0 (quadspi_die_idle()). The W25M512JV (2x 32 MB)
+ * fails both, it needs 4-byte addressing and a die select + indirect
+ * read for the read-back of die 1, so none is listed yet.
+ */
+static const struct {
+	uint32_t id;
+	uint8_t dies;
+	uint8_t die_size_log2;
+} qspi_stacked[] = {
+	{ 0 },	/* end of list */
+};
+
+static int quadspi_dies = 1;
+static int quadspi_die_shift;
+static int quadspi_die = -1;		/* selected die, -1 = unknown */
+static uint32_t quadspi_die_busy_mask;	/* dies left busy by quadspi_die_*_start() */
+
+/*
+ * Last values written to the operand registers. quadspi_issue() only
+ * writes a register when a command needs it and the value differs.
+ */
+static struct {
+	uint32_t dlr;
+	uint32_t abr;
+	uint32_t psmkr;
+	uint32_t psmar;
+} quadspi_shadow;
 
 void quadspi_busy_wait(void *base)
 {
@@ -14,168 +338,549 @@ void quadspi_wait_flag(void *base, uint32_t flag)
 	QUADSPI_FCR = flag;
 }
 
-void quadspi_write_enable(void *base)
+/* Start a command, CCR (and AR for commands with an address) start the transfer */
+void quadspi_issue(const struct qspi_cmd *cmd, uint32_t address)
 {
-	quadspi_busy_wait(base);
+	uint32_t ccr = cmd->ccr;
 
-	QUADSPI_CCR = QUADSPI_CCR_FMODE_IND_WR | QUADSPI_CCR_IDMOD_1_LINE |
-		WRITE_ENABLE_CMD;
+	quadspi_busy_wait(0);
 
-	quadspi_wait_flag(base, QUADSPI_SR_TCF);
+	if ((ccr & QUADSPI_CCR_DMODE_MASK) && cmd->dlr != quadspi_shadow.dlr) {
+		QUADSPI_DLR = cmd->dlr;
+		quadspi_shadow.dlr = cmd->dlr;
+	}
+	if ((ccr & QUADSPI_CCR_ABMODE_MASK) && cmd->abr != quadspi_shadow.abr) {
+		QUADSPI_ABR = cmd->abr;
+		quadspi_shadow.abr = cmd->abr;
+	}
+	if ((ccr & QUADSPI_CCR_FMODE_MASK) == QUADSPI_CCR_FMODE_AUTO_POLL) {
+		if (cmd->psmkr != quadspi_shadow.psmkr) {
+			QUADSPI_PSMKR = cmd->psmkr;
+			quadspi_shadow.psmkr = cmd->psmkr;
+		}
+		if (cmd->psmar != quadspi_shadow.psmar) {
+			QUADSPI_PSMAR = cmd->psmar;
+			quadspi_shadow.psmar = cmd->psmar;
+		}
+	}
+
+	QUADSPI_CCR = ccr;
+	if ((ccr & QUADSPI_CCR_ADMODE_MASK) &&
+	    (ccr & QUADSPI_CCR_FMODE_MASK) != QUADSPI_CCR_FMODE_MEMMAP)
+		QUADSPI_AR = address;
+}
 
-	quadspi_busy_wait(base);
+/* Issue a command without data phase and wait for its completion flag */
+void quadspi_run(const struct qspi_cmd *cmd, uint32_t address)
+{
+	quadspi_issue(cmd, address);
+	quadspi_wait_flag(0, cmd->flag);
+}
 
-	QUADSPI_PSMAR = N25Q512A_SR_WREN;
-	QUADSPI_PSMKR = N25Q512A_SR_WREN;
-	QUADSPI_PIR = 0x10;
+static uint32_t quadspi_read_id(const struct qspi_cmd *cmd)
+{
+	volatile uint8_t *data_reg = (volatile uint8_t *)&QUADSPI_DR;
+	uint32_t id;
 
-	QUADSPI_CR |= QUADSPI_CR_AMPS;
-	QUADSPI_DLR = 0;
-	QUADSPI_CCR = QUADSPI_CCR_FMODE_AUTO_POLL | QUADSPI_CCR_DMODE_1_LINE |
-		QUADSPI_CCR_IDMOD_1_LINE | READ_STATUS_REG_CMD;
+	quadspi_run(cmd, 0);
+
+	id = *data_reg << 16;
+	id |= *data_reg << 8;
+	id |= *data_reg;
+
+	return id;
+}
+
+static void quadspi_abort(void)
+{
+	QUADSPI_CR |= QUADSPI_CR_ABORT;
+	while (QUADSPI_CR & QUADSPI_CR_ABORT);
+}
+
+/*
+ * Memory mapped mode keeps BUSY set after the first access and may have
+ * left the memory in continuous read, leave both before other commands
+ */
+static void quadspi_leave_mmap(void)
+{
+	if ((QUADSPI_CCR & QUADSPI_CCR_FMODE_MASK) == QUADSPI_CCR_FMODE_MEMMAP) {
+		quadspi_abort();
+		quadspi_run(&qspi_mode_reset, 0xffffff);
+	}
+}
+
+/* Switch the memory to QPI on first use, mmap() switches it back */
+static void quadspi_command_mode(void)
+{
+	quadspi_leave_mmap();
+
+	if (quadspi_mode == QSPI_MODE_QPI && !quadspi_qpi_active) {
+		quadspi_run(&qspi_qpi_enter, 0);
+		quadspi_qpi_active = 1;
+	}
+}
 
-	quadspi_wait_flag(base, QUADSPI_SR_SMF);
+static void quadspi_exit_qpi(void)
+{
+	if (quadspi_qpi_active) {
+		quadspi_run(&qspi_qpi_exit, 0);
+		quadspi_qpi_active = 0;
+	}
+}
+
+/*
+ * Select the command mode used by erase/program and detect stacked-die
+ * parts. The mode is only taken when the memory passes a self test,
+ * otherwise 1-1-4 stays in use:
+ * - 1-4-4: 0x38 is only a quad page program on Macronix and ISSI parts
+ *   (Winbond uses it to enter QPI), so the JEDEC vendor is checked.
+ * - QPI: the JEDEC ID read in QPI must match the one read in SPI mode.
+ * Returns the mode in use.
+ */
+int quadspi_set_mode(int mode)
+{
+	uint32_t id, vendor, i;
+
+	quadspi_exit_qpi();
+	quadspi_mode = QSPI_MODE_1_1_4;
+
+	id = quadspi_read_id(&qspi_rdid);
+	vendor = id >> 16;
+
+	quadspi_dies = 1;
+	quadspi_die = -1;
+	quadspi_die_busy_mask = 0;
+	for (i = 0; qspi_stacked[i].id; i++) {
+		if (qspi_stacked[i].id == id) {
+			quadspi_dies = qspi_stacked[i].dies;
+			quadspi_die_shift = qspi_stacked[i].die_size_log2;
+		}
+	}
+
+	if (vendor == 0x00 || vendor == 0xff)
+		mode = QSPI_MODE_1_1_4;
+
+	if (mode == QSPI_MODE_1_4_4 &&
+	    vendor != JEDEC_VENDOR_MACRONIX && vendor != JEDEC_VENDOR_ISSI)
+		mode = QSPI_MODE_1_1_4;
+
+	if (mode == QSPI_MODE_QPI) {
+		quadspi_run(&qspi_qpi_enter, 0);
+		quadspi_qpi_active = 1;
+		if (quadspi_read_id(&qspi_qpi_rdid) != id) {
+			quadspi_exit_qpi();
+			mode = QSPI_MODE_1_1_4;
+		}
+	}
+
+	quadspi_mode = mode;
+	quadspi_set = &qspi_sets[mode];
+
+	return mode;
+}
+
+void quadspi_write_enable(void *base)
+{
+	quadspi_run(quadspi_set->wren, 0);
+	quadspi_run(quadspi_set->poll_wel, 0);
 }
 
 void quadspi_memory_ready(void *base)
 {
-	quadspi_busy_wait(base);
+	quadspi_run(quadspi_set->poll_wip, 0);
+}
 
-	QUADSPI_PSMAR = 0;
-	QUADSPI_PSMKR = N25Q512A_SR_WIP;
-	QUADSPI_PIR = 0x10;
+int quadspi_num_dies(void)
+{
+	return quadspi_dies;
+}
 
-	QUADSPI_CR |= QUADSPI_CR_AMPS;
-	QUADSPI_DLR = 0;
-	QUADSPI_CCR = QUADSPI_CCR_FMODE_AUTO_POLL | QUADSPI_CCR_DMODE_1_LINE |
-		QUADSPI_CCR_IDMOD_1_LINE | READ_STATUS_REG_CMD;
+int quadspi_die_of(uint32_t address)
+{
+	return quadspi_dies > 1 ? address >> quadspi_die_shift : 0;
+}
+
+static void quadspi_select_die(int die)
+{
+	if (quadspi_dies == 1 || die == quadspi_die)
+		return;
 
-	quadspi_wait_flag(base, QUADSPI_SR_SMF);
+	quadspi_issue(quadspi_set->die_sel, 0);
+	quadspi_wait_flag(0, QUADSPI_SR_FTF);
+	*(volatile uint8_t *)&QUADSPI_DR = die;
+	quadspi_wait_flag(0, quadspi_set->die_sel->flag);
+
+	quadspi_die = die;
+}
+
+/*
+ * Command mode on the die of an address, waiting for it when a
+ * quadspi_die_*_start() left it busy. Returns the address in the die.
+ */
+static uint32_t quadspi_die_prepare(uint32_t address)
+{
+	int die = quadspi_die_of(address);
+
+	quadspi_command_mode();
+
+	quadspi_select_die(die);
+	if (quadspi_die_busy_mask & (1 << die)) {
+		quadspi_memory_ready(0);
+		quadspi_die_busy_mask &= ~(1 << die);
+	}
+
+	return quadspi_dies > 1 ? address & ((1UL << quadspi_die_shift) - 1) : address;
+}
+
+/* Wait for all dies, memory mapped reads see die 0 */
+static void quadspi_die_idle(void)
+{
+	int die;
+
+	if (quadspi_dies == 1 || (!quadspi_die_busy_mask && quadspi_die == 0))
+		return;
+
+	for (die = 0; die < quadspi_dies; die++)
+		if (quadspi_die_busy_mask & (1 << die))
+			quadspi_die_prepare((uint32_t)die << quadspi_die_shift);
+	quadspi_select_die(0);
 }
 
 void quadspi_erase_sector(uint32_t sector)
 {
-//    quadspi_busy_wait((void*)QUADSPI_BASE);
-//    *QUADSPI_CCR = QUADSPI_CCR_FMODE_IND_WR;
-        quadspi_busy_wait((void*)QUADSPI_BASE);
+	uint32_t die_sector = quadspi_die_prepare(sector), start;
 
-        quadspi_write_enable((void*)QUADSPI_BASE);
+	quadspi_write_enable(0);
 
-        quadspi_busy_wait((void*)QUADSPI_BASE);
+	quadspi_run(quadspi_set->erase, die_sector);
+	start = latency_start();
 
-	QUADSPI_CCR = QUADSPI_CCR_FMODE_IND_WR |
-                QUADSPI_CCR_ADSIZE_24BITS |
-		QUADSPI_CCR_ADMOD_1_LINE | 
-                QUADSPI_CCR_IDMOD_1_LINE | 0x20;
-        QUADSPI_AR = sector;
+	quadspi_memory_ready(0);
+	latency_erase(sector, start);
+}
 
-        quadspi_wait_flag((void*)QUADSPI_BASE, QUADSPI_SR_TCF);
+/* Start a sector erase without waiting, see quadspi_busy() */
+void quadspi_erase_start(uint32_t sector)
+{
+	sector = quadspi_die_prepare(sector);
 
-        quadspi_memory_ready((void*)QUADSPI_BASE);
+	quadspi_write_enable(0);
+
+	quadspi_run(quadspi_set->erase, sector);
 }
 
-void quadspi_write(uint32_t address,uint8_t *data,int len)
+/*
+ * Erase and page program that only keep their die busy, see
+ * quadspi_die_busy(). Other dies can be used meanwhile, the next command
+ * to the same die waits for it.
+ */
+void quadspi_die_erase_start(uint32_t sector)
 {
-  int txCount;
-  volatile uint32_t *data_reg = &QUADSPI_DR;
-  while(len > 0){
-    quadspi_write_enable((void*)QUADSPI_BASE);
+	uint32_t start;
+
+	quadspi_erase_start(sector);
+	start = latency_start();
 
-    quadspi_busy_wait((void*)QUADSPI_BASE);
+	if (quadspi_dies > 1) {
+		quadspi_die_busy_mask |= 1 << quadspi_die;
+	} else {
+		quadspi_memory_ready(0);
+		latency_erase(sector, start);
+	}
+}
 
-    QUADSPI_DLR = 255;
-    QUADSPI_CCR = QUADSPI_CCR_FMODE_IND_WR | 
-		QUADSPI_CCR_DCYC(0) | QUADSPI_CCR_ADSIZE_24BITS | QUADSPI_CCR_DMODE_4_LINES |
-		QUADSPI_CCR_ADMOD_1_LINE | QUADSPI_CCR_IDMOD_1_LINE | 0x32;
-    QUADSPI_AR = address;
+void quadspi_die_write_start(uint32_t address, const uint8_t *data)
+{
+	volatile uint8_t *data_reg = (volatile uint8_t *)&QUADSPI_DR;
+	const struct qspi_cmd *prog = quadspi_set->prog;
+	uint32_t start;
+	int i;
+
+	address = quadspi_die_prepare(address);
+
+	quadspi_write_enable(0);
+
+	quadspi_issue(prog, address);
+	for (i = 0; i < 256; i++) {
+		quadspi_wait_flag(0, QUADSPI_SR_FTF);
+		*data_reg = data[i];
+	}
+	quadspi_wait_flag(0, prog->flag);
+	start = latency_start();
+
+	if (quadspi_dies > 1) {
+		quadspi_die_busy_mask |= 1 << quadspi_die;
+	} else {
+		quadspi_memory_ready(0);
+		latency_page(start);
+	}
+}
+
+/* One status register read of a die left busy, returns WIP */
+int quadspi_die_busy(int die)
+{
+	volatile uint8_t *data_reg = (volatile uint8_t *)&QUADSPI_DR;
+
+	if (!(quadspi_die_busy_mask & (1 << die)))
+		return 0;
+
+	quadspi_command_mode();
+	quadspi_select_die(die);
+
+	quadspi_run(quadspi_set->rdsr, 0);
+	if (*data_reg & N25Q512A_SR_WIP)
+		return 1;
+
+	quadspi_die_busy_mask &= ~(1 << die);
+	return 0;
+}
+
+/* One status register read, returns WIP */
+int quadspi_busy(void)
+{
+	volatile uint8_t *data_reg = (volatile uint8_t *)&QUADSPI_DR;
+
+	quadspi_command_mode();
+
+	quadspi_run(quadspi_set->rdsr, 0);
+
+	return *data_reg & N25Q512A_SR_WIP;
+}
+
+/*
+ * Suspend a running erase. WIP clears once the memory can be read (tSUS),
+ * except for the sector being erased. No effect when the erase is done.
+ */
+void quadspi_erase_suspend(void)
+{
+	quadspi_command_mode();
+
+	quadspi_run(quadspi_set->suspend, 0);
+
+	quadspi_memory_ready(0);
+}
+
+void quadspi_erase_resume(void)
+{
+	quadspi_command_mode();
+
+	quadspi_run(quadspi_set->resume, 0);
+}
+
+#if FLASH_BUS_VERIFY_ON_WRITE
+/*
+ * Read a programmed page back and compare it with the source. Returns the
+ * offset of the first byte that differs, 256 when the page matches.
+ */
+static int quadspi_verify_page(uint32_t address, const uint8_t *data)
+{
+	volatile uint8_t *data_reg = (volatile uint8_t *)&QUADSPI_DR;
+	int i;
+
+	quadspi_issue(&qspi_read_page, address);
+
+	for (i = 0; i < 256; i++) {
+		quadspi_wait_flag(0, QUADSPI_SR_FTF);
+		if (*data_reg != data[i]) {
+			quadspi_abort();
+			return i;
+		}
+	}
+
+	quadspi_wait_flag(0, qspi_read_page.flag);
+
+	return 256;
+}
+#endif
+
+/*
+ * Program whole pages. Returns the number of bytes programmed, with
+ * FLASH_BUS_VERIFY_ON_WRITE the count stops at the first byte that does
+ * not read back.
+ */
+int quadspi_write(uint32_t address,uint8_t *data,int len)
+{
+  int txCount, done = 0;
+  volatile uint8_t *data_reg = (volatile uint8_t *)&QUADSPI_DR;
+  const struct qspi_cmd *prog = quadspi_set->prog;
+  uint32_t die_address, start;
+
+  while(done < len){
+    die_address = quadspi_die_prepare(address);
+
+    quadspi_write_enable(0);
+
+    quadspi_issue(prog, die_address);
 
     txCount = 256;
     while(txCount-- > 0){
-      quadspi_wait_flag((void*)QUADSPI_BASE, QUADSPI_SR_FTF);
-       *(volatile uint8_t *)data_reg = *data ++;
+      quadspi_wait_flag(0, QUADSPI_SR_FTF);
+      *data_reg = *data ++;
     }
 
-    quadspi_wait_flag((void*)QUADSPI_BASE, QUADSPI_SR_TCF);
-
-    len -= 256;
-    address += 256;
+    quadspi_wait_flag(0, prog->flag);
+    start = latency_start();
 
     quadspi_memory_ready(0);
+    latency_page(start);
+
+#if FLASH_BUS_VERIFY_ON_WRITE
+    txCount = quadspi_verify_page(die_address, data - 256);
+    if (txCount < 256)
+      return done + txCount;
+#endif
+
+    done += 256;
+    address += 256;
   }
+
+  return len;
 }
 
 void quadspi_reset_memory(void *base)
 {
-	/* Reset memory */
-	quadspi_busy_wait(base);
-
-	QUADSPI_CCR = QUADSPI_CCR_FMODE_IND_WR | QUADSPI_CCR_IDMOD_1_LINE |
-		RESET_ENABLE_CMD;
-
-	quadspi_wait_flag(base, QUADSPI_SR_TCF);
-
-	QUADSPI_CCR = QUADSPI_CCR_FMODE_IND_WR | QUADSPI_CCR_IDMOD_1_LINE |
-		RESET_MEMORY_CMD;
-
-	quadspi_wait_flag(base, QUADSPI_SR_TCF);
+	/*
+	 * Reset memory, leave continuous read and QPI first in case the
+	 * application or a previous session left it there
+	 */
+	quadspi_run(&qspi_mode_reset, 0xffffff);
+	quadspi_run(&qspi_qpi_rsten, 0);
+	quadspi_run(&qspi_qpi_rst, 0);
+	quadspi_run(&qspi_rsten, 0);
+	quadspi_run(&qspi_rst, 0);
 }
 
 void quadspi_write_sr2()
 {
     quadspi_write_enable(0);
-    QUADSPI_DLR = 1;
-    QUADSPI_CCR = QUADSPI_CCR_FMODE_IND_WR | QUADSPI_CCR_IDMOD_1_LINE |
-		0x31;
+
+    quadspi_issue(&qspi_wrsr2, 0);
 
     while (!(QUADSPI_SR & QUADSPI_SR_FTF));
 
-    QUADSPI_DR = 0x02;
+    *(volatile uint8_t *)&QUADSPI_DR = 0x02;
+
+    quadspi_wait_flag(0, qspi_wrsr2.flag);
+}
+
+/* Memory mapped read in one of the QSPI_XIP_* modes */
+void quadspi_mmap_mode(int mode)
+{
+	quadspi_leave_mmap();
+	quadspi_die_idle();
+	quadspi_exit_qpi();
 
-    quadspi_wait_flag(0, QUADSPI_SR_TCF);
+	quadspi_issue(&qspi_xip_modes[mode], 0);
+	quadspi_busy_wait(0);
 }
 
 void quadspi_mmap(void)
 {
-/*	QUADSPI_CCR = QUADSPI_CCR_FMODE_MEMMAP | QUADSPI_CCR_DMODE_4_LINES |
-		QUADSPI_CCR_DCYC(8) | QUADSPI_CCR_ADSIZE_24BITS |
-		QUADSPI_CCR_ADMOD_1_LINE | QUADSPI_CCR_IDMOD_1_LINE |
-		QUAD_OUTPUT_FAST_READ_CMD;*/
-        QUADSPI_ABR = 0x20;
-	QUADSPI_CCR = QUADSPI_CCR_FMODE_MEMMAP | QUADSPI_CCR_DMODE_4_LINES |
-		QUADSPI_CCR_DCYC(4) | QUADSPI_CCR_ADSIZE_24BITS |
-		QUADSPI_CCR_ADMOD_4_LINE | QUADSPI_CCR_ABMOD_4_LINE | QUADSPI_CCR_ABSIZE_8BITS |
-                QUADSPI_CCR_IDMOD_1_LINE | QUAD_IO_FAST_READ_CMD | QUADSPI_CCR_SIOMODE_ONCE;
+	quadspi_mmap_mode(QSPI_XIP_1_4_4_CONT);
+}
+
+/* Compare memory mapped reads against the indirect reference reads */
+static int quadspi_xip_check(uint32_t ref[][QSPI_XIP_CHECK_SIZE / 4])
+{
+	volatile uint32_t *mem;
+	int i, j;
+
+	for (i = 0; i < 2; i++) {
+		mem = QUADSPI_MEM(i * QSPI_XIP_CHECK_STRIDE);
+		for (j = 0; j < QSPI_XIP_CHECK_SIZE / 4; j++)
+			if (mem[j] != ref[i][j])
+				return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Leave the controller in memory mapped mode for execute-in-place after
+ * flashing. Starting at QSPI_XIP_MODE, each read mode is checked against
+ * reference data read in 1-1-1 at two locations (the second access also
+ * exercises continuous read re-entry), the first one that matches is
+ * kept. On a blank memory there is nothing to compare and QSPI_XIP_MODE
+ * is used as is. The controller is not re-initialised and the memory is
+ * not reset. Init(3) and Verify() leave the flash mapped, leave that
+ * first. Returns the read mode in use.
+ */
+int quadspi_handoff(void)
+{
+	uint32_t ref[2][QSPI_XIP_CHECK_SIZE / 4];
+	int mode, i, j, blank = 1;
+
+	quadspi_leave_mmap();
+	quadspi_die_idle();
+	quadspi_exit_qpi();
+
+	for (i = 0; i < 2; i++) {
+		quadspi_run(&qspi_read_ref, i * QSPI_XIP_CHECK_STRIDE);
+		for (j = 0; j < QSPI_XIP_CHECK_SIZE / 4; j++) {
+			ref[i][j] = QUADSPI_DR;
+			if (ref[i][j] != 0xffffffff)
+				blank = 0;
+		}
+	}
+
+	/*
+	 * Without timeout nCS stays low after an access so that the next
+	 * sequential fetch continues the burst (prefetch friendly).
+	 */
 	quadspi_busy_wait(0);
+	if (QSPI_XIP_TIMEOUT) {
+		QUADSPI_LPTR = QSPI_XIP_TIMEOUT;
+		QUADSPI_CR |= QUADSPI_CR_TCEN;
+	} else {
+		QUADSPI_CR &= ~QUADSPI_CR_TCEN;
+	}
+
+	for (mode = QSPI_XIP_MODE; mode < QSPI_XIP_1_1_1; mode++) {
+		quadspi_issue(&qspi_xip_modes[mode], 0);
+		if (blank || !quadspi_xip_check(ref))
+			return mode;
+
+		quadspi_abort();
+		quadspi_run(&qspi_mode_reset, 0xffffff);
+	}
+
+	quadspi_issue(&qspi_xip_modes[QSPI_XIP_1_1_1], 0);
+
+	return QSPI_XIP_1_1_1;
 }
 
 void quadspi_init(struct qspi_params *params, void *base)
 {
-	uint32_t reg;
-
 	QUADSPI_CR = QUADSPI_CR_FTHRES(0);
 
 	quadspi_busy_wait(base);
 
-    QUADSPI_CR |= QUADSPI_CR_PRESCALER(1) | QUADSPI_CR_SSHIFT;
-    QUADSPI_DCR = QUADSPI_DCR_FSIZE_8MB | QUADSPI_DCR_CSHT(1);
+    QUADSPI_CR |= QUADSPI_CR_PRESCALER(BOARD_FLASH_PRESCALER) | QUADSPI_CR_SSHIFT;
+    QUADSPI_DCR = QUADSPI_DCR_FSIZE(BOARD_FLASH_SIZE_LOG2 - 1) | QUADSPI_DCR_CSHT(1);
 
     QUADSPI_CR |= QUADSPI_CR_EN;
 
-        quadspi_reset_memory(base);
-#if 1
+	/*
+	 * Registers that are constant for all commands are written once here,
+	 * the operand registers are loaded so that the shadow copy is valid.
+	 */
+	QUADSPI_PIR = 0x10;
+	QUADSPI_CR |= QUADSPI_CR_AMPS;
 
-	quadspi_busy_wait(base);
+	QUADSPI_DLR = quadspi_shadow.dlr = 0;
+	QUADSPI_ABR = quadspi_shadow.abr = 0;
+	QUADSPI_PSMKR = quadspi_shadow.psmkr = 0;
+	QUADSPI_PSMAR = quadspi_shadow.psmar = 0;
 
-	QUADSPI_PSMAR = 0;
-	QUADSPI_PSMKR = N25Q512A_SR_WIP;
-	QUADSPI_PIR = 0x10;
+	/* The reset below also takes the memory out of QPI */
+	quadspi_mode = QSPI_MODE_1_1_4;
+	quadspi_set = &qspi_sets[QSPI_MODE_1_1_4];
+	quadspi_qpi_active = 0;
 
-	QUADSPI_CR |= QUADSPI_CR_AMPS;
-	QUADSPI_DLR = 0;
-	QUADSPI_CCR = QUADSPI_CCR_FMODE_AUTO_POLL | QUADSPI_CCR_DMODE_1_LINE |
-		QUADSPI_CCR_IDMOD_1_LINE | READ_STATUS_REG_CMD;
+        quadspi_reset_memory(base);
+#if 1
 
-	quadspi_wait_flag(base, QUADSPI_SR_SMF);
+	quadspi_memory_ready(base);
 
 #endif
 //        quadspi_write_sr2();
@@ -246,3 +951,4 @@ void quadspi_init(struct qspi_params *params, void *base)
 
 }
 
+#endif /* !FLASH_BUS_OCTOSPI */
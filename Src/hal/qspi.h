@@ -5,6 +5,7 @@
 
 /* QUADSPI_CR */
 #define QUADSPI_CR_EN				(1 << 0)
+#define QUADSPI_CR_ABORT			(1 << 1)
 #define QUADSPI_CR_TCEN				(1 << 3)
 #define QUADSPI_CR_SSHIFT			(1 << 4)
 #define QUADSPI_CR_DFM				(1 << 6)
@@ -49,7 +50,13 @@
 #define QUADSPI_CCR_FMODE(x)		((x) << 26)
 #define QUADSPI_CCR_SIOMODE(x)          ((x) << 28)
 
+#define QUADSPI_CCR_ADMODE_MASK		QUADSPI_CCR_ADMODE(3)
+#define QUADSPI_CCR_ABMODE_MASK		QUADSPI_CCR_ABMODE(3)
+#define QUADSPI_CCR_DMODE_MASK		QUADSPI_CCR_DMODE(3)
+#define QUADSPI_CCR_FMODE_MASK		QUADSPI_CCR_FMODE(3)
+
 #define QUADSPI_CCR_IDMOD_1_LINE	QUADSPI_CCR_IDMODE(1)
+#define QUADSPI_CCR_IDMOD_4_LINE	QUADSPI_CCR_IDMODE(3)
 #define QUADSPI_CCR_ADMOD_1_LINE	QUADSPI_CCR_ADMODE(1)
 #define QUADSPI_CCR_ADMOD_4_LINE	QUADSPI_CCR_ADMODE(3)
 #define QUADSPI_CCR_ADSIZE_24BITS	QUADSPI_CCR_ADSIZE(2)
@@ -68,8 +75,13 @@
 
 
 /*  QSPI Comands */
+#define PAGE_PROG_CMD				0x02
 #define READ_STATUS_REG_CMD			0x05
 #define WRITE_ENABLE_CMD			0x06
+#define FAST_READ_CMD				0x0b
+#define SECTOR_ERASE_4K_CMD			0x20
+#define QUAD_PAGE_PROG_CMD			0x32
+#define QUAD_IO_PAGE_PROG_CMD		0x38
 #define RESET_ENABLE_CMD			0x66
 #define QUAD_OUTPUT_FAST_READ_CMD	0x6b
 #define QUAD_IO_FAST_READ_CMD	0xeb
@@ -77,20 +89,86 @@
 #define READ_VOL_CFG_REG_CMD		0x85
 #define RESET_MEMORY_CMD			0x99
 #define ENTER_4_BYTE_ADDR_MODE_CMD	0xb7
-
-
-#define QUADSPI_CR	 (*(volatile unsigned long *)(QUADSPI_BASE + 0x00))
-#define QUADSPI_DCR	 (*(volatile unsigned long *)(QUADSPI_BASE + 0x04))
-#define QUADSPI_SR	 (*(volatile unsigned long *)(QUADSPI_BASE + 0x08))
-#define QUADSPI_FCR	 (*(volatile unsigned long *)(QUADSPI_BASE + 0x0c))
-#define QUADSPI_DLR	 (*(volatile unsigned long *)(QUADSPI_BASE + 0x10))
-#define QUADSPI_CCR	 (*(volatile unsigned long *)(QUADSPI_BASE + 0x14))
-#define QUADSPI_AR	 (*(volatile unsigned long *)(QUADSPI_BASE + 0x18))
-#define QUADSPI_ABR	 (*(volatile unsigned long *)(QUADSPI_BASE + 0x1C))
-#define QUADSPI_DR	 (*(volatile unsigned long *)(QUADSPI_BASE + 0x20))
-#define QUADSPI_PSMKR    (*(volatile unsigned long *)(QUADSPI_BASE + 0x24))
-#define QUADSPI_PSMAR    (*(volatile unsigned long *)(QUADSPI_BASE + 0x28))
-#define QUADSPI_PIR	 (*(volatile unsigned long *)(QUADSPI_BASE + 0x2c))
+#define READ_JEDEC_ID_CMD			0x9f
+#define SOFTWARE_DIE_SELECT_CMD		0xc2
+
+/* QPI entry/exit differ per vendor */
+#ifndef QSPI_QPI_ENTER_CMD
+#define QSPI_QPI_ENTER_CMD			0x38	/* Winbond, 0x35 for Macronix/ISSI */
+#endif
+#ifndef QSPI_QPI_EXIT_CMD
+#define QSPI_QPI_EXIT_CMD			0xff	/* Winbond, 0xf5 for Macronix/ISSI */
+#endif
+
+/* Erase suspend/resume, 0xb0/0x30 on older Macronix parts */
+#ifndef QSPI_ERASE_SUSPEND_CMD
+#define QSPI_ERASE_SUSPEND_CMD		0x75
+#endif
+#ifndef QSPI_ERASE_RESUME_CMD
+#define QSPI_ERASE_RESUME_CMD		0x7a
+#endif
+
+#define JEDEC_VENDOR_WINBOND		0xef
+#define JEDEC_VENDOR_MACRONIX		0xc2
+#define JEDEC_VENDOR_ISSI			0x9d
+
+/* Erase/program command modes, see quadspi_set_mode() */
+#define QSPI_MODE_1_1_4				0	/* 1-line command/address, 0x32 quad page program */
+#define QSPI_MODE_1_4_4				1	/* 0x38 quad I/O page program */
+#define QSPI_MODE_QPI				2	/* 4-4-4 for all commands */
+
+#ifndef QSPI_PROG_MODE
+#define QSPI_PROG_MODE				QSPI_MODE_1_1_4
+#endif
+
+/* Stacked-die parts, see quadspi_set_mode() */
+#define QSPI_MAX_DIES				4
+
+/* Memory mapped read modes for the XIP handoff, see quadspi_handoff() */
+#define QSPI_XIP_1_4_4_CONT			0	/* 0xeb, instruction once + continuous read mode bits */
+#define QSPI_XIP_1_4_4				1	/* 0xeb */
+#define QSPI_XIP_1_1_4				2	/* 0x6b */
+#define QSPI_XIP_1_1_1				3	/* 0x0b */
+
+/* XIP handoff profile */
+#ifndef QSPI_XIP_MODE
+#define QSPI_XIP_MODE				QSPI_XIP_1_4_4_CONT	/* fastest mode to try */
+#endif
+#ifndef QSPI_XIP_MODE_BYTE
+#define QSPI_XIP_MODE_BYTE			0x20	/* Winbond continuous read, M5-4 = 10 */
+#endif
+#ifndef QSPI_XIP_TIMEOUT
+#define QSPI_XIP_TIMEOUT			0	/* LPTR clocks before nCS release, 0 = never */
+#endif
+
+#define QSPI_XIP_CHECK_SIZE			32
+#define QSPI_XIP_CHECK_STRIDE		0x1000
+
+
+#if QSPI_REG_MODEL
+/* Host model of the controller, Tools/sim/qspi_model.c */
+volatile unsigned long *qspi_model_reg(unsigned int offset);
+volatile uint32_t *qspi_model_mem(uint32_t offset);
+#define QUADSPI_REG(offset)	(*qspi_model_reg(offset))
+#define QUADSPI_MEM(offset)	qspi_model_mem(offset)
+#else
+#define QUADSPI_REG(offset)	(*(volatile unsigned long *)(QUADSPI_BASE + (offset)))
+#define QUADSPI_MEM(offset)	((volatile uint32_t *)(QUADSPI_MEM_BASE + (offset)))
+#endif
+
+#define QUADSPI_CR	 QUADSPI_REG(0x00)
+#define QUADSPI_DCR	 QUADSPI_REG(0x04)
+#define QUADSPI_SR	 QUADSPI_REG(0x08)
+#define QUADSPI_FCR	 QUADSPI_REG(0x0c)
+#define QUADSPI_DLR	 QUADSPI_REG(0x10)
+#define QUADSPI_CCR	 QUADSPI_REG(0x14)
+#define QUADSPI_AR	 QUADSPI_REG(0x18)
+#define QUADSPI_ABR	 QUADSPI_REG(0x1C)
+#define QUADSPI_DR	 QUADSPI_REG(0x20)
+#define QUADSPI_PSMKR    QUADSPI_REG(0x24)
+#define QUADSPI_PSMAR    QUADSPI_REG(0x28)
+#define QUADSPI_PIR	 QUADSPI_REG(0x2c)
+#define QUADSPI_LPTR	 QUADSPI_REG(0x30)
 
 /* N25Q512A Registers*/
 
@@ -109,9 +187,38 @@ struct qspi_params {
 	uint32_t fsize;
 };
 
+/*
+ * One flash command: CCR word plus the operands it needs. dlr is only
+ * used with a data phase, abr with alternate bytes and psmkr/psmar in
+ * automatic polling mode. flag is the SR flag that signals completion.
+ */
+struct qspi_cmd {
+	uint32_t ccr;
+	uint32_t dlr;
+	uint32_t abr;
+	uint32_t psmkr;
+	uint32_t psmar;
+	uint32_t flag;
+};
+
+void quadspi_issue(const struct qspi_cmd *cmd, uint32_t address);
+void quadspi_run(const struct qspi_cmd *cmd, uint32_t address);
+
 void quadspi_init(struct qspi_params *params, void *base);
+int quadspi_set_mode(int mode);
+int quadspi_handoff(void);
 void quadspi_erase_sector(uint32_t sector);
-void quadspi_write(uint32_t address,uint8_t *data,int len);
+void quadspi_erase_start(uint32_t sector);
+int quadspi_busy(void);
+void quadspi_erase_suspend(void);
+void quadspi_erase_resume(void);
+int quadspi_write(uint32_t address,uint8_t *data,int len);
+int quadspi_num_dies(void);
+int quadspi_die_of(uint32_t address);
+void quadspi_die_erase_start(uint32_t sector);
+void quadspi_die_write_start(uint32_t address, const uint8_t *data);
+int quadspi_die_busy(int die);
 void quadspi_mmap(void);
+void quadspi_mmap_mode(int mode);
 
 #endif /* _QSPI_H */
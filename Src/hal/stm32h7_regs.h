@@ -28,5 +28,15 @@
 #define GPIOA_BASE			(void *)0x58020000UL
 #define SDRAM_BASE			0xd0000000UL
 #define QUADSPI_BASE		0x52005000
+#define QUADSPI_MEM_BASE	0x90000000
+/*  OCTOSPI (STM32H7A3/H7B0/H72x/H73x), OCTOSPI1 replaces QUADSPI */
+#define OCTOSPI1_BASE		0x52005000
+#define RCC_AHB3ENR_IOMNGREN	(1 << 21)
+/*  HASH (STM32H750/H753 crypto option) */
+#define HASH_BASE			0x48021400
+#define RCC_AHB2ENR_HASHEN	(1 << 5)
+/*  HSEM (dual-core parts) */
+#define HSEM_BASE			0x58026400
+#define RCC_AHB4ENR_HSEMEN	(1 << 25)
 
 #endif /* _STM32H7_REGS_H */
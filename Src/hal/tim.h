@@ -0,0 +1,60 @@
+#ifndef _TIM_H
+#define _TIM_H
+
+#include <stdint.h>
+#include "stm32h7_regs.h"
+#include "flash_bus.h"
+
+/*
+ * Free running timer for the call trace, counting on while the core is
+ * halted by the debugger: TIM2 on the target, the virtual clock of the
+ * flash model with FLASH_BUS_SIM=1. CYCCNT stops in debug halt, TIM2
+ * only when its DBGMCU freeze bit is set, tim_start() clears it.
+ *
+ * clock_setup() gates the TIM2 clock off again. The counter keeps its
+ * value, tim_start() is called at every trace point to ungate it and
+ * only the rest of Init() goes uncounted.
+ */
+#if FLASH_BUS_SIM
+
+#define TIM_HZ						SIM_CPU_HZ
+#define tim_start()					((void)0)
+#define tim_count()					flash_sim_cycles()
+
+#else
+
+#define TIM_HZ						1000000
+#define TIM_KER_HZ					(BOARD_CPU_HZ / 2)	/* APB1 timer clock after clock_setup() */
+
+#define TIM2_BASE					0x40000000
+
+#define TIM2_CR1		(*(volatile unsigned long *)(TIM2_BASE + 0x00))
+#define TIM2_EGR		(*(volatile unsigned long *)(TIM2_BASE + 0x14))
+#define TIM2_CNT		(*(volatile unsigned long *)(TIM2_BASE + 0x24))
+#define TIM2_PSC		(*(volatile unsigned long *)(TIM2_BASE + 0x28))
+#define TIM2_ARR		(*(volatile unsigned long *)(TIM2_BASE + 0x2c))
+#define RCC_APB1LENR	(*(volatile unsigned long *)(RCC_BASE_REG + 0x0e8))
+#define DBGMCU_APB1LFZ1	(*(volatile unsigned long *)0x5c00103c)
+
+#define TIM_CR1_CEN					(1UL << 0)
+#define TIM_EGR_UG					(1UL << 0)
+#define RCC_APB1LENR_TIM2EN			(1UL << 0)
+#define DBGMCU_APB1LFZ1_TIM2		(1UL << 0)
+
+/* Ungate TIM2 and keep it running in debug halt, set it up once */
+#define tim_start() do {							\
+	RCC_APB1LENR |= RCC_APB1LENR_TIM2EN;				\
+	(void)RCC_APB1LENR;						\
+	DBGMCU_APB1LFZ1 &= ~DBGMCU_APB1LFZ1_TIM2;			\
+	if (!(TIM2_CR1 & TIM_CR1_CEN)) {				\
+		TIM2_PSC = TIM_KER_HZ / TIM_HZ - 1;			\
+		TIM2_ARR = 0xffffffff;					\
+		TIM2_EGR = TIM_EGR_UG;					\
+		TIM2_CR1 = TIM_CR1_CEN;					\
+	}								\
+} while (0)
+#define tim_count()					((uint32_t)TIM2_CNT)
+
+#endif
+
+#endif /* _TIM_H */
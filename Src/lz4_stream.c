@@ -0,0 +1,164 @@
+#include <stdint.h>
+#include "lz4_stream.h"
+
+#define LZ4_WINDOW_MASK		(LZ4_WINDOW_SIZE - 1)
+#define LZ4_PAGE_MASK		(LZ4_PAGE_SIZE - 1)
+
+enum {
+	LZ4S_TOKEN,
+	LZ4S_LITLEN,
+	LZ4S_LITERALS,
+	LZ4S_OFFSET_LO,
+	LZ4S_OFFSET_HI,
+	LZ4S_MATCHLEN,
+};
+
+void lz4_stream_init(struct lz4_stream *s, lz4_sink_t sink)
+{
+	s->state = LZ4S_TOKEN;
+	s->token = 0;
+	s->len = 0;
+	s->offset = 0;
+	s->pos = 0;
+	s->sink = sink;
+}
+
+/* Hand the page that has just been completed at s->pos to the sink */
+static int lz4_flush(struct lz4_stream *s)
+{
+	uint32_t page = s->pos - LZ4_PAGE_SIZE;
+
+	return s->sink(page, &s->window[page & LZ4_WINDOW_MASK]);
+}
+
+static int lz4_copy_match(struct lz4_stream *s)
+{
+	uint8_t *dst;
+	uint32_t from, n;
+
+	while (s->len) {
+		/* Never run past the end of the staging page */
+		n = LZ4_PAGE_SIZE - (s->pos & LZ4_PAGE_MASK);
+		if (n > s->len)
+			n = s->len;
+
+		dst = &s->window[s->pos & LZ4_WINDOW_MASK];
+		from = s->pos - s->offset;
+		s->pos += n;
+		s->len -= n;
+
+		/* Byte copy keeps overlapping (run-length) matches correct */
+		while (n--)
+			*dst++ = s->window[from++ & LZ4_WINDOW_MASK];
+
+		if (!(s->pos & LZ4_PAGE_MASK) && lz4_flush(s))
+			return -1;
+	}
+
+	return 0;
+}
+
+int lz4_stream_decode(struct lz4_stream *s, const uint8_t *src, uint32_t len)
+{
+	const uint8_t *end = src + len;
+	uint8_t *dst;
+	uint32_t n;
+	uint8_t c;
+
+	while (src < end) {
+		switch (s->state) {
+		case LZ4S_TOKEN:
+			s->token = *src++;
+			s->len = s->token >> 4;
+			if (s->len == 15)
+				s->state = LZ4S_LITLEN;
+			else if (s->len)
+				s->state = LZ4S_LITERALS;
+			else
+				s->state = LZ4S_OFFSET_LO;
+			break;
+
+		case LZ4S_LITLEN:
+			c = *src++;
+			s->len += c;
+			if (c != 255)
+				s->state = LZ4S_LITERALS;
+			break;
+
+		case LZ4S_LITERALS:
+			n = LZ4_PAGE_SIZE - (s->pos & LZ4_PAGE_MASK);
+			if (n > s->len)
+				n = s->len;
+			if (n > (uint32_t)(end - src))
+				n = end - src;
+
+			dst = &s->window[s->pos & LZ4_WINDOW_MASK];
+			s->pos += n;
+			s->len -= n;
+			while (n--)
+				*dst++ = *src++;
+
+			if (!(s->pos & LZ4_PAGE_MASK) && lz4_flush(s))
+				return -1;
+			if (!s->len)
+				s->state = LZ4S_OFFSET_LO;
+			break;
+
+		case LZ4S_OFFSET_LO:
+			s->offset = *src++;
+			s->state = LZ4S_OFFSET_HI;
+			break;
+
+		case LZ4S_OFFSET_HI:
+			s->offset |= (uint32_t)*src++ << 8;
+			if (!s->offset || s->offset > LZ4_WINDOW_SIZE ||
+			    s->offset > s->pos)
+				return -1;
+
+			s->len = s->token & 0xf;
+			if (s->len == 15) {
+				s->state = LZ4S_MATCHLEN;
+				break;
+			}
+			s->len += LZ4_MIN_MATCH;
+			s->state = LZ4S_TOKEN;
+			if (lz4_copy_match(s))
+				return -1;
+			break;
+
+		case LZ4S_MATCHLEN:
+			c = *src++;
+			s->len += c;
+			if (c == 255)
+				break;
+			s->len += LZ4_MIN_MATCH;
+			s->state = LZ4S_TOKEN;
+			if (lz4_copy_match(s))
+				return -1;
+			break;
+
+		default:
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Pad the last partial page with the fill value and flush it. A stream
+ * may only end after a literal run (LZ4 last sequence) or a full sequence.
+ */
+int lz4_stream_finish(struct lz4_stream *s, uint8_t fill)
+{
+	if (s->state != LZ4S_TOKEN && s->state != LZ4S_OFFSET_LO)
+		return -1;
+
+	if (!(s->pos & LZ4_PAGE_MASK))
+		return 0;
+
+	while (s->pos & LZ4_PAGE_MASK)
+		s->window[s->pos++ & LZ4_WINDOW_MASK] = fill;
+
+	return lz4_flush(s);
+}
@@ -0,0 +1,44 @@
+#ifndef _LZ4_STREAM_H
+#define _LZ4_STREAM_H
+
+#include <stdint.h>
+
+/*
+ * Streaming decoder for LZ4 block format data.
+ *
+ * The compressed stream may be split at any byte boundary across calls to
+ * lz4_stream_decode(). Output is collected in a window ring and handed to
+ * the sink one LZ4_PAGE_SIZE page at a time, so match offsets must not
+ * exceed LZ4_WINDOW_SIZE (the host packer in Tools/ enforces this).
+ */
+
+#ifndef LZ4_WINDOW_SIZE
+#define LZ4_WINDOW_SIZE		2048
+#endif
+
+#define LZ4_PAGE_SIZE		256
+
+#if (LZ4_WINDOW_SIZE & (LZ4_WINDOW_SIZE - 1)) || (LZ4_WINDOW_SIZE % LZ4_PAGE_SIZE)
+#error "LZ4_WINDOW_SIZE must be a power of two multiple of LZ4_PAGE_SIZE"
+#endif
+
+#define LZ4_MIN_MATCH		4
+
+/* Sink for one decompressed page, offset is relative to the stream start */
+typedef int (*lz4_sink_t)(uint32_t offset, const uint8_t *page);
+
+struct lz4_stream {
+	uint8_t state;
+	uint8_t token;
+	uint32_t len;
+	uint32_t offset;
+	uint32_t pos;
+	lz4_sink_t sink;
+	uint8_t window[LZ4_WINDOW_SIZE];
+};
+
+void lz4_stream_init(struct lz4_stream *s, lz4_sink_t sink);
+int lz4_stream_decode(struct lz4_stream *s, const uint8_t *src, uint32_t len);
+int lz4_stream_finish(struct lz4_stream *s, uint8_t fill);
+
+#endif /* _LZ4_STREAM_H */
@@ -5,93 +5,342 @@
 **********************************************************************
 ----------------------------------------------------------------------
 File    : Main.c
-Purpose : Contains functions for RAMCode debugging.
+Purpose : Throughput benchmark of the RAMCode.
+          Runs sweeps over region size, ProgramPage() batch size and
+          memory mapped read mode through the public flash API and
+          leaves the results in BenchTable.
+          On target, run the Debug configuration and dump BenchTable
+          once main() returns. On Linux, build against the flash model
+          in Tools/sim ("make bench" in Tools/), the table is printed.
 --------  END-OF-HEADER  ---------------------------------------------
 */
-#include <string.h> 
+#include <string.h>
 #include <stdio.h>
 #include "FlashOS.h"
+#include "FlashConf.h"
+#include "flash_bus.h"
+#include "dwt.h"
 
-static U8 _acTestData[512] = {
-  0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00,
-  0x04, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x06, 0x00, 0x00, 0x00, 0x07, 0x00, 0x00, 0x00,
-  0x08, 0x00, 0x00, 0x00, 0x09, 0x00, 0x00, 0x00, 0x0A, 0x00, 0x00, 0x00, 0x0B, 0x00, 0x00, 0x00,
-  0x0C, 0x00, 0x00, 0x00, 0x0D, 0x00, 0x00, 0x00, 0x0E, 0x00, 0x00, 0x00, 0x0F, 0x00, 0x00, 0x00,
-  0x10, 0x00, 0x00, 0x00, 0x11, 0x00, 0x00, 0x00, 0x12, 0x00, 0x00, 0x00, 0x13, 0x00, 0x00, 0x00,
-  0x14, 0x00, 0x00, 0x00, 0x15, 0x00, 0x00, 0x00, 0x16, 0x00, 0x00, 0x00, 0x17, 0x00, 0x00, 0x00,
-  0x18, 0x00, 0x00, 0x00, 0x19, 0x00, 0x00, 0x00, 0x1A, 0x00, 0x00, 0x00, 0x1B, 0x00, 0x00, 0x00,
-  0x1C, 0x00, 0x00, 0x00, 0x1D, 0x00, 0x00, 0x00, 0x1E, 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00,
-  0x20, 0x00, 0x00, 0x00, 0x21, 0x00, 0x00, 0x00, 0x22, 0x00, 0x00, 0x00, 0x23, 0x00, 0x00, 0x00,
-  0x24, 0x00, 0x00, 0x00, 0x25, 0x00, 0x00, 0x00, 0x26, 0x00, 0x00, 0x00, 0x27, 0x00, 0x00, 0x00,
-  0x28, 0x00, 0x00, 0x00, 0x29, 0x00, 0x00, 0x00, 0x2A, 0x00, 0x00, 0x00, 0x2B, 0x00, 0x00, 0x00,
-  0x2C, 0x00, 0x00, 0x00, 0x2D, 0x00, 0x00, 0x00, 0x2E, 0x00, 0x00, 0x00, 0x2F, 0x00, 0x00, 0x00,
-  0x30, 0x00, 0x00, 0x00, 0x31, 0x00, 0x00, 0x00, 0x32, 0x00, 0x00, 0x00, 0x33, 0x00, 0x00, 0x00,
-  0x34, 0x00, 0x00, 0x00, 0x35, 0x00, 0x00, 0x00, 0x36, 0x00, 0x00, 0x00, 0x37, 0x00, 0x00, 0x00,
-  0x38, 0x00, 0x00, 0x00, 0x39, 0x00, 0x00, 0x00, 0x3A, 0x00, 0x00, 0x00, 0x3B, 0x00, 0x00, 0x00,
-  0x3C, 0x00, 0x00, 0x00, 0x3D, 0x00, 0x00, 0x00, 0x3E, 0x00, 0x00, 0x00, 0x3F, 0x00, 0x00, 0x00,
-  0x40, 0x00, 0x00, 0x00, 0x41, 0x00, 0x00, 0x00, 0x42, 0x00, 0x00, 0x00, 0x43, 0x00, 0x00, 0x00,
-  0x44, 0x00, 0x00, 0x00, 0x45, 0x00, 0x00, 0x00, 0x46, 0x00, 0x00, 0x00, 0x47, 0x00, 0x00, 0x00,
-  0x48, 0x00, 0x00, 0x00, 0x49, 0x00, 0x00, 0x00, 0x4A, 0x00, 0x00, 0x00, 0x4B, 0x00, 0x00, 0x00,
-  0x4C, 0x00, 0x00, 0x00, 0x4D, 0x00, 0x00, 0x00, 0x4E, 0x00, 0x00, 0x00, 0x4F, 0x00, 0x00, 0x00,
-  0x50, 0x00, 0x00, 0x00, 0x51, 0x00, 0x00, 0x00, 0x52, 0x00, 0x00, 0x00, 0x53, 0x00, 0x00, 0x00,
-  0x54, 0x00, 0x00, 0x00, 0x55, 0x00, 0x00, 0x00, 0x56, 0x00, 0x00, 0x00, 0x57, 0x00, 0x00, 0x00,
-  0x58, 0x00, 0x00, 0x00, 0x59, 0x00, 0x00, 0x00, 0x5A, 0x00, 0x00, 0x00, 0x5B, 0x00, 0x00, 0x00,
-  0x5C, 0x00, 0x00, 0x00, 0x5D, 0x00, 0x00, 0x00, 0x5E, 0x00, 0x00, 0x00, 0x5F, 0x00, 0x00, 0x00,
-  0x60, 0x00, 0x00, 0x00, 0x61, 0x00, 0x00, 0x00, 0x62, 0x00, 0x00, 0x00, 0x63, 0x00, 0x00, 0x00,
-  0x64, 0x00, 0x00, 0x00, 0x65, 0x00, 0x00, 0x00, 0x66, 0x00, 0x00, 0x00, 0x67, 0x00, 0x00, 0x00,
-  0x68, 0x00, 0x00, 0x00, 0x69, 0x00, 0x00, 0x00, 0x6A, 0x00, 0x00, 0x00, 0x6B, 0x00, 0x00, 0x00,
-  0x6C, 0x00, 0x00, 0x00, 0x6D, 0x00, 0x00, 0x00, 0x6E, 0x00, 0x00, 0x00, 0x6F, 0x00, 0x00, 0x00,
-  0x70, 0x00, 0x00, 0x00, 0x71, 0x00, 0x00, 0x00, 0x72, 0x00, 0x00, 0x00, 0x73, 0x00, 0x00, 0x00,
-  0x74, 0x00, 0x00, 0x00, 0x75, 0x00, 0x00, 0x00, 0x76, 0x00, 0x00, 0x00, 0x77, 0x00, 0x00, 0x00,
-  0x78, 0x00, 0x00, 0x00, 0x79, 0x00, 0x00, 0x00, 0x7A, 0x00, 0x00, 0x00, 0x7B, 0x00, 0x00, 0x00,
-  0x7C, 0x00, 0x00, 0x00, 0x7D, 0x00, 0x00, 0x00, 0x7E, 0x00, 0x00, 0x00, 0x7F, 0x00, 0x00, 0x00
-};
-
-#define _FLASH_BASE_ADDR (0x90000000)
+/*********************************************************************
+*
+*       Defines (configurable)
+*
+**********************************************************************
+*/
+#define BENCH_BASE_ADDR     (QSPI_BASE_ADDR + 0x00100000)  // Start of the area the sweeps erase and program
+#define BENCH_SECTOR_SIZE   (0x1000)                       // Sector size in FlashDev.c
+#define BENCH_MAX_REGION    (0x40000)                      // Largest entry of _aRegionSize[]
+#define BENCH_MAX_BATCH     (4096)                         // Largest entry of _aBatchSize[]
 
 /*********************************************************************
 *
-*       Public code
+*       Defines (fixed)
 *
 **********************************************************************
 */
+#define BENCH_MAGIC         (0x48434E42)                   // "BNCH", BenchTable is complete
+#define BENCH_MAX_SAMPLES   (BENCH_MAX_REGION / 256)       // One latency sample per ProgramPage() call at most
+#define BENCH_MAX_RESULTS   (2 * 3)                        // Rows of the sweep tables below
+#define COUNTOF(a)          (sizeof(a) / sizeof((a)[0]))
 
 /*********************************************************************
 *
-*       main
+*       Types
+*
+**********************************************************************
+*/
+typedef struct {
+  U32 RegionSize;         // Bytes erased, programmed and read back
+  U32 BatchSize;          // Bytes per ProgramPage() call
+  U32 NumErrors;          // Words that read back wrong, summed over all read modes
+  U32 EraseKBps;          // Throughput in kB/s (MB/s * 1000)
+  U32 ProgramKBps;
+  U32 aReadKBps[FLASH_BUS_NUM_READ_MODES];  // Read back throughput per memory mapped read mode, 0 is the fastest
+  U32 aEraseUs[3];        // p50/p90/p99 latency of one EraseSector() call in us
+  U32 aProgramUs[3];      // p50/p90/p99 latency of one ProgramPage() call in us
+} BENCH_RESULT;
+
+typedef struct {
+  U32 Magic;              // BENCH_MAGIC once all rows are filled in
+  U32 CpuHz;              // Cycle counter rate
+  U32 NumReadModes;       // Entries used in aReadKBps[]
+  U32 NumResults;
+  BENCH_RESULT aResult[BENCH_MAX_RESULTS];
+} BENCH_TABLE;
+
+/*********************************************************************
+*
+*       Static const data
+*
+**********************************************************************
+*/
+static const U32 _aRegionSize[] = { 0x10000, 0x40000 };
+static const U32 _aBatchSize[]  = { 256, 1024, 4096 };
+
+/*********************************************************************
+*
+*       Static data
+*
+**********************************************************************
+*/
+static uint32_t _aBatch[BENCH_MAX_BATCH / 4];
+static uint32_t _aEraseCycles[BENCH_MAX_REGION / BENCH_SECTOR_SIZE];
+static uint32_t _aProgramCycles[BENCH_MAX_SAMPLES];
+
+/*********************************************************************
+*
+*       Public data
+*
+**********************************************************************
+*/
+BENCH_TABLE BenchTable;
+
+/*********************************************************************
+*
+*       Static code
+*
+**********************************************************************
+*/
+
+/*********************************************************************
+*
+*       _Pattern
 *
 *  Function description
-*    Main function. Performs some sample operations with
-*    the RAMCode for verification.
+*    Expected content of the word at Addr. Seed changes per row so that
+*    data left by the previous row does not pass.
 */
-int main(void) {
-  int r; 
+static uint32_t _Pattern(U32 Addr, U32 Seed) {
+  return (uint32_t)(Addr ^ Seed);
+}
+
+/*********************************************************************
+*
+*       _Percentiles
+*
+*  Function description
+*    Sorts the samples and stores p50/p90/p99 in us.
+*/
+static void _Percentiles(uint32_t *pSample, U32 NumSamples, U32 *pUs) {
+  static const U8 _aPercent[3] = { 50, 90, 99 };
+  uint32_t v;
+  U32 i;
+  U32 j;
+
+  if (NumSamples == 0) {
+    return;
+  }
+  for (i = 1; i < NumSamples; i++) {
+    v = pSample[i];
+    for (j = i; j > 0 && pSample[j - 1] > v; j--) {
+      pSample[j] = pSample[j - 1];
+    }
+    pSample[j] = v;
+  }
+  for (i = 0; i < 3; i++) {
+    pUs[i] = pSample[(NumSamples - 1) * _aPercent[i] / 100] / (DWT_CPU_HZ / 1000000);
+  }
+}
+
+/*********************************************************************
+*
+*       _KBps
+*
+*  Function description
+*    Converts bytes transferred in a number of cycles into kB/s.
+*/
+static U32 _KBps(U32 NumBytes, unsigned long long Cycles) {
+  if (Cycles == 0) {
+    return 0;
+  }
+  return (U32)((unsigned long long)NumBytes * (DWT_CPU_HZ / 1000) / Cycles);
+}
+
+/*********************************************************************
+*
+*       _CountErrors
+*
+*  Function description
+*    Reads a region back through the memory mapped window and counts
+*    the words that do not match the pattern.
+*/
+static U32 _CountErrors(U32 Addr, U32 NumBytes, U32 Seed) {
+  const volatile uint32_t *pFlash;
+  U32 NumErrors;
+  U32 i;
+
+  pFlash = (const volatile uint32_t *)flash_bus_ptr(Addr);
+  NumErrors = 0;
+  for (i = 0; i < NumBytes / 4; i++) {
+    if (pFlash[i] != _Pattern(Addr + i * 4, Seed)) {
+      NumErrors++;
+    }
+  }
+#if FLASH_BUS_SIM
+  flash_sim_account_read(NumBytes);
+#endif
+  return NumErrors;
+}
+
+/*********************************************************************
+*
+*       _RunRow
+*
+*  Function description
+*    Erases, programs and reads back one region the way the J-Link DLL
+*    does: erase with Func 1, program with Func 2, verify with Func 3.
+*
+*  Return value
+*    0 O.K.
+*    1 Error
+*/
+static int _RunRow(BENCH_RESULT *pResult, U32 Seed) {
+  unsigned long long EraseCycles;
+  unsigned long long ProgramCycles;
+  unsigned long long Cycles;
+  U32 NumErase;
+  U32 NumProgram;
+  U32 Addr;
+  U32 End;
+  uint32_t t;
+  U32 i;
+  int Mode;
+  int r;
+
+  EraseCycles   = 0;
+  ProgramCycles = 0;
+  NumErase      = 0;
+  NumProgram    = 0;
+  r             = 0;
+  End           = BENCH_BASE_ADDR + pResult->RegionSize;
   //
-  // Blank Check
+  // Erase the region
   //
-#if SUPPORT_BLANK_CHECK
-  Init(0, 0, 0);
-  r = BlankCheck(_FLASH_BASE_ADDR, 0x20000, 0xFF);
-  UnInit(0);
-#endif
+  Init(BENCH_BASE_ADDR, 0, 1);
+  for (Addr = BENCH_BASE_ADDR; Addr < End; Addr += BENCH_SECTOR_SIZE) {
+    t = dwt_cycles();
+    r |= EraseSector(Addr);
+    t = dwt_cycles() - t;
+    EraseCycles += t;
+    _aEraseCycles[NumErase++] = t;
+  }
+  UnInit(1);
+  //
+  // Program it
+  //
+  Init(BENCH_BASE_ADDR, 0, 2);
+  for (Addr = BENCH_BASE_ADDR; Addr < End; Addr += pResult->BatchSize) {
+    for (i = 0; i < pResult->BatchSize / 4; i++) {
+      _aBatch[i] = _Pattern(Addr + i * 4, Seed);
+    }
+    t = dwt_cycles();
+    r |= ProgramPage(Addr, pResult->BatchSize, (U8 *)_aBatch);
+    t = dwt_cycles() - t;
+    ProgramCycles += t;
+    _aProgramCycles[NumProgram++] = t;
+  }
+  UnInit(2);
   //
-  // Erase sector
+  // Read back in every memory mapped read mode
   //
-  Init(0, 0, 0);
-  r = EraseSector(_FLASH_BASE_ADDR);
-  if (r != 0) {  // Error?
-    while (1);
+  Init(BENCH_BASE_ADDR, 0, 3);
+  for (Mode = 0; Mode < FLASH_BUS_NUM_READ_MODES; Mode++) {
+    flash_bus_mmap_mode(Mode);
+    t = dwt_cycles();
+    pResult->NumErrors += _CountErrors(BENCH_BASE_ADDR, pResult->RegionSize, Seed);
+    Cycles = dwt_cycles() - t;
+    pResult->aReadKBps[Mode] = _KBps(pResult->RegionSize, Cycles);
+  }
+  UnInit(3);
+
+  pResult->EraseKBps   = _KBps(pResult->RegionSize, EraseCycles);
+  pResult->ProgramKBps = _KBps(pResult->RegionSize, ProgramCycles);
+  _Percentiles(_aEraseCycles, NumErase, pResult->aEraseUs);
+  _Percentiles(_aProgramCycles, NumProgram, pResult->aProgramUs);
+  return r ? 1 : 0;
+}
+
+#if FLASH_BUS_SIM
+/*********************************************************************
+*
+*       _PrintTable
+*
+*  Function description
+*    Prints BenchTable, host build only.
+*/
+static void _PrintTable(void) {
+  const BENCH_RESULT *p;
+  U32 i;
+  int Mode;
+
+  printf("region  batch   erase kB/s  prog kB/s  erase us p50/p90/p99  prog us p50/p90/p99  read kB/s per mode         errors\n");
+  for (i = 0; i < BenchTable.NumResults; i++) {
+    p = &BenchTable.aResult[i];
+    printf("%6luK %5lu %12lu %10lu %8lu/%lu/%lu %12lu/%lu/%lu   ",
+           p->RegionSize >> 10, p->BatchSize,
+           p->EraseKBps, p->ProgramKBps,
+           p->aEraseUs[0], p->aEraseUs[1], p->aEraseUs[2],
+           p->aProgramUs[0], p->aProgramUs[1], p->aProgramUs[2]);
+    for (Mode = 0; Mode < FLASH_BUS_NUM_READ_MODES; Mode++) {
+      printf(" %6lu", p->aReadKBps[Mode]);
+    }
+    printf(" %8lu\n", p->NumErrors);
   }
-  UnInit(0);
+}
+#endif
+
+/*********************************************************************
+*
+*       Public code
+*
+**********************************************************************
+*/
+
+/*********************************************************************
+*
+*       main
+*
+*  Function description
+*    Main function. Runs all sweeps and fills in BenchTable.
+*
+*  Return value
+*    0 O.K., all rows read back correctly
+*    1 Error
+*/
+int main(void) {
+  BENCH_RESULT *pResult;
+  U32 iRegion;
+  U32 iBatch;
+  int r;
+
+  memset(&BenchTable, 0, sizeof(BenchTable));
+  BenchTable.CpuHz = DWT_CPU_HZ;
+  BenchTable.NumReadModes = FLASH_BUS_NUM_READ_MODES;
   //
-  // Program page
+  // Init() runs clock_setup(), start the counter afterwards
   //
-  Init(0, 0, 0);
-  r = ProgramPage(_FLASH_BASE_ADDR, sizeof(_acTestData), (U8 *)_acTestData);
-  if (r != 0) {  // Error?
-  //  while (1);
+  Init(BENCH_BASE_ADDR, 0, 1);
+  UnInit(1);
+  dwt_enable();
+
+  r = 0;
+  pResult = &BenchTable.aResult[0];
+  for (iRegion = 0; iRegion < COUNTOF(_aRegionSize); iRegion++) {
+    for (iBatch = 0; iBatch < COUNTOF(_aBatchSize); iBatch++) {
+      pResult->RegionSize = _aRegionSize[iRegion];
+      pResult->BatchSize  = _aBatchSize[iBatch];
+      r |= _RunRow(pResult, BenchTable.NumResults * 0x01010101u);
+      if (pResult->NumErrors) {
+        r = 1;
+      }
+      BenchTable.NumResults++;
+      pResult++;
+    }
   }
-  UnInit(0);
+  BenchTable.Magic = BENCH_MAGIC;
+#if FLASH_BUS_SIM
+  _PrintTable();
+#endif
   return r;
 }
 
@@ -1,6 +1,6 @@
 #include "stm32h7_regs.h"
-#include "gpio.h"
-#include "qspi.h"
+#include "board.h"
+#include "flash_bus.h"
 
 #define RCC_CR  (*(volatile unsigned long *)(RCC_BASE_REG))
 #define RCC_CFGR  (*(volatile unsigned long *)(RCC_BASE_REG + 0x10))
@@ -93,10 +93,10 @@ void clock_setup(void)
 	}
 	/* Configure PLL1 as clock source:
 	 * OSC_HSI = 64 MHz
-	 * VCO = 640MHz
-	 * pll1_p = 320MHz / pll1_q = 320MHz*/
+	 * VCO = 8 MHz x BOARD_PLL1_DIVN (640MHz H74x/H75x, 560MHz H7A3)
+	 * pll1_p = pll1_q = BOARD_CPU_HZ (320MHz / 280MHz)*/
 	divm = 8;
-	divn = 80;
+	divn = BOARD_PLL1_DIVN;
 	divp = 2;
 	divq = 2;
 	divr = 2;
@@ -118,7 +118,7 @@ void clock_setup(void)
 	FLASH_FACR &=0xfffffff0;
 	FLASH_FACR |= 0xa;
 
-	/* set HPRE (/2) DI clk --> 160MHz */
+	/* set HPRE (/2) DI clk --> BOARD_FLASH_KER_HZ (160MHz / 140MHz) */
 	RCC_D1CFGR |= (4<<4)|8;
         RCC_D2CFGR |= (4<<4)|(4<<8);
         RCC_D3CFGR |= (4<<4);
@@ -138,14 +138,7 @@ void clock_setup(void)
 
 void qspi_init(void)
 {
+  board_init_flash_pins();
 
-
-  gpio_set_qspi(GPIOA_BASE,'B',2,GPIOx_PUPDR_NOPULL, 0x9);
-  gpio_set_qspi(GPIOA_BASE,'B',6,GPIOx_PUPDR_NOPULL, 0xA);
-  gpio_set_qspi(GPIOA_BASE,'D',11,GPIOx_PUPDR_NOPULL, 0x9);
-  gpio_set_qspi(GPIOA_BASE,'D',12,GPIOx_PUPDR_NOPULL, 0x9);
-  gpio_set_qspi(GPIOA_BASE,'D',13,GPIOx_PUPDR_NOPULL, 0x9);
-  gpio_set_qspi(GPIOA_BASE,'E',2,GPIOx_PUPDR_NOPULL, 0x9);
-
-  quadspi_init(0, (void *)QUADSPI_BASE);
+  flash_bus_init();
 }
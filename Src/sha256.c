@@ -0,0 +1,116 @@
+#include <stdint.h>
+#include "sha256.h"
+
+#define ROR(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static void sha256_block(uint32_t *state, const uint8_t *p)
+{
+	uint32_t w[16], a, b, c, d, e, f, g, h, t1, t2, s0, s1;
+	int i;
+
+	for (i = 0; i < 16; i++)
+		w[i] = ((uint32_t)p[4 * i] << 24) | (p[4 * i + 1] << 16) |
+			(p[4 * i + 2] << 8) | p[4 * i + 3];
+
+	a = state[0]; b = state[1]; c = state[2]; d = state[3];
+	e = state[4]; f = state[5]; g = state[6]; h = state[7];
+
+	for (i = 0; i < 64; i++) {
+		/* Message schedule kept as a 16 word ring */
+		if (i >= 16) {
+			s0 = w[(i + 1) & 15];
+			s0 = ROR(s0, 7) ^ ROR(s0, 18) ^ (s0 >> 3);
+			s1 = w[(i + 14) & 15];
+			s1 = ROR(s1, 17) ^ ROR(s1, 19) ^ (s1 >> 10);
+			w[i & 15] += s0 + s1 + w[(i + 9) & 15];
+		}
+
+		t1 = h + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) +
+			((e & f) ^ (~e & g)) + sha256_k[i] + w[i & 15];
+		t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) +
+			((a & b) ^ (a & c) ^ (b & c));
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+
+	state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+	state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+void sha256_init(struct sha256_ctx *ctx)
+{
+	ctx->state[0] = 0x6a09e667;
+	ctx->state[1] = 0xbb67ae85;
+	ctx->state[2] = 0x3c6ef372;
+	ctx->state[3] = 0xa54ff53a;
+	ctx->state[4] = 0x510e527f;
+	ctx->state[5] = 0x9b05688c;
+	ctx->state[6] = 0x1f83d9ab;
+	ctx->state[7] = 0x5be0cd19;
+	ctx->count = 0;
+}
+
+void sha256_update(struct sha256_ctx *ctx, const uint8_t *data, uint32_t len)
+{
+	uint32_t fill = ctx->count % SHA256_BLOCK_SIZE;
+
+	ctx->count += len;
+
+	while (len) {
+		if (fill == 0 && len >= SHA256_BLOCK_SIZE) {
+			/* Whole blocks straight from the source */
+			sha256_block(ctx->state, data);
+			data += SHA256_BLOCK_SIZE;
+			len -= SHA256_BLOCK_SIZE;
+			continue;
+		}
+
+		ctx->buf[fill++] = *data++;
+		len--;
+		if (fill == SHA256_BLOCK_SIZE) {
+			sha256_block(ctx->state, ctx->buf);
+			fill = 0;
+		}
+	}
+}
+
+void sha256_final(struct sha256_ctx *ctx, uint8_t *digest)
+{
+	uint32_t fill = ctx->count % SHA256_BLOCK_SIZE;
+	uint32_t bits_hi = ctx->count >> 29, bits_lo = ctx->count << 3;
+	int i;
+
+	ctx->buf[fill++] = 0x80;
+	if (fill > SHA256_BLOCK_SIZE - 8) {
+		while (fill < SHA256_BLOCK_SIZE)
+			ctx->buf[fill++] = 0;
+		sha256_block(ctx->state, ctx->buf);
+		fill = 0;
+	}
+	while (fill < SHA256_BLOCK_SIZE - 8)
+		ctx->buf[fill++] = 0;
+
+	for (i = 0; i < 4; i++) {
+		ctx->buf[56 + i] = bits_hi >> (24 - 8 * i);
+		ctx->buf[60 + i] = bits_lo >> (24 - 8 * i);
+	}
+	sha256_block(ctx->state, ctx->buf);
+
+	for (i = 0; i < 8; i++) {
+		digest[4 * i] = ctx->state[i] >> 24;
+		digest[4 * i + 1] = ctx->state[i] >> 16;
+		digest[4 * i + 2] = ctx->state[i] >> 8;
+		digest[4 * i + 3] = ctx->state[i];
+	}
+}
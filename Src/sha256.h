@@ -0,0 +1,24 @@
+#ifndef _SHA256_H
+#define _SHA256_H
+
+#include <stdint.h>
+
+/*
+ * Software SHA-256 (FIPS 180-4), used where the HASH peripheral is not
+ * available. Data may be added in pieces of any size.
+ */
+
+#define SHA256_DIGEST_SIZE	32
+#define SHA256_BLOCK_SIZE	64
+
+struct sha256_ctx {
+	uint32_t state[8];
+	uint32_t count;		/* bytes hashed so far */
+	uint8_t buf[SHA256_BLOCK_SIZE];
+};
+
+void sha256_init(struct sha256_ctx *ctx);
+void sha256_update(struct sha256_ctx *ctx, const uint8_t *data, uint32_t len);
+void sha256_final(struct sha256_ctx *ctx, uint8_t *digest);
+
+#endif /* _SHA256_H */
@@ -0,0 +1,72 @@
+#include <stdint.h>
+#include "trace.h"
+#include "dwt.h"
+#include "tim.h"
+
+/* Range functions whose adjacent calls are merged */
+#define TRACE_MERGE		(1 << TRACE_ERASE_SECTOR | 1 << TRACE_PROGRAM_PAGE | \
+		1 << TRACE_VERIFY | 1 << TRACE_BLANK_CHECK | 1 << TRACE_READ)
+
+/* Timer at entry of the call being traced, calls do not nest */
+static uint32_t trace_start;
+
+/* Cycle counter at entry of a call */
+uint32_t trace_enter(void)
+{
+	tim_start();
+	trace_start = tim_count();
+	dwt_enable();
+
+	return dwt_cycles();
+}
+
+/* Verify() returns the end of the range when it matches, the rest 0 */
+int trace_ok(int func, uint32_t addr, uint32_t len, uint32_t result)
+{
+	return result == (func == TRACE_VERIFY ? addr + len : 0);
+}
+
+void trace_leave(struct trace_buf *t, int func, uint32_t addr, uint32_t len,
+		 uint32_t arg, uint32_t result, uint32_t start)
+{
+	uint32_t end = dwt_cycles(), stamp;
+	struct trace_rec *r;
+
+	tim_start();		/* Init() gated it off */
+	stamp = tim_count();
+
+	if (t->magic != TRACE_MAGIC) {
+		t->magic = TRACE_MAGIC;
+		t->rec_size = sizeof(struct trace_rec);
+		t->num_recs = TRACE_RECS;
+		t->cpu_hz = DWT_CPU_HZ;
+		t->timer_hz = TIM_HZ;
+		t->head = 0;
+	}
+
+	if (t->head) {
+		r = &t->rec[(t->head - 1) % TRACE_RECS];
+		if (r->func == func && (TRACE_MERGE & 1 << func) && len &&
+		    r->addr + r->len == addr && r->calls < 0xffff &&
+		    trace_ok(func, r->addr, r->len, r->result) &&
+		    trace_ok(func, addr, len, result)) {
+			r->calls++;
+			r->len += len;
+			r->result = result;
+			r->end = stamp;
+			r->cycles += end - start;
+			return;
+		}
+	}
+
+	r = &t->rec[t->head++ % TRACE_RECS];
+	r->func = func;
+	r->calls = 1;
+	r->addr = addr;
+	r->len = len;
+	r->arg = arg;
+	r->result = result;
+	r->start = trace_start;
+	r->end = stamp;
+	r->cycles = end - start;
+}
@@ -0,0 +1,75 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdint.h>
+
+/*
+ * Call trace of the loader entry points, SUPPORT_TRACE in FlashPrg.c.
+ * Every call is recorded with its arguments, the cycles spent in it, a
+ * timestamp at entry and exit and its result into a ring of TRACE_RECS
+ * records. A download is mostly long runs of EraseSector() /
+ * ProgramPage() / Verify() over adjacent ranges: successful calls of one
+ * function that continue the range of the previous record are merged
+ * into it, so that a whole session usually fits.
+ *
+ * The cycles come from CYCCNT, which stops while the core is halted
+ * between the calls. The timestamps come from the timer of tim.h, which
+ * does not: the time the J-Link DLL spends between the calls is the gap
+ * between them, less the cycles for the gaps inside a merged record.
+ * Init() runs clock_setup() and starts on the 64 MHz HSI, its cycles are
+ * counted at cpu_hz and read too short.
+ *
+ * The buffer is read from the target after the session in one piece and
+ * replayed on the host against the flash model with Tools/replay.c. The
+ * layout is fixed, little endian, and described by its header.
+ */
+#ifndef TRACE_RECS
+#define TRACE_RECS					64
+#endif
+
+#define TRACE_MAGIC					0x45434154	/* "TACE" */
+
+/* Entry points */
+#define TRACE_INIT					1
+#define TRACE_UNINIT				2
+#define TRACE_ERASE_SECTOR			3
+#define TRACE_PROGRAM_PAGE			4
+#define TRACE_VERIFY				5
+#define TRACE_BLANK_CHECK			6
+#define TRACE_READ					7	/* SEGGER_OPEN_Read() */
+#define TRACE_PROGRAM_COMPRESSED	8
+#define TRACE_PROGRAM_SCATTER		9
+#define TRACE_FILL_RANGE			10
+#define TRACE_HASH_REGION			11
+#define TRACE_LATENCY_MAP			12
+#define TRACE_NUM_FUNCS				13
+
+struct trace_rec {
+	uint16_t func;				/* TRACE_* */
+	uint16_t calls;				/* merged into this record */
+	uint32_t addr;				/* of the first call */
+	uint32_t len;				/* summed over the calls, EraseSector(): erased,
+								   Init(): Freq, ProgramScatter(): NumDescs */
+	uint32_t arg;				/* Func of Init() / UnInit(), Pattern, BlankData, Clear */
+	uint32_t result;			/* of the last call */
+	uint32_t start;				/* timer at entry of the first call */
+	uint32_t end;				/* at exit of the last call */
+	uint32_t cycles;			/* spent in the calls */
+};
+
+struct trace_buf {
+	uint32_t magic;
+	uint16_t rec_size;			/* sizeof(struct trace_rec) */
+	uint16_t num_recs;			/* TRACE_RECS */
+	uint32_t cpu_hz;			/* cycle counter rate after clock_setup() */
+	uint32_t timer_hz;			/* rate of start and end */
+	uint32_t head;				/* records written, the ring wraps */
+	struct trace_rec rec[TRACE_RECS];
+};
+
+uint32_t trace_enter(void);
+void trace_leave(struct trace_buf *t, int func, uint32_t addr, uint32_t len,
+		 uint32_t arg, uint32_t result, uint32_t start);
+int trace_ok(int func, uint32_t addr, uint32_t len, uint32_t result);
+
+#endif /* _TRACE_H */
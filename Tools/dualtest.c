@@ -0,0 +1,286 @@
+/*
+ * dualtest - host check of the dual-core ProgramCompressed() pipeline
+ *
+ * Two threads stand in for the cores: one runs the Cortex-M4 worker of
+ * Src/dual_core.c, the main thread posts jobs like the Cortex-M7 and
+ * programs the pages it drains into a RAM image. The HSEM doorbell is
+ * replaced by atomic flags. Streams are split at random points and the
+ * result, the skipped erased pages and the stream CRC are checked, as
+ * well as the recovery after a corrupt stream and a program error, and
+ * the timeouts when there is no worker or it stops in the middle of a job.
+ *
+ * Build: cc -O2 -pthread -I../Src -I../Src/hal -o dualtest dualtest.c
+ *        ../Src/dual_core.c ../Src/lz4_stream.c ../Src/crc32.c
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dual_core.h"
+#include "crc32.h"
+#include "hsem.h"
+
+#define IMAGE_SIZE		(192 * 1024 - 100)	/* last page padded */
+#define PADDED_SIZE		((IMAGE_SIZE + LZ4_PAGE_SIZE - 1) & ~(LZ4_PAGE_SIZE - 1))
+#define RUNS			200
+
+static struct dual_shared shared;
+static struct lz4_stream worker_stream;
+static int doorbell[32];
+static int worker_stop;
+static int doorbell_held;
+
+static uint8_t image[PADDED_SIZE];
+static uint8_t flash[PADDED_SIZE];
+static uint8_t stream[PADDED_SIZE * 2];
+static uint32_t stream_len;
+static uint32_t programmed, fail_at;
+
+int hsem_notify(int id)
+{
+	if (doorbell_held)
+		return -1;
+	__atomic_store_n(&doorbell[id], 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+int hsem_event(int id)
+{
+	return __atomic_exchange_n(&doorbell[id], 0, __ATOMIC_ACQ_REL);
+}
+
+static void *worker(void *arg)
+{
+	while (!__atomic_load_n(&worker_stop, __ATOMIC_RELAXED))
+		if (!dual_worker_poll(&shared))
+			sched_yield();
+	return arg;
+}
+
+/* An M4 that takes the job, hands over one page and then halts */
+static void *halting_worker(void *arg)
+{
+	while (!hsem_event(DUAL_HSEM_JOB))
+		sched_yield();
+	__atomic_store_n(&shared.ack_seq,
+			 __atomic_load_n(&shared.job_seq, __ATOMIC_ACQUIRE),
+			 __ATOMIC_RELEASE);
+	shared.slot[0].offset = 0;
+	shared.slot[0].flags = 0;
+	memset(shared.slot[0].data, 0x5a, LZ4_PAGE_SIZE);
+	__atomic_store_n(&shared.head, 1, __ATOMIC_RELEASE);
+	return arg;
+}
+
+/* Program sink of the "M7", pages must arrive in order and only once */
+static int program(uint32_t offset, const uint8_t *page)
+{
+	if (offset % LZ4_PAGE_SIZE || offset >= PADDED_SIZE)
+		return -1;
+	if (fail_at && offset == fail_at)
+		return -1;
+	memcpy(flash + offset, page, LZ4_PAGE_SIZE);
+	programmed++;
+	return 0;
+}
+
+static uint32_t emit_len(uint32_t op, uint32_t len)
+{
+	while (len >= 255) {
+		stream[op++] = 255;
+		len -= 255;
+	}
+	stream[op++] = len;
+	return op;
+}
+
+/*
+ * Minimal LZ4 block encoder: runs of a repeated byte become a literal
+ * plus an offset 1 match, everything else is copied as literals.
+ */
+static void encode(const uint8_t *in, uint32_t n)
+{
+	uint32_t ip = 0, anchor = 0, op = 0, run, nlit, ml;
+
+	while (ip + 12 < n) {
+		for (run = 1; ip + run < n - 5 && in[ip + run] == in[ip]; run++);
+		if (run < 16) {
+			ip += run;
+			continue;
+		}
+		nlit = ip + 1 - anchor;
+		ml = run - 1 - LZ4_MIN_MATCH;
+		stream[op++] = (nlit >= 15 ? 15 : nlit) << 4 | (ml >= 15 ? 15 : ml);
+		if (nlit >= 15)
+			op = emit_len(op, nlit - 15);
+		memcpy(stream + op, in + anchor, nlit);
+		op += nlit;
+		stream[op++] = 1;
+		stream[op++] = 0;
+		if (ml >= 15)
+			op = emit_len(op, ml - 15);
+		ip += run;
+		anchor = ip;
+	}
+	nlit = n - anchor;
+	stream[op++] = (nlit >= 15 ? 15 : nlit) << 4;
+	if (nlit >= 15)
+		op = emit_len(op, nlit - 15);
+	memcpy(stream + op, in + anchor, nlit);
+	stream_len = op + nlit;
+}
+
+/* Erased, random and run-length pages, some runs crossing pages */
+static void make_image(void)
+{
+	uint32_t i, page;
+
+	for (page = 0; page < PADDED_SIZE / LZ4_PAGE_SIZE; page++) {
+		uint8_t *p = image + page * LZ4_PAGE_SIZE;
+
+		switch (rand() % 4) {
+		case 0:
+			memset(p, 0xff, LZ4_PAGE_SIZE);
+			break;
+		case 1:
+			memset(p, rand(), LZ4_PAGE_SIZE);
+			break;
+		default:
+			for (i = 0; i < LZ4_PAGE_SIZE; i++)
+				p[i] = rand();
+			break;
+		}
+	}
+	memset(image + IMAGE_SIZE, 0xff, PADDED_SIZE - IMAGE_SIZE);
+}
+
+/* One stream, compressed data split into random chunks */
+static int run_stream(const uint8_t *src, uint32_t len, uint32_t *crc)
+{
+	uint32_t pos, chunk;
+	int ret;
+
+	ret = dual_run(&shared, DUAL_CMD_START, NULL, 0, program, crc);
+	for (pos = 0; !ret && pos < len; pos += chunk) {
+		chunk = 1 + rand() % 3000;
+		if (chunk > len - pos)
+			chunk = len - pos;
+		ret = dual_run(&shared, DUAL_CMD_DECODE, src + pos, chunk,
+			       program, crc);
+	}
+	if (!ret)
+		ret = dual_run(&shared, DUAL_CMD_FINISH, NULL, 0, program, crc);
+	return ret;
+}
+
+static int check_stream(void)
+{
+	uint32_t crc, erased = 0, page;
+
+	for (page = 0; page < PADDED_SIZE; page += LZ4_PAGE_SIZE) {
+		uint32_t i;
+
+		for (i = 0; i < LZ4_PAGE_SIZE && image[page + i] == 0xff; i++);
+		erased += i == LZ4_PAGE_SIZE;
+	}
+
+	memset(flash, 0xff, sizeof(flash));
+	programmed = 0;
+	if (run_stream(stream, stream_len, &crc)) {
+		fprintf(stderr, "stream failed\n");
+		return -1;
+	}
+	if (memcmp(flash, image, PADDED_SIZE)) {
+		fprintf(stderr, "output mismatch\n");
+		return -1;
+	}
+	if (programmed != PADDED_SIZE / LZ4_PAGE_SIZE - erased) {
+		fprintf(stderr, "%u pages programmed, %u expected\n",
+			programmed, PADDED_SIZE / LZ4_PAGE_SIZE - erased);
+		return -1;
+	}
+	if (crc != crc32(0, image, PADDED_SIZE)) {
+		fprintf(stderr, "crc 0x%08x, expected 0x%08x\n",
+			crc, crc32(0, image, PADDED_SIZE));
+		return -1;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	static const uint8_t bad[] = { 0x0f, 0xff, 0x7f };	/* offset past pos */
+	pthread_t thread;
+	uint32_t crc;
+	int i;
+
+	if (crc32(0, (const uint8_t *)"123456789", 9) != 0xcbf43926) {
+		fprintf(stderr, "crc32 check value mismatch\n");
+		return 1;
+	}
+
+	dual_init(&shared, &worker_stream);
+	if (dual_run(&shared, DUAL_CMD_START, NULL, 0, program, &crc) !=
+	    DUAL_NO_WORKER) {
+		fprintf(stderr, "job taken without a worker\n");
+		return 1;
+	}
+
+	dual_init(&shared, &worker_stream);
+	doorbell_held = 1;
+	if (dual_run(&shared, DUAL_CMD_START, NULL, 0, program, &crc) !=
+	    DUAL_NO_WORKER) {
+		fprintf(stderr, "job posted without the doorbell\n");
+		return 1;
+	}
+	doorbell_held = 0;
+
+	dual_init(&shared, &worker_stream);
+	doorbell[DUAL_HSEM_JOB] = 0;
+	programmed = 0;
+	pthread_create(&thread, NULL, halting_worker, NULL);
+	if (dual_run(&shared, DUAL_CMD_DECODE, stream, 1, program, &crc) !=
+	    DUAL_NO_WORKER || programmed != 1) {
+		fprintf(stderr, "halted worker not detected\n");
+		return 1;
+	}
+	pthread_join(thread, NULL);
+
+	dual_init(&shared, &worker_stream);
+	doorbell[DUAL_HSEM_JOB] = 0;
+	pthread_create(&thread, NULL, worker, NULL);
+
+	for (i = 0; i < RUNS; i++) {
+		make_image();
+		encode(image, IMAGE_SIZE);
+		if (check_stream())
+			goto fail;
+
+		/* Errors end the job cleanly, the next stream still works */
+		if (i % 16 == 1 && run_stream(bad, sizeof(bad), &crc) != DUAL_ERROR) {
+			fprintf(stderr, "corrupt stream not reported\n");
+			goto fail;
+		}
+		if (i % 16 == 2) {
+			fail_at = LZ4_PAGE_SIZE * 3;
+			memset(image, 0x55, LZ4_PAGE_SIZE * 4);
+			encode(image, IMAGE_SIZE);
+			if (run_stream(stream, stream_len, &crc) != DUAL_ERROR) {
+				fprintf(stderr, "program error not reported\n");
+				goto fail;
+			}
+			fail_at = 0;
+		}
+	}
+
+	__atomic_store_n(&worker_stop, 1, __ATOMIC_RELAXED);
+	pthread_join(thread, NULL);
+	printf("dual core pipeline OK, %d streams\n", RUNS);
+	return 0;
+
+fail:
+	fprintf(stderr, "failed in run %d\n", i);
+	return 1;
+}
@@ -0,0 +1,507 @@
+/*
+ * flashplan - plan the erase/program operations for an image
+ *
+ * The J-Link erases every 4 KB sector an image touches and programs all
+ * of it. flashplan walks the sector layout of the loader (FlashDevice in
+ * Src/FlashDev.c, built with the same switches) and, given what is on the
+ * chip, plans only the work that is needed:
+ *
+ *  - sectors whose content already matches, or that stay blank, are
+ *    skipped; blank sectors are programmed without an erase
+ *  - the remaining sectors are erased one by one with EraseSector(), the
+ *    only erase the loader offers; consecutive ones are printed as a run
+ *  - erased (all 0xFF) pages are not programmed, the rest is coalesced
+ *    into contiguous program runs
+ *
+ * The chip state is an optional map with one line per sector, as read
+ * from the target (CRC-32 as zlib over the whole sector):
+ *
+ *	0x90000000 blank
+ *	0x90001000 0x1c291ca3
+ *
+ * Sectors not in the map are unknown and get erased when touched. Bytes
+ * of a touched sector not covered by the image end up erased.
+ *
+ * The expected time of the plan and of the plain J-Link flow is printed,
+ * from typical tSE/tPP values (Tools/sim/flash_sim.h for the NOR) and the
+ * download rate. With -t the planner checks itself on built-in cases.
+ *
+ * Build: cc -O2 -I../Src -I../Src/hal -Isim -o flashplan flashplan.c
+ *        image.c ../Src/FlashDev.c ../Src/crc32.c
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "FlashOS.h"
+#include "FlashConf.h"
+#include "crc32.h"
+#include "flash_sim.h"
+#include "image.h"
+
+extern struct FlashDevice const FlashDevice;
+
+#define T_INT_SE_US		1000000		/* internal 128 KB sector erase */
+#define T_INT_PP_US		128			/* internal, 256 bytes in flash words */
+
+#define OP_ERASE		0
+#define OP_PROGRAM		1
+
+/* What is known about a sector on the chip */
+#define TGT_UNKNOWN		0
+#define TGT_BLANK		1
+#define TGT_CRC			2
+
+struct sector {
+	uint32_t addr;
+	uint32_t size;
+	uint8_t target;
+	uint8_t erase;
+	uint8_t program;
+	uint32_t crc;
+};
+
+struct op {
+	uint8_t type;
+	uint32_t addr;
+	uint32_t len;
+};
+
+struct plan {
+	struct op *ops;
+	int num_ops;
+	int num_erase, num_program;
+	uint64_t erase_us, program_us, xfer_us;
+	uint64_t naive_us;
+};
+
+static struct sector *sectors;
+static int num_sectors;
+static uint32_t page_size;
+static uint32_t rate_kbps = 1000;	/* download rate of the probe */
+
+static int is_nor(uint32_t addr)
+{
+	return addr >= QSPI_BASE_ADDR;
+}
+
+static uint32_t sector_erase_us(const struct sector *s)
+{
+	return is_nor(s->addr) ? SIM_T_SE_US : T_INT_SE_US;
+}
+
+static uint32_t page_program_us(uint32_t addr)
+{
+	return is_nor(addr) ? SIM_T_PP_US : T_INT_PP_US;
+}
+
+static uint64_t xfer_us(uint64_t bytes)
+{
+	return bytes * 1000 / rate_kbps;
+}
+
+/* Sector list from the FlashDevice layout */
+static int load_layout(void)
+{
+	const struct FlashDevice *d = &FlashDevice;
+	uint32_t start, end, addr;
+	int i, n = 0;
+
+	for (i = 0; d->SectorInfo[i].SectorSize != 0xFFFFFFFF; i++) {
+		start = d->SectorInfo[i].SectorStartAddr;
+		end = d->SectorInfo[i + 1].SectorSize != 0xFFFFFFFF ?
+		      d->SectorInfo[i + 1].SectorStartAddr : d->TotalSize;
+		n += (end - start) / d->SectorInfo[i].SectorSize;
+	}
+
+	sectors = calloc(n, sizeof(*sectors));
+	if (!sectors)
+		return -1;
+
+	for (i = 0, num_sectors = 0; d->SectorInfo[i].SectorSize != 0xFFFFFFFF; i++) {
+		start = d->SectorInfo[i].SectorStartAddr;
+		end = d->SectorInfo[i + 1].SectorSize != 0xFFFFFFFF ?
+		      d->SectorInfo[i + 1].SectorStartAddr : d->TotalSize;
+		for (addr = start; addr < end; addr += d->SectorInfo[i].SectorSize) {
+			sectors[num_sectors].addr = d->BaseAddr + addr;
+			sectors[num_sectors].size = d->SectorInfo[i].SectorSize;
+			num_sectors++;
+		}
+	}
+	page_size = d->PageSize;
+	return 0;
+}
+
+static void reset_sectors(void)
+{
+	int i;
+
+	for (i = 0; i < num_sectors; i++) {
+		sectors[i].target = TGT_UNKNOWN;
+		sectors[i].erase = 0;
+		sectors[i].program = 0;
+	}
+}
+
+static struct sector *find_sector(uint32_t addr)
+{
+	int lo = 0, hi = num_sectors - 1, mid;
+
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		if (addr < sectors[mid].addr)
+			hi = mid - 1;
+		else if (addr >= sectors[mid].addr + sectors[mid].size)
+			lo = mid + 1;
+		else
+			return &sectors[mid];
+	}
+	return NULL;
+}
+
+static int load_map(const char *path)
+{
+	char line[128], state[32];
+	unsigned long addr;
+	struct sector *s;
+	int lineno = 0;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		lineno++;
+		if (line[0] == '#' || line[0] == '\n' || line[0] == '\r')
+			continue;
+		if (sscanf(line, "%lx %31s", &addr, state) != 2 ||
+		    !(s = find_sector(addr)) || s->addr != addr) {
+			fprintf(stderr, "%s:%d: not a sector\n", path, lineno);
+			fclose(f);
+			return -1;
+		}
+		if (!strcmp(state, "blank")) {
+			s->target = TGT_BLANK;
+		} else {
+			s->target = TGT_CRC;
+			s->crc = strtoul(state, NULL, 16);
+		}
+	}
+
+	fclose(f);
+	return 0;
+}
+
+/* Sector content as it should end up, uncovered bytes erased */
+static void sector_data(const struct image *img, const struct sector *s,
+			uint8_t *buf)
+{
+	uint32_t i, a;
+
+	for (i = 0; i < s->size; i++) {
+		a = s->addr + i - img->base;
+		buf[i] = (s->addr + i >= img->base && a < img->size) ?
+			 img->data[a] : 0xff;
+	}
+}
+
+static int is_blank(const uint8_t *p, uint32_t len)
+{
+	while (len--)
+		if (*p++ != 0xff)
+			return 0;
+	return 1;
+}
+
+/* Appends an op, extending the last one when it is contiguous and alike */
+static int add_op(struct plan *p, int type, uint32_t addr, uint32_t len)
+{
+	struct op *ops;
+
+	if (p->num_ops && p->ops[p->num_ops - 1].type == type &&
+	    p->ops[p->num_ops - 1].addr + p->ops[p->num_ops - 1].len == addr) {
+		p->ops[p->num_ops - 1].len += len;
+		return 0;
+	}
+
+	ops = realloc(p->ops, (p->num_ops + 1) * sizeof(*ops));
+	if (!ops)
+		return -1;
+	p->ops = ops;
+	p->ops[p->num_ops].type = type;
+	p->ops[p->num_ops].addr = addr;
+	p->ops[p->num_ops].len = len;
+	p->num_ops++;
+	if (type == OP_PROGRAM)
+		p->num_program++;
+	return 0;
+}
+
+static int make_plan(const struct image *img, struct plan *p)
+{
+	uint8_t *buf;
+	uint32_t off, max = 0;
+	struct sector *s;
+	int i;
+
+	memset(p, 0, sizeof(*p));
+	for (i = 0; i < num_sectors; i++)
+		if (sectors[i].size > max)
+			max = sectors[i].size;
+	buf = malloc(max);
+	if (!buf)
+		return -1;
+
+	/* Decide per sector, and cost the plain J-Link flow on the way */
+	for (i = 0; i < num_sectors; i++) {
+		s = &sectors[i];
+		if (s->addr + s->size <= img->base ||
+		    s->addr >= img->base + img->size)
+			continue;
+		sector_data(img, s, buf);
+
+		p->naive_us += sector_erase_us(s) + xfer_us(s->size) +
+			       (uint64_t)s->size / page_size * page_program_us(s->addr);
+
+		if (s->target == TGT_CRC && s->crc == crc32(0, buf, s->size))
+			continue;
+		if (s->target == TGT_BLANK) {
+			s->program = !is_blank(buf, s->size);
+			continue;
+		}
+		s->erase = 1;
+		s->program = !is_blank(buf, s->size);
+	}
+
+	for (i = 0; i < num_sectors; i++) {
+		s = &sectors[i];
+		if (!s->erase)
+			continue;
+		if (add_op(p, OP_ERASE, s->addr, s->size))
+			goto fail;
+		p->num_erase++;
+		p->erase_us += sector_erase_us(s);
+	}
+
+	for (i = 0; i < num_sectors; i++) {
+		s = &sectors[i];
+		if (!s->program)
+			continue;
+		sector_data(img, s, buf);
+		for (off = 0; off < s->size; off += page_size) {
+			if (is_blank(buf + off, page_size))
+				continue;
+			if (add_op(p, OP_PROGRAM, s->addr + off, page_size))
+				goto fail;
+			p->program_us += page_program_us(s->addr + off);
+			p->xfer_us += xfer_us(page_size);
+		}
+	}
+
+	free(buf);
+	return 0;
+
+fail:
+	free(buf);
+	free(p->ops);
+	return -1;
+}
+
+static void print_plan(const struct plan *p)
+{
+	uint64_t total = p->erase_us + p->program_us + p->xfer_us;
+	int i;
+
+	for (i = 0; i < p->num_ops; i++)
+		printf("%-7s 0x%08x 0x%x\n",
+		       p->ops[i].type == OP_ERASE ? "erase" : "program",
+		       p->ops[i].addr, p->ops[i].len);
+
+	printf("# erase %d sectors %.1f ms, program %d runs %.1f ms, download %.1f ms\n",
+	       p->num_erase, p->erase_us / 1e3, p->num_program,
+	       p->program_us / 1e3, p->xfer_us / 1e3);
+	printf("# total %.1f ms, erase+program of all touched sectors %.1f ms\n",
+	       total / 1e3, p->naive_us / 1e3);
+}
+
+/* Built-in cases on the QSPI bank, checked against the expected ops */
+struct test_case {
+	const char *name;
+	uint32_t offset, size;	/* image, relative to QSPI_BASE_ADDR */
+	int blank_page;		/* page made erased in the image, -1 none */
+	int num_blank;		/* target sectors known blank from the image start */
+	int match_first;	/* first sector CRC matches */
+	struct op expect[4];
+	int num_expect;
+};
+
+static const struct test_case tests[] = {
+	{ "128K range", 0, 0x20000, -1, 0, 0,
+	  { { OP_ERASE, 0, 0x20000 }, { OP_PROGRAM, 0, 0x20000 } }, 2 },
+	{ "unaligned range", 0xf800, 0x11000, -1, 0, 0,
+	  { { OP_ERASE, 0xf000, 0x12000 }, { OP_PROGRAM, 0xf800, 0x11000 } }, 2 },
+	{ "blank target, no erase", 0, 0x2000, 1, 2, 0,
+	  { { OP_PROGRAM, 0, 0x100 }, { OP_PROGRAM, 0x200, 0x1e00 } }, 2 },
+	{ "unchanged sector skipped", 0, 0x2000, -1, 0, 1,
+	  { { OP_ERASE, 0x1000, 0x1000 }, { OP_PROGRAM, 0x1000, 0x1000 } }, 2 },
+	{ "blank neighbours not erased", 0x1000, 0x2000, -1, -1, 0,
+	  { { OP_ERASE, 0x1000, 0x2000 }, { OP_PROGRAM, 0x1000, 0x2000 } }, 2 },
+};
+
+static int run_test(const struct test_case *t)
+{
+	struct image img;
+	struct plan p;
+	uint8_t *buf;
+	uint32_t i;
+	int k, ret = 0;
+
+	reset_sectors();
+	img.base = QSPI_BASE_ADDR + t->offset;
+	img.size = t->size;
+	img.data = malloc(t->size);
+	img.used = malloc(t->size);
+	buf = malloc(0x1000);
+	if (!img.data || !img.used || !buf)
+		return -1;
+	for (i = 0; i < t->size; i++)
+		img.data[i] = i * 7 + 1;
+	memset(img.used, 1, t->size);
+	if (t->blank_page >= 0)
+		memset(img.data + t->blank_page * page_size, 0xff, page_size);
+
+	/* num_blank < 0: sectors past the image, up to 32K from its start, blank */
+	if (t->num_blank < 0) {
+		for (i = t->size; i < 0x8000; i += 0x1000)
+			find_sector(img.base + i)->target = TGT_BLANK;
+	}
+	for (k = 0; k < t->num_blank; k++)
+		find_sector(img.base + k * 0x1000)->target = TGT_BLANK;
+	if (t->match_first) {
+		struct sector *s = find_sector(img.base);
+
+		sector_data(&img, s, buf);
+		s->target = TGT_CRC;
+		s->crc = crc32(0, buf, s->size);
+	}
+
+	if (make_plan(&img, &p)) {
+		ret = -1;
+		goto out;
+	}
+
+	if (p.num_ops != t->num_expect)
+		ret = -1;
+	for (k = 0; !ret && k < p.num_ops; k++)
+		if (p.ops[k].type != t->expect[k].type ||
+		    p.ops[k].addr != QSPI_BASE_ADDR + t->expect[k].addr ||
+		    p.ops[k].len != t->expect[k].len)
+			ret = -1;
+	if (ret) {
+		fprintf(stderr, "self test \"%s\" failed, plan:\n", t->name);
+		print_plan(&p);
+	}
+	free(p.ops);
+out:
+	free(img.data);
+	free(img.used);
+	free(buf);
+	return ret;
+}
+
+static int self_test(void)
+{
+	int i, fails = 0;
+
+	if (crc32(0, (const uint8_t *)"123456789", 9) != 0xcbf43926) {
+		fprintf(stderr, "self test: crc32 check value mismatch\n");
+		return -1;
+	}
+
+	for (i = 0; i < (int)(sizeof(tests) / sizeof(tests[0])); i++)
+		if (run_test(&tests[i]))
+			fails++;
+
+	if (fails)
+		return -1;
+	printf("self test OK, %d cases\n", i);
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-a addr] [-m map] [-r kbps] input.{bin,hex}\n"
+		"       %s -t\n"
+		"  -a addr    load address of .bin input (default 0x%08x)\n"
+		"  -m map     per-sector blank/CRC-32 map read from the target\n"
+		"  -r kbps    download rate in KB/s for the time model (default %u)\n"
+		"  -t         check the planner on built-in cases\n",
+		prog, prog, QSPI_BASE_ADDR, rate_kbps);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	const char *map = NULL;
+	uint32_t base = QSPI_BASE_ADDR;
+	struct image img;
+	struct plan p;
+	int opt, test = 0;
+
+	while ((opt = getopt(argc, argv, "a:m:r:t")) != -1) {
+		switch (opt) {
+		case 'a':
+			base = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			map = optarg;
+			break;
+		case 'r':
+			rate_kbps = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			test = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!rate_kbps || (!test && argc - optind != 1))
+		usage(argv[0]);
+
+	if (load_layout()) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	if (test)
+		return self_test() ? 1 : 0;
+
+	if (map && load_map(map))
+		return 1;
+	if (image_load(&img, argv[optind], base))
+		return 1;
+
+	if (img.base < FlashDevice.BaseAddr ||
+	    img.base + img.size > FlashDevice.BaseAddr + FlashDevice.TotalSize) {
+		fprintf(stderr, "image 0x%08x..0x%08x outside the flash\n",
+			img.base, img.base + img.size);
+		return 1;
+	}
+
+	if (make_plan(&img, &p)) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	printf("# %s 0x%08x..0x%08x\n", argv[optind], img.base, img.base + img.size);
+	print_plan(&p);
+
+	free(p.ops);
+	image_free(&img);
+	return 0;
+}
@@ -0,0 +1,151 @@
+/*
+ * hashtest - host check of the SHA-256 of HashRegion()
+ *
+ * Checks Src/sha256.c against the FIPS 180-4 example digests, fed in one
+ * piece and in pieces across the block boundaries, then programs random
+ * data into the NOR model of Tools/sim and checks HashRegion() over
+ * unaligned ranges and lengths around the 55/56/64 byte padding cases.
+ * HashRegion() is called right after programming, it has to map the
+ * flash itself.
+ *
+ * Built and run with "make test" in Tools/.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FlashOS.h"
+#include "FlashConf.h"
+#include "flash_bus.h"
+#include "sim_test.h"
+#include "sha256.h"
+
+#define REGION_ADDR		(QSPI_BASE_ADDR + 0x80000)
+#define REGION_SIZE		(4 * QSPI_SECTOR_SIZE)
+
+static const struct {
+	const char *msg;
+	uint32_t repeat;
+	const char *digest;
+} vectors[] = {
+	{ "", 1,
+	  "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+	{ "abc", 1,
+	  "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+	{ "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1,
+	  "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+	{ "a", 1000000,
+	  "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" },
+};
+
+static U8 data[REGION_SIZE];
+
+static void to_hex(const U8 *digest, char *hex)
+{
+	int i;
+
+	for (i = 0; i < SHA256_DIGEST_SIZE; i++)
+		sprintf(hex + 2 * i, "%02x", digest[i]);
+}
+
+/* Digest of msg repeated, added in pieces of 'piece' bytes (0: one call) */
+static void hash_vector(const char *msg, uint32_t repeat, uint32_t piece, char *hex)
+{
+	struct sha256_ctx ctx;
+	U8 digest[SHA256_DIGEST_SIZE];
+	uint32_t len = strlen(msg), i, n;
+
+	sha256_init(&ctx);
+	for (i = 0; i < repeat; i++) {
+		if (!piece) {
+			sha256_update(&ctx, (const uint8_t *)msg, len);
+			continue;
+		}
+		for (n = 0; n < len; n += piece)
+			sha256_update(&ctx, (const uint8_t *)msg + n,
+				      len - n < piece ? len - n : piece);
+	}
+	sha256_final(&ctx, digest);
+	to_hex(digest, hex);
+}
+
+static int check_vectors(void)
+{
+	static const uint32_t pieces[] = { 0, 1, 7, 63 };
+	char hex[2 * SHA256_DIGEST_SIZE + 1];
+	uint32_t i, j;
+
+	for (i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+		for (j = 0; j < sizeof(pieces) / sizeof(pieces[0]); j++) {
+			if (vectors[i].repeat > 1 && pieces[j] > 1)
+				continue;	/* the 1 byte message has one piece size */
+			hash_vector(vectors[i].msg, vectors[i].repeat, pieces[j], hex);
+			if (strcmp(hex, vectors[i].digest))
+				return sim_fail("FIPS 180-4 example digest mismatch");
+		}
+	}
+	return 0;
+}
+
+static int program_region(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < REGION_SIZE; i++)
+		data[i] = rand();
+	if (Init(QSPI_BASE_ADDR, 0, 1))
+		return sim_fail("Init(1) failed");
+	for (i = 0; i < REGION_SIZE; i += QSPI_SECTOR_SIZE)
+		if (EraseSector(REGION_ADDR + i))
+			return sim_fail("erase failed");
+	UnInit(1);
+	if (Init(QSPI_BASE_ADDR, 0, 2))
+		return sim_fail("Init(2) failed");
+	for (i = 0; i < REGION_SIZE; i += QSPI_PAGE_SIZE)
+		if (ProgramPage(REGION_ADDR + i, QSPI_PAGE_SIZE, data + i))
+			return sim_fail("program failed");
+	return 0;
+}
+
+static int check_region(uint32_t off, uint32_t len)
+{
+	struct sha256_ctx ctx;
+	U8 want[SHA256_DIGEST_SIZE], got[SHA256_DIGEST_SIZE];
+
+	sha256_init(&ctx);
+	sha256_update(&ctx, data + off, len);
+	sha256_final(&ctx, want);
+	if (HashRegion(REGION_ADDR + off, len, got))
+		return sim_fail("HashRegion failed");
+	if (memcmp(want, got, sizeof(got)))
+		return sim_fail("HashRegion digest mismatch");
+	return 0;
+}
+
+int main(void)
+{
+	static const uint32_t lens[] = { 0, 1, 55, 56, 63, 64, 65, 119, 120, 4096, REGION_SIZE - 3 };
+	U8 digest[SHA256_DIGEST_SIZE];
+	uint32_t i;
+
+	if (check_vectors() || program_region())
+		return 1;
+
+	/* Still in the program phase, HashRegion() maps the flash itself */
+	if (check_region(0, REGION_SIZE))
+		return 1;
+	UnInit(2);
+
+	Init(QSPI_BASE_ADDR, 0, 3);
+	for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++)
+		if (check_region(3, lens[i]) || check_region(0, lens[i]))
+			return 1;
+	if (!HashRegion(QSPI_BASE_ADDR - 0x1000, 64, digest))
+		return sim_fail("range outside the flash hashed");
+	if (!HashRegion(QSPI_BASE_ADDR + QSPI_DEVICE_SIZE - 32, 64, digest))
+		return sim_fail("range past the end of the flash hashed");
+	UnInit(3);
+
+	printf("hash OK\n");
+	return 0;
+}
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "image.h"
+
+#define IMAGE_ERASED_VAL	0xFF
+
+static int hex_nibble(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/* Parse one Intel hex record into rec[], returns record length or -1 */
+static int hex_record(const char *line, uint8_t *rec)
+{
+	int i, hi, lo, len;
+	uint8_t sum = 0;
+
+	if (*line++ != ':')
+		return -1;
+
+	for (i = 0; ; i++) {
+		hi = hex_nibble(line[2 * i]);
+		if (hi < 0)
+			break;
+		lo = hex_nibble(line[2 * i + 1]);
+		if (lo < 0 || i >= 5 + 255)
+			return -1;
+		rec[i] = (hi << 4) | lo;
+		sum += rec[i];
+	}
+
+	len = i;
+	if (len < 5 || len != rec[0] + 5 || sum)
+		return -1;
+
+	return len;
+}
+
+/* Grow the image so that [addr, addr + len) is inside it */
+static int image_cover(struct image *img, uint32_t addr, uint32_t len)
+{
+	uint32_t base, end;
+	uint8_t *data, *used;
+
+	if (!img->data) {
+		base = addr;
+		end = addr + len;
+	} else {
+		base = addr < img->base ? addr : img->base;
+		end = img->base + img->size;
+		if (addr + len > end)
+			end = addr + len;
+		if (base == img->base && end == img->base + img->size)
+			return 0;
+	}
+
+	data = malloc(end - base);
+	used = calloc(end - base, 1);
+	if (!data || !used) {
+		free(data);
+		free(used);
+		return -1;
+	}
+	memset(data, IMAGE_ERASED_VAL, end - base);
+	if (img->data) {
+		memcpy(data + img->base - base, img->data, img->size);
+		memcpy(used + img->base - base, img->used, img->size);
+		free(img->data);
+		free(img->used);
+	}
+
+	img->data = data;
+	img->used = used;
+	img->base = base;
+	img->size = end - base;
+	return 0;
+}
+
+static int image_load_hex(struct image *img, FILE *f)
+{
+	char line[600];
+	uint8_t rec[5 + 255];
+	uint32_t upper = 0, addr;
+	int len, lineno = 0;
+
+	while (fgets(line, sizeof(line), f)) {
+		lineno++;
+		if (line[0] == '\r' || line[0] == '\n')
+			continue;
+
+		len = hex_record(line, rec);
+		if (len < 0) {
+			fprintf(stderr, "hex: bad record on line %d\n", lineno);
+			return -1;
+		}
+
+		switch (rec[3]) {
+		case 0x00:	/* data */
+			addr = upper + ((uint32_t)rec[1] << 8) + rec[2];
+			if (image_cover(img, addr, rec[0]))
+				return -1;
+			memcpy(img->data + addr - img->base, &rec[4], rec[0]);
+			memset(img->used + addr - img->base, 1, rec[0]);
+			break;
+		case 0x01:	/* end of file */
+			return 0;
+		case 0x02:	/* extended segment address */
+			upper = (((uint32_t)rec[4] << 8) | rec[5]) << 4;
+			break;
+		case 0x04:	/* extended linear address */
+			upper = (((uint32_t)rec[4] << 8) | rec[5]) << 16;
+			break;
+		case 0x03:	/* start segment address */
+		case 0x05:	/* start linear address */
+			break;
+		default:
+			fprintf(stderr, "hex: unknown record type %02x on line %d\n",
+				rec[3], lineno);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int image_load_bin(struct image *img, FILE *f, uint32_t base)
+{
+	long size;
+
+	if (fseek(f, 0, SEEK_END) || (size = ftell(f)) < 0 ||
+	    fseek(f, 0, SEEK_SET))
+		return -1;
+
+	if (image_cover(img, base, size))
+		return -1;
+	if (size && fread(img->data, size, 1, f) != 1)
+		return -1;
+	memset(img->used, 1, size);
+	return 0;
+}
+
+int image_load(struct image *img, const char *path, uint32_t base)
+{
+	const char *ext = strrchr(path, '.');
+	FILE *f;
+	int ret;
+
+	memset(img, 0, sizeof(*img));
+
+	f = fopen(path, "rb");
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+
+	if (ext && !strcasecmp(ext, ".hex"))
+		ret = image_load_hex(img, f);
+	else
+		ret = image_load_bin(img, f, base);
+
+	fclose(f);
+	if (ret)
+		image_free(img);
+	return ret;
+}
+
+void image_free(struct image *img)
+{
+	free(img->data);
+	free(img->used);
+	memset(img, 0, sizeof(*img));
+}
@@ -0,0 +1,21 @@
+#ifndef _IMAGE_H
+#define _IMAGE_H
+
+#include <stdint.h>
+
+/*
+ * Flat flash image loaded from a raw .bin or an Intel .hex file.
+ * Gaps between hex records are filled with the erased value (0xFF).
+ */
+struct image {
+	uint32_t base;
+	uint32_t size;
+	uint8_t *data;
+	uint8_t *used;	/* per byte: 1 if covered by the input file */
+};
+
+/* base is used for .bin input and ignored for .hex */
+int image_load(struct image *img, const char *path, uint32_t base);
+void image_free(struct image *img);
+
+#endif /* _IMAGE_H */
@@ -0,0 +1,199 @@
+/*
+ * journaltest - host check of the resumable session journal
+ *
+ * Runs download sessions against the NOR model of Tools/sim the way
+ * J-Link does: Init(1), EraseSector() per sector, UnInit(1), Init(2),
+ * ProgramPage() for every page that is not blank, UnInit(2). A session
+ * cut short stops without UnInit(), like a power loss. Checks that the
+ * next session skips the erases and page programs of the sectors the
+ * journal recorded, that the result matches when the image changed in
+ * between, and that the journal is cleared once a session completes.
+ * A large image cut near its end checks that the journal holds more
+ * sectors than one journal sector has records for.
+ *
+ * Built and run with "make test" in Tools/.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FlashOS.h"
+#include "FlashConf.h"
+#include "flash_bus.h"
+#include "sim_test.h"
+
+#if !SUPPORT_JOURNAL
+#error journaltest needs SUPPORT_JOURNAL=1
+#endif
+
+#define REGION_ADDR		(QSPI_BASE_ADDR + 0x40000)
+#define REGION_SIZE		(32 * QSPI_SECTOR_SIZE)
+#define REGION_PAGES	(REGION_SIZE / QSPI_PAGE_SIZE)
+
+/* More sectors than the 255 records of a single journal sector */
+#define LARGE_ADDR		(QSPI_BASE_ADDR + 0x100000)
+#define LARGE_SECTORS	320
+#define LARGE_SIZE		(LARGE_SECTORS * QSPI_SECTOR_SIZE)
+#define LARGE_CUT		300
+
+extern U32 JournalExtents;
+extern U32 JournalSkippedErases;
+extern U32 JournalSkippedPages;
+extern U32 JournalDropped;
+
+static U8 image[REGION_SIZE];
+static U8 large[LARGE_SIZE];
+
+/* One session, programming stops after 'pages' pages when not complete */
+static int session_at(uint32_t addr, const U8 *img, uint32_t size,
+		      uint32_t pages, uint32_t *us)
+{
+	uint32_t t = flash_sim_cycles(), i;
+
+	JournalSkippedErases = 0;
+	JournalSkippedPages = 0;
+	if (Init(QSPI_BASE_ADDR, 0, 1))
+		return -1;
+	for (i = 0; i < size; i += QSPI_SECTOR_SIZE)
+		if (EraseSector(addr + i))
+			return -1;
+	UnInit(1);
+	if (Init(QSPI_BASE_ADDR, 0, 2))
+		return -1;
+	for (i = 0; i < size / QSPI_PAGE_SIZE && i < pages; i++) {
+		const U8 *p = img + i * QSPI_PAGE_SIZE;
+
+		if (!sim_blank(p, QSPI_PAGE_SIZE) &&
+		    ProgramPage(addr + i * QSPI_PAGE_SIZE, QSPI_PAGE_SIZE, (U8 *)p))
+			return -1;
+	}
+	if (i == size / QSPI_PAGE_SIZE)
+		UnInit(2);
+	*us = SIM_CYCLES_US(flash_sim_cycles() - t);
+	return 0;
+}
+
+static int session(uint32_t pages, uint32_t *us)
+{
+	return session_at(REGION_ADDR, image, REGION_SIZE, pages, us);
+}
+
+static int journal_blank(void)
+{
+	flash_bus_mmap();
+	return sim_blank(flash_bus_ptr(QSPI_JOURNAL_ADDR),
+			 QSPI_JOURNAL_SECTORS * QSPI_SECTOR_SIZE);
+}
+
+static int check_large(void)
+{
+	uint32_t full, cut, resumed, i;
+
+	for (i = 0; i < LARGE_SIZE; i++)
+		large[i] = rand();
+	if (session_at(LARGE_ADDR, large, LARGE_SIZE, LARGE_SECTORS * 16, &full))
+		return sim_fail("large session failed");
+
+	/* Cut in sector LARGE_CUT, the sectors before it are recorded */
+	for (i = 0; i < LARGE_SIZE; i++)
+		large[i] ^= 0x5a;
+	if (session_at(LARGE_ADDR, large, LARGE_SIZE, LARGE_CUT * 16 + 5, &cut))
+		return sim_fail("interrupted large session failed");
+	if (session_at(LARGE_ADDR, large, LARGE_SIZE, LARGE_SECTORS * 16, &resumed))
+		return sim_fail("resumed large session failed");
+	if (JournalExtents != LARGE_CUT || JournalSkippedErases != LARGE_CUT ||
+	    JournalDropped)
+		return sim_fail("large journal not recorded completely");
+	if (memcmp(flash_sim_ptr(LARGE_ADDR), large, LARGE_SIZE))
+		return sim_fail("content mismatch after a large resume");
+	if (!journal_blank())
+		return sim_fail("journal not cleared after a large resume");
+	printf("%u sectors: full session %8u us, resumed after %u %8u us\n",
+	       LARGE_SECTORS, full, LARGE_CUT, resumed);
+	return 0;
+}
+
+int main(void)
+{
+	uint32_t full, cut, resumed, v, i;
+
+	for (i = 0; i < REGION_SIZE; i++)
+		image[i] = rand();
+	memset(image + 5 * QSPI_SECTOR_SIZE, 0xff, QSPI_SECTOR_SIZE);
+	v = flash_sim_violations();
+
+	/* Reference session, nothing recorded before */
+	if (session(REGION_PAGES, &full) || JournalSkippedErases || JournalSkippedPages)
+		return sim_fail("first session failed");
+	if (!journal_blank())
+		return sim_fail("journal not cleared after a complete session");
+
+	/*
+	 * Cut in sector 20: a sector is recorded once programming moves on,
+	 * the blank sector 5 is never programmed, 19 recorded
+	 */
+	if (session(20 * QSPI_SECTOR_SIZE / QSPI_PAGE_SIZE + 3, &cut))
+		return sim_fail("interrupted session failed");
+	if (journal_blank())
+		return sim_fail("nothing recorded by the interrupted session");
+
+	if (session(REGION_PAGES, &resumed))
+		return sim_fail("resumed session failed");
+	if (JournalExtents != 19)
+		return sim_fail("wrong number of extents found");
+	if (JournalSkippedErases != 19)
+		return sim_fail("erases of recorded sectors not skipped");
+	if (JournalSkippedPages != 19 * QSPI_SECTOR_SIZE / QSPI_PAGE_SIZE)
+		return sim_fail("pages of recorded sectors not skipped");
+	if (memcmp(flash_sim_ptr(REGION_ADDR), image, REGION_SIZE))
+		return sim_fail("content mismatch after resume");
+	if (!journal_blank())
+		return sim_fail("journal not cleared after resume");
+	printf("full session %8u us, cut in sector 20 of 32 %8u us,\n"
+	       "resumed %8u us, %lu erases and %lu page programs skipped\n",
+	       full, cut, resumed, JournalSkippedErases, JournalSkippedPages);
+
+	/*
+	 * The image changes between the cut and the resume: a page in the
+	 * middle of a recorded sector, a page that becomes blank at the end
+	 * of another one and a whole recorded sector.
+	 */
+	if (session(12 * QSPI_SECTOR_SIZE / QSPI_PAGE_SIZE, &cut))
+		return sim_fail("second interrupted session failed");
+	image[2 * QSPI_SECTOR_SIZE + 7 * QSPI_PAGE_SIZE + 1] ^= 0x40;
+	memset(image + 4 * QSPI_SECTOR_SIZE - QSPI_PAGE_SIZE, 0xff, QSPI_PAGE_SIZE);
+	for (i = 0; i < QSPI_SECTOR_SIZE; i++)
+		image[9 * QSPI_SECTOR_SIZE + i] = rand();
+	if (session(REGION_PAGES, &resumed))
+		return sim_fail("resume with a changed image failed");
+	if (JournalExtents != 10 || JournalSkippedErases != 10)
+		return sim_fail("changed sector erase skipped");
+	if (memcmp(flash_sim_ptr(REGION_ADDR), image, REGION_SIZE))
+		return sim_fail("content mismatch after resume with a changed image");
+	if (!journal_blank())
+		return sim_fail("journal not cleared after resume with a changed image");
+
+	/* A journal of another layout is dropped, not trusted */
+	if (session(4 * QSPI_SECTOR_SIZE / QSPI_PAGE_SIZE, &cut))
+		return sim_fail("third interrupted session failed");
+	{
+		U8 page[QSPI_PAGE_SIZE];
+
+		memcpy(page, flash_bus_ptr(QSPI_JOURNAL_ADDR), sizeof(page));
+		page[6] = 0;	/* header device size */
+		flash_bus_write(QSPI_JOURNAL_ADDR - QSPI_BASE_ADDR, page, sizeof(page));
+	}
+	image[0] ^= 1;
+	if (session(REGION_PAGES, &resumed) || JournalExtents || JournalSkippedErases)
+		return sim_fail("foreign journal used");
+	if (memcmp(flash_sim_ptr(REGION_ADDR), image, REGION_SIZE))
+		return sim_fail("content mismatch after a foreign journal");
+
+	if (check_large())
+		return 1;
+
+	if (flash_sim_violations() != v)
+		return sim_fail("flash protocol violated");
+	printf("journal OK\n");
+	return 0;
+}
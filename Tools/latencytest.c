@@ -0,0 +1,105 @@
+/*
+ * latencytest - host check of the erase/program busy time map
+ *
+ * Erases and programs a region of the NOR model of Tools/sim through
+ * EraseSector() and ProgramPage() with one sector made slow, reads the
+ * map with LatencyMap() and checks that the slow sector stands out,
+ * that the page programs land in the tPP bin and that Clear starts over.
+ *
+ * Built and run with "make test" in Tools/.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FlashOS.h"
+#include "FlashConf.h"
+#include "flash_bus.h"
+#include "sim_test.h"
+#include "latency.h"
+
+#if !FLASH_BUS_LATENCY
+#error latencytest needs FLASH_BUS_LATENCY=1
+#endif
+
+#define REGION_SECTOR	16
+#define REGION_SECTORS	16
+#define SLOW_SECTOR		(REGION_SECTOR + 7)
+#define SLOW_MS			400			/* tSE max, must not saturate */
+
+/* Map cell of an erase of 'us' */
+#define ERASE_UNITS(us)	(((us) + LATENCY_ERASE_UNIT_US - 1) / LATENCY_ERASE_UNIT_US)
+
+int LatencyMap(U8 *pDest, U32 NumBytes, U32 Clear);
+
+static struct latency_map map;
+static U8 page[QSPI_PAGE_SIZE];
+
+int main(void)
+{
+	uint32_t i, s, addr;
+
+	if (Init(QSPI_BASE_ADDR, 0, 1))
+		return sim_fail("Init failed");
+	flash_sim_set_erase_ms(SLOW_SECTOR * QSPI_SECTOR_SIZE, SLOW_MS);
+	for (s = REGION_SECTOR; s < REGION_SECTOR + REGION_SECTORS; s++)
+		EraseSector(QSPI_BASE_ADDR + s * QSPI_SECTOR_SIZE);
+	/* Sector 0 of the region twice, min and max apart */
+	flash_sim_set_erase_ms(REGION_SECTOR * QSPI_SECTOR_SIZE, 60);
+	EraseSector(QSPI_BASE_ADDR + REGION_SECTOR * QSPI_SECTOR_SIZE);
+	UnInit(1);
+
+	Init(QSPI_BASE_ADDR, 0, 2);
+	for (i = 0; i < sizeof(page); i++)
+		page[i] = rand();
+	for (i = 0; i < REGION_SECTORS * QSPI_SECTOR_SIZE; i += QSPI_PAGE_SIZE) {
+		addr = QSPI_BASE_ADDR + REGION_SECTOR * QSPI_SECTOR_SIZE + i;
+		if (ProgramPage(addr, QSPI_PAGE_SIZE, page))
+			return sim_fail("ProgramPage failed");
+	}
+	UnInit(2);
+
+	/* A short buffer gets the header, the size tells what is missing */
+	if (LatencyMap((U8 *)&map, 8, 0) != sizeof(map) || map.magic != LATENCY_MAGIC ||
+	    map.size != sizeof(map))
+		return sim_fail("bad map header");
+	if (LatencyMap((U8 *)&map, sizeof(map), 1) != sizeof(map))
+		return sim_fail("LatencyMap failed");
+
+	if (map.erases != REGION_SECTORS + 1 || map.erase_max_us < SLOW_MS * 1000)
+		return sim_fail("wrong erase totals");
+	for (s = 0; s < LATENCY_SECTORS; s++) {
+		uint32_t sector = s + LATENCY_FIRST_SECTOR;
+		uint32_t t = map.erase_last[s];
+
+		if (sector < REGION_SECTOR || sector >= REGION_SECTOR + REGION_SECTORS) {
+			if (t || map.erase_min[s] || map.erase_max[s])
+				return sim_fail("sector outside the region recorded");
+			continue;
+		}
+		if (sector == SLOW_SECTOR) {
+			if (t != ERASE_UNITS(SLOW_MS * 1000) || map.erase_min[s] != t ||
+			    map.erase_max[s] != t)
+				return sim_fail("slow sector not recorded");
+		} else if (sector == REGION_SECTOR) {
+			if (t != ERASE_UNITS(60000) || map.erase_min[s] != ERASE_UNITS(SIM_T_SE_US) ||
+			    map.erase_max[s] != t)
+				return sim_fail("min/max/last of a sector erased twice wrong");
+		} else if (t != ERASE_UNITS(SIM_T_SE_US) || map.erase_max[s] != t) {
+			return sim_fail("erase time not recorded");
+		}
+	}
+
+	if (map.pages != REGION_SECTORS * QSPI_SECTOR_SIZE / QSPI_PAGE_SIZE ||
+	    map.page_hist[SIM_T_PP_US / LATENCY_PAGE_BIN_US] != map.pages)
+		return sim_fail("page programs not in the tPP bin");
+	printf("%u erases, slowest %u us, %u pages, slowest %u us\n",
+	       map.erases, map.erase_max_us, map.pages, map.page_max_us);
+
+	LatencyMap((U8 *)&map, sizeof(map), 0);
+	if (map.erases || map.pages || map.erase_last[SLOW_SECTOR - LATENCY_FIRST_SECTOR])
+		return sim_fail("map not cleared");
+
+	printf("latency map OK\n");
+	return 0;
+}
@@ -0,0 +1,254 @@
+/*
+ * lz4pack - produce the compressed stream consumed by ProgramCompressed()
+ *
+ * The output is plain LZ4 block format with match offsets limited to the
+ * decoder window of the loader (LZ4_WINDOW_SIZE in Src/lz4_stream.h).
+ * The stream starts at the page aligned base address of the image, which
+ * is printed so that it can be passed as DestAddr.
+ *
+ * With -t the stream is decoded again with the loader decompressor,
+ * split into odd sized chunks, compared against the input and timed.
+ *
+ * Build: cc -O2 -I../Src -o lz4pack lz4pack.c image.c ../Src/lz4_stream.c
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "image.h"
+#include "lz4_stream.h"
+
+#define HASH_BITS		14
+#define LAST_LITERALS		5	/* LZ4 block format end conditions */
+#define MF_LIMIT		12
+
+static uint32_t hash4(const uint8_t *p)
+{
+	uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+
+	return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static size_t emit_len(uint8_t *out, size_t op, size_t len)
+{
+	while (len >= 255) {
+		out[op++] = 255;
+		len -= 255;
+	}
+	out[op++] = len;
+	return op;
+}
+
+static size_t emit_seq(uint8_t *out, size_t op, const uint8_t *lit,
+		       size_t nlit, uint32_t offset, size_t mlen)
+{
+	size_t ml = mlen ? mlen - LZ4_MIN_MATCH : 0;
+	uint8_t token;
+
+	token = (nlit >= 15 ? 15 : nlit) << 4;
+	if (mlen)
+		token |= ml >= 15 ? 15 : ml;
+	out[op++] = token;
+	if (nlit >= 15)
+		op = emit_len(out, op, nlit - 15);
+	memcpy(out + op, lit, nlit);
+	op += nlit;
+
+	if (!mlen)
+		return op;
+
+	out[op++] = offset;
+	out[op++] = offset >> 8;
+	if (ml >= 15)
+		op = emit_len(out, op, ml - 15);
+	return op;
+}
+
+/* Greedy single-probe LZ4 block compressor, offsets limited to window */
+static size_t lz4_compress(const uint8_t *in, size_t n, uint8_t *out,
+			   uint32_t window)
+{
+	static int64_t table[1 << HASH_BITS];
+	size_t ip = 0, anchor = 0, op = 0, len, k;
+	size_t mflimit = n > MF_LIMIT ? n - MF_LIMIT : 0;
+	int64_t ref;
+	uint32_t h;
+
+	for (k = 0; k < (1 << HASH_BITS); k++)
+		table[k] = -1;
+
+	while (ip < mflimit) {
+		h = hash4(in + ip);
+		ref = table[h];
+		table[h] = ip;
+
+		if (ref < 0 || ip - ref > window || memcmp(in + ref, in + ip, 4)) {
+			ip++;
+			continue;
+		}
+
+		len = LZ4_MIN_MATCH;
+		while (ip + len < n - LAST_LITERALS && in[ref + len] == in[ip + len])
+			len++;
+
+		op = emit_seq(out, op, in + anchor, ip - anchor, ip - ref, len);
+
+		for (k = ip + 1; k < ip + len && k < mflimit; k++)
+			table[hash4(in + k)] = k;
+
+		ip += len;
+		anchor = ip;
+	}
+
+	return emit_seq(out, op, in + anchor, n - anchor, 0, 0);
+}
+
+static uint8_t *check_buf;
+static uint32_t check_size;
+
+static int check_sink(uint32_t offset, const uint8_t *page)
+{
+	uint32_t n = LZ4_PAGE_SIZE;
+
+	if (offset >= check_size)
+		return -1;
+	if (n > check_size - offset)
+		n = check_size - offset;
+	memcpy(check_buf + offset, page, n);
+	return 0;
+}
+
+static int self_test(const uint8_t *in, uint32_t n, const uint8_t *z, size_t zlen)
+{
+	static struct lz4_stream s;
+	struct timespec t0, t1;
+	size_t pos, chunk;
+	double secs;
+	int run, runs = 0;
+
+	check_size = n;
+	check_buf = malloc(n ? n : 1);
+	if (!check_buf)
+		return -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	do {
+		/* Feed in chunks that never line up with sequence boundaries */
+		lz4_stream_init(&s, check_sink);
+		for (pos = 0, run = 0; pos < zlen; pos += chunk, run++) {
+			chunk = 1 + (run * 977) % 4093;
+			if (chunk > zlen - pos)
+				chunk = zlen - pos;
+			if (lz4_stream_decode(&s, z + pos, chunk))
+				goto fail;
+		}
+		if (lz4_stream_finish(&s, 0xFF))
+			goto fail;
+		runs++;
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+	} while (secs < 0.5);
+
+	if (memcmp(check_buf, in, n)) {
+		fprintf(stderr, "self test: output mismatch\n");
+		free(check_buf);
+		return -1;
+	}
+
+	printf("self test OK, decode %.1f MB/s (%d runs)\n",
+	       (double)n * runs / secs / 1e6, runs);
+	free(check_buf);
+	return 0;
+
+fail:
+	fprintf(stderr, "self test: decoder error at stream offset %zu\n", pos);
+	free(check_buf);
+	return -1;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-a addr] [-w window] [-t] input.{bin,hex} output\n"
+		"  -a addr    load address of .bin input (default 0x90000000)\n"
+		"  -w window  max match offset (default %d, must not exceed\n"
+		"             the loader LZ4_WINDOW_SIZE)\n"
+		"  -t         decode again, compare and benchmark\n",
+		prog, LZ4_WINDOW_SIZE);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	struct image img;
+	uint32_t base = 0x90000000, window = LZ4_WINDOW_SIZE, start, lead, n;
+	uint8_t *in, *out;
+	size_t zlen;
+	int opt, test = 0, ret = 0;
+	FILE *f;
+
+	while ((opt = getopt(argc, argv, "a:w:t")) != -1) {
+		switch (opt) {
+		case 'a':
+			base = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			window = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			test = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind != 2)
+		usage(argv[0]);
+
+	if (!window || window > 65535)
+		window = 65535;
+	if (test && window > LZ4_WINDOW_SIZE) {
+		fprintf(stderr, "window %u exceeds decoder window %d\n",
+			window, LZ4_WINDOW_SIZE);
+		return 1;
+	}
+
+	if (image_load(&img, argv[optind], base))
+		return 1;
+
+	/* The stream has to start on a page boundary, pad with erased bytes */
+	start = img.base & ~(LZ4_PAGE_SIZE - 1);
+	lead = img.base - start;
+	n = lead + img.size;
+
+	in = malloc(n ? n : 1);
+	out = malloc(n + n / 255 + 16);
+	if (!in || !out) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	memset(in, 0xFF, lead);
+	memcpy(in + lead, img.data, img.size);
+
+	zlen = lz4_compress(in, n, out, window);
+
+	f = fopen(argv[optind + 1], "wb");
+	if (!f || fwrite(out, 1, zlen, f) != zlen) {
+		perror(argv[optind + 1]);
+		return 1;
+	}
+	fclose(f);
+
+	printf("DestAddr 0x%08x, %u -> %zu bytes (%.2f:1)\n",
+	       start, n, zlen, zlen ? (double)n / zlen : 0.0);
+
+	if (test && self_test(in, n, out, zlen))
+		ret = 1;
+
+	free(in);
+	free(out);
+	image_free(&img);
+	return ret;
+}
@@ -0,0 +1,63 @@
+/*
+ * qspitest - host check of the QUADSPI driver around memory mapped mode
+ *
+ * Runs Src/hal/qspi.c against the controller register model of
+ * Tools/sim/qspi_model.c. Maps the flash and reads it the way Verify()
+ * and Init(3) do, then hands off for XIP the way UnInit() does, and
+ * maps it again. Memory mapped mode keeps BUSY set, a driver that waits
+ * for it to clear without an abort first would hang on the target, the
+ * model counts it as a violation.
+ *
+ * Built and run with "make test" in Tools/.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "flash_bus.h"
+#include "qspi_model.h"
+
+static int fail(const char *msg)
+{
+	fprintf(stderr, "FAIL: %s\n", msg);
+	return 1;
+}
+
+/* A mapped read, as Verify() does it */
+static int mapped_read(uint32_t offset)
+{
+	const uint8_t *mem = qspi_model_flash();
+	uint32_t want = mem[offset] | mem[offset + 1] << 8 |
+		mem[offset + 2] << 16 | (uint32_t)mem[offset + 3] << 24;
+
+	return *QUADSPI_MEM(offset) == want;
+}
+
+int main(void)
+{
+	uint8_t *mem = qspi_model_flash();
+	uint32_t i;
+
+	for (i = 0; i < QSPI_MODEL_SIZE; i++)
+		mem[i] = rand();
+
+	/* UnInit() without a mapping before */
+	if (quadspi_handoff() != QSPI_XIP_MODE || !qspi_model_mapped())
+		return fail("handoff from command mode");
+
+	/* Verify() maps and reads, twice, then UnInit() hands off */
+	quadspi_mmap();
+	if (!mapped_read(0x100))
+		return fail("mapped read");
+	quadspi_mmap_mode(QSPI_XIP_1_1_4);
+	if (!mapped_read(0x2000))
+		return fail("mapped read after a second mapping");
+	if (quadspi_handoff() != QSPI_XIP_MODE || !qspi_model_mapped())
+		return fail("handoff from memory mapped mode");
+	if (!mapped_read(0x40))
+		return fail("read after the handoff");
+
+	if (qspi_model_violations())
+		return fail("controller used while busy in memory mapped mode");
+	printf("qspi mapping OK\n");
+	return 0;
+}
@@ -0,0 +1,395 @@
+/*
+ * replay - replay a call trace of the loader against the flash model
+ *
+ * A loader built with SUPPORT_TRACE=1 records every entry point call of
+ * a download into Trace (see Src/trace.h). Save it after the session,
+ * e.g. with J-Link Commander while the loader is still in RAM:
+ *
+ *	savebin trace.bin <address of Trace> <size of Trace>
+ *
+ * replay feeds the recorded calls through the loader compiled for the
+ * host against the NOR model of Tools/sim and prints where the time of
+ * the session went: per entry point the time on the target and in the
+ * replay, and the time the J-Link DLL spent between the calls (transfer
+ * of the data, its own verify), taken from the timestamps of the halt
+ * proof timer. Init() partly runs on the reset clock, its target time
+ * is a lower bound. Replaying one trace against two loader builds
+ * compares them on the real call pattern.
+ *
+ * Program data is not recorded, the replay programs an address derived
+ * pattern. ProgramCompressed() and ProgramScatter() take their input
+ * from RAM and are only reported, like functions this build lacks.
+ *
+ * With -g a built-in J-Link style session is run and its trace written,
+ * the DLL time between its calls stood in for by halting the model. With
+ * -t that trace is replayed and checked against the recording.
+ *
+ * Built with make in Tools/, "make test" runs replay -t.
+ */
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "FlashOS.h"
+#include "FlashConf.h"
+#include "flash_bus.h"
+#include "trace.h"
+
+#if !SUPPORT_TRACE
+#error replay needs SUPPORT_TRACE=1
+#endif
+
+#define MAX_CALL_LEN	0x10000		/* largest ProgramPage() call replayed */
+
+/* Built-in session: erase, program, fill the tail, hash */
+#define GEN_ADDR		(QSPI_BASE_ADDR + 0x100000)
+#define GEN_SECTORS		16
+#define GEN_PROGRAM		(12 * QSPI_SECTOR_SIZE)
+#define GEN_INIT_US		2000		/* DLL time before Init(), RAMCode download */
+#define GEN_PAGE_US		20			/* before ProgramPage(), page transfer */
+
+extern struct trace_buf Trace;
+extern int FillRange(U32 Addr, U32 NumBytes, U32 Pattern);
+extern int HashRegion(U32 Addr, U32 NumBytes, U8 *pDigest);
+
+static const char *const func_name[TRACE_NUM_FUNCS] = {
+	[TRACE_INIT]				= "Init",
+	[TRACE_UNINIT]				= "UnInit",
+	[TRACE_ERASE_SECTOR]		= "EraseSector",
+	[TRACE_PROGRAM_PAGE]		= "ProgramPage",
+	[TRACE_VERIFY]				= "Verify",
+	[TRACE_BLANK_CHECK]			= "BlankCheck",
+	[TRACE_READ]				= "SEGGER_OPEN_Read",
+	[TRACE_PROGRAM_COMPRESSED]	= "ProgramCompressed",
+	[TRACE_PROGRAM_SCATTER]		= "ProgramScatter",
+	[TRACE_FILL_RANGE]			= "FillRange",
+	[TRACE_HASH_REGION]			= "HashRegion",
+	[TRACE_LATENCY_MAP]			= "LatencyMap",
+};
+
+struct func_stats {
+	uint32_t recs, calls, skipped;
+	uint64_t bytes;
+	uint64_t target;		/* cycles at the trace rate */
+	uint64_t replay;		/* model cycles */
+};
+
+static U8 data[MAX_CALL_LEN];
+
+static void fill_pattern(uint32_t addr, uint32_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i < len; i++)
+		data[i] = (addr + i) * 2654435761u >> 24;
+}
+
+/*
+ * Replays one record, all its calls of len / calls bytes. Returns the
+ * result of the last call, *done = 0 when the record cannot be replayed.
+ */
+static uint32_t replay_rec(const struct trace_rec *r, int *done)
+{
+	uint32_t step = r->calls ? r->len / r->calls : 0, addr = r->addr, i;
+	uint32_t result = 0;
+	U8 digest[32];
+
+	*done = 1;
+	for (i = 0; i < r->calls; i++, addr += step) {
+		switch (r->func) {
+		case TRACE_INIT:
+			result = Init(r->addr, r->len, r->arg);
+			break;
+		case TRACE_UNINIT:
+			result = UnInit(r->arg);
+			break;
+		case TRACE_ERASE_SECTOR:
+			result = EraseSector(addr);
+			break;
+		case TRACE_PROGRAM_PAGE:
+			if (step > MAX_CALL_LEN) {
+				*done = 0;
+				return 0;
+			}
+			fill_pattern(addr, step);
+			result = ProgramPage(addr, step, data);
+			break;
+		case TRACE_FILL_RANGE:
+			result = FillRange(addr, step, r->arg);
+			break;
+		case TRACE_HASH_REGION:
+			result = HashRegion(addr, step, digest);
+			break;
+		default:
+			*done = 0;
+			return 0;
+		}
+	}
+	return result;
+}
+
+/* Oldest record still in the ring, and how many there are */
+static uint32_t ring_first(const struct trace_buf *t, uint32_t *n)
+{
+	*n = t->head < t->num_recs ? t->head : t->num_recs;
+	return t->head > t->num_recs ? t->head % t->num_recs : 0;
+}
+
+/*
+ * Replays a trace, prints the breakdown. The replay is recorded into
+ * Trace, cleared first. *dll receives the DLL time between the calls in
+ * timer ticks. Returns the number of results that differ from the
+ * recording.
+ */
+static int replay(const struct trace_buf *t, uint64_t *dll)
+{
+	struct func_stats stats[TRACE_NUM_FUNCS] = { { 0 } };
+	uint64_t loader = 0, replayed = 0, gaps = 0, in;
+	uint32_t first, n, i, t0, prev_end = 0, span;
+	uint32_t calls = 0, differ = 0, skipped = 0;
+	const struct trace_rec *r;
+	double us = 1e6 / t->cpu_hz, tus = 1e6 / t->timer_hz;
+	int done;
+
+	memset(&Trace, 0, sizeof(Trace));
+	first = ring_first(t, &n);
+	if (t->head > n)
+		printf("# ring wrapped, the first %u records are lost\n", t->head - n);
+
+	for (i = 0; i < n; i++) {
+		uint32_t result;
+
+		r = &t->rec[(first + i) % t->num_recs];
+		if (r->func >= TRACE_NUM_FUNCS || !func_name[r->func]) {
+			fprintf(stderr, "record %u: unknown function %u\n", i, r->func);
+			return -1;
+		}
+
+		/*
+		 * DLL time before the record and between its calls. The timer
+		 * misses part of Init(), the span of a record can be shorter
+		 * than its cycles.
+		 */
+		if (i)
+			gaps += (uint32_t)(r->start - prev_end);
+		span = r->end - r->start;
+		in = (uint64_t)r->cycles * t->timer_hz / t->cpu_hz;
+		if (span > in)
+			gaps += span - in;
+		prev_end = r->end;
+		loader += r->cycles;
+		calls += r->calls;
+
+		stats[r->func].recs++;
+		stats[r->func].calls += r->calls;
+		if (r->func != TRACE_INIT && r->func != TRACE_PROGRAM_SCATTER)
+			stats[r->func].bytes += r->len;		/* not Freq / NumDescs */
+		stats[r->func].target += r->cycles;
+
+		t0 = flash_sim_cycles();
+		result = replay_rec(r, &done);
+		if (!done) {
+			stats[r->func].skipped++;
+			skipped++;
+			continue;
+		}
+		stats[r->func].replay += flash_sim_cycles() - t0;
+		replayed += flash_sim_cycles() - t0;
+		if (result != r->result)
+			differ++;
+	}
+
+	printf("%u records, %u calls, session %.1f ms on the target\n\n", n, calls,
+	       loader * us / 1000 + gaps * tus / 1000);
+	printf("%-18s %7s %7s %10s %11s %11s\n", "function", "records", "calls",
+	       "bytes", "target ms", "replay ms");
+	for (i = 0; i < TRACE_NUM_FUNCS; i++) {
+		struct func_stats *s = &stats[i];
+
+		if (!s->recs)
+			continue;
+		printf("%-18s %7u %7u %10llu %11.1f", func_name[i], s->recs, s->calls,
+		       (unsigned long long)s->bytes, s->target * us / 1000);
+		if (s->skipped == s->recs)
+			printf(" %11s\n", "-");
+		else
+			printf(" %11.1f\n", s->replay * 1000.0 / SIM_CPU_HZ);
+	}
+	printf("%-18s %37.1f %11.1f\n", "loader", loader * us / 1000,
+	       replayed * 1000.0 / SIM_CPU_HZ);
+	printf("%-18s %37.1f\n", "DLL between calls", gaps * tus / 1000);
+	if (stats[TRACE_INIT].recs)
+		printf("# Init() starts on the reset clock, its target time is a lower bound\n");
+	if (skipped)
+		printf("# %u records not replayed (data not in the trace or not in this build)\n",
+		       skipped);
+	if (differ)
+		printf("# %u records returned another result than on the target\n", differ);
+	*dll = gaps;
+	return differ;
+}
+
+/*
+ * J-Link style download of a region, recorded into Trace. Returns the
+ * DLL time it stood in for between the calls, in microseconds.
+ */
+static uint32_t generate(void)
+{
+	U8 digest[32];
+	uint32_t off;
+
+	memset(&Trace, 0, sizeof(Trace));
+	Init(GEN_ADDR, 4000000, 1);
+	for (off = 0; off < GEN_SECTORS * QSPI_SECTOR_SIZE; off += QSPI_SECTOR_SIZE)
+		EraseSector(GEN_ADDR + off);
+	UnInit(1);
+
+	flash_sim_halt(GEN_INIT_US);
+	Init(GEN_ADDR, 4000000, 2);
+	for (off = 0; off < GEN_PROGRAM; off += QSPI_PAGE_SIZE) {
+		fill_pattern(GEN_ADDR + off, QSPI_PAGE_SIZE);
+		flash_sim_halt(GEN_PAGE_US);
+		ProgramPage(GEN_ADDR + off, QSPI_PAGE_SIZE, data);
+	}
+	FillRange(GEN_ADDR + GEN_PROGRAM, GEN_SECTORS * QSPI_SECTOR_SIZE - GEN_PROGRAM,
+		  0x5a5aa5a5);
+	UnInit(2);
+
+	flash_sim_halt(GEN_INIT_US);
+	Init(GEN_ADDR, 4000000, 3);
+	HashRegion(GEN_ADDR, GEN_SECTORS * QSPI_SECTOR_SIZE, digest);
+	UnInit(3);
+
+	return 2 * GEN_INIT_US + GEN_PROGRAM / QSPI_PAGE_SIZE * GEN_PAGE_US;
+}
+
+static int self_test(void)
+{
+	static struct trace_buf rec;
+	uint32_t first, n, i, halted;
+	uint64_t dll;
+
+	halted = generate();
+	rec = Trace;
+	first = ring_first(&rec, &n);
+	/* Init/UnInit x3, one record per run of erases and pages, fill, hash (TRACE_RECS >= 10) */
+	if (n != 10 || rec.rec[(first + 1) % TRACE_RECS].calls != GEN_SECTORS ||
+	    rec.rec[(first + 4) % TRACE_RECS].calls != GEN_PROGRAM / QSPI_PAGE_SIZE) {
+		fprintf(stderr, "adjacent calls not merged, %u records\n", n);
+		return -1;
+	}
+	if (replay(&rec, &dll))
+		return -1;
+	if (dll != (uint64_t)halted * (rec.timer_hz / 1000000)) {
+		fprintf(stderr, "DLL time %llu ticks, %u us expected\n",
+			(unsigned long long)dll, halted);
+		return -1;
+	}
+
+	/* The model is deterministic: the replay has to record the same */
+	for (i = 0; i < n; i++) {
+		const struct trace_rec *a = &rec.rec[(first + i) % TRACE_RECS];
+		const struct trace_rec *b = &Trace.rec[i];
+
+		if (a->func != b->func || a->calls != b->calls || a->addr != b->addr ||
+		    a->len != b->len || a->arg != b->arg || a->result != b->result ||
+		    a->cycles != b->cycles) {
+			fprintf(stderr, "record %u (%s) replayed differently\n", i,
+				func_name[a->func]);
+			return -1;
+		}
+	}
+	printf("replay OK\n");
+	return 0;
+}
+
+static int save(const char *name)
+{
+	FILE *f = fopen(name, "wb");
+
+	if (!f || fwrite(&Trace, sizeof(Trace), 1, f) != 1) {
+		perror(name);
+		return -1;
+	}
+	return fclose(f);
+}
+
+static struct trace_buf *load(const char *name)
+{
+	struct trace_buf hdr, *t;
+	size_t size;
+	FILE *f = fopen(name, "rb");
+
+	if (!f) {
+		perror(name);
+		return NULL;
+	}
+	if (fread(&hdr, offsetof(struct trace_buf, rec), 1, f) != 1 ||
+	    hdr.magic != TRACE_MAGIC || hdr.rec_size != sizeof(struct trace_rec) ||
+	    !hdr.num_recs || !hdr.cpu_hz || !hdr.timer_hz) {
+		fprintf(stderr, "%s: not a loader trace\n", name);
+		fclose(f);
+		return NULL;
+	}
+	size = offsetof(struct trace_buf, rec) + hdr.num_recs * sizeof(struct trace_rec);
+	t = malloc(size);
+	rewind(f);
+	if (!t || fread(t, size, 1, f) != 1) {
+		fprintf(stderr, "%s: truncated\n", name);
+		free(t);
+		t = NULL;
+	}
+	fclose(f);
+	return t;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s trace.bin\n"
+		"       %s -g trace.bin\n"
+		"       %s -t\n"
+		"  -g file    run the built-in session and save its trace\n"
+		"  -t         replay the built-in session and check it\n",
+		prog, prog, prog);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	const char *gen = NULL;
+	struct trace_buf *t;
+	uint64_t dll;
+	int opt, test = 0, r;
+
+	while ((opt = getopt(argc, argv, "g:t")) != -1) {
+		switch (opt) {
+		case 'g':
+			gen = optarg;
+			break;
+		case 't':
+			test = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!test && !gen && argc - optind != 1)
+		usage(argv[0]);
+
+	if (test)
+		return self_test() ? 1 : 0;
+	if (gen) {
+		generate();
+		return save(gen) ? 1 : 0;
+	}
+
+	t = load(argv[optind]);
+	if (!t)
+		return 1;
+	r = replay(t, &dll);
+	free(t);
+	return r < 0 ? 1 : 0;
+}
@@ -0,0 +1,381 @@
+/*
+ * flash_sim - host model of the QUADSPI NOR flash, see flash_sim.h
+ *
+ * Also provides the board hooks FlashPrg.c calls from Init(), so that the
+ * loader links on the host without Src/qspi_init.c and Src/hal/board.c.
+ *
+ * The benchmark harness (Src/main.c) is built for Linux as Tools/bench by
+ * make in Tools/.
+ */
+#include <string.h>
+
+#include "flash_bus.h"
+#include "latency.h"
+
+#define SIM_US(us)		((uint32_t)((uint64_t)(us) * (SIM_CPU_HZ / 1000000)))
+
+/* Lines used for instruction, address and data of one command */
+struct sim_lines {
+	uint8_t inst, addr, data, dummy;
+};
+
+/* Page program per QSPI_MODE_* */
+static const struct sim_lines sim_prog[] = {
+	[QSPI_MODE_1_1_4] = { 1, 1, 4, 0 },
+	[QSPI_MODE_1_4_4] = { 1, 4, 4, 0 },
+	[QSPI_MODE_QPI]   = { 4, 4, 4, 0 },
+};
+
+/* Memory mapped read per QSPI_XIP_*, instruction 0 = sent once */
+static const struct sim_lines sim_read[] = {
+	[QSPI_XIP_1_4_4_CONT] = { 0, 4, 4, 6 },
+	[QSPI_XIP_1_4_4]      = { 1, 4, 4, 6 },
+	[QSPI_XIP_1_1_4]      = { 1, 1, 4, 8 },
+	[QSPI_XIP_1_1_1]      = { 1, 1, 1, 8 },
+};
+
+static uint8_t sim_mem[SIM_FLASH_SIZE] __attribute__((aligned(4)));
+static int sim_powered;
+static int sim_prog_mode;
+static int sim_read_mode;
+static uint32_t sim_clock;
+
+/*
+ * Per die state. active is an erase or page program running in the
+ * background of the clock, addr is the sector of an erase or ~0 for a
+ * page program.
+ */
+struct sim_die {
+	int active;
+	int suspended;
+	uint32_t addr;
+	uint32_t left;		/* cycles of tSE/tPP still to run */
+	uint32_t resumed;	/* clock of the last start or resume */
+};
+
+static struct sim_die sim_dies[SIM_MAX_DIES];
+static int sim_num_dies = 1;
+static int sim_die_sel;		/* die status/suspend/resume commands go to */
+static uint32_t sim_violations;
+static uint16_t sim_t_se_ms[SIM_FLASH_SIZE / SIM_SECTOR_SIZE];	/* 0 = SIM_T_SE_US */
+
+static int sim_die_of(uint32_t offset)
+{
+	return offset / (SIM_FLASH_SIZE / sim_num_dies);
+}
+
+int flash_sim_die_of(uint32_t address)
+{
+	return sim_die_of(address % SIM_FLASH_SIZE);
+}
+
+static void sim_die_done(struct sim_die *d)
+{
+	if (d->addr != ~0u)
+		memset(sim_mem + d->addr, 0xff, SIM_SECTOR_SIZE);
+	d->active = 0;
+}
+
+/* Advance time, running operations complete in the background */
+static void sim_advance(uint32_t cycles)
+{
+	struct sim_die *d;
+
+	sim_clock += cycles;
+
+	for (d = sim_dies; d < sim_dies + sim_num_dies; d++) {
+		if (!d->active || d->suspended)
+			continue;
+		if (cycles >= d->left)
+			sim_die_done(d);
+		else
+			d->left -= cycles;
+	}
+}
+
+/* Operations that need an idle die, the part would ignore them */
+static struct sim_die *sim_check_idle(uint32_t offset)
+{
+	struct sim_die *d = &sim_dies[sim_die_of(offset)];
+
+	if (d->active)
+		sim_violations++;
+	return d;
+}
+
+/* CPU cycles of one command with len data bytes */
+static uint32_t sim_cmd_cycles(const struct sim_lines *l, uint32_t len)
+{
+	uint32_t clk = 0;
+
+	if (l->inst)
+		clk += 8 / l->inst;
+	if (l->addr)
+		clk += 24 / l->addr;
+	clk += l->dummy + len * 8 / l->data;
+
+	return SIM_CMD_OVERHEAD + clk * SIM_BUS_DIV;
+}
+
+/* Write enable, the polls around it and the final WIP poll */
+static uint32_t sim_wren_cycles(void)
+{
+	static const struct sim_lines status = { 1, 0, 1, 0 };
+	static const struct sim_lines wren = { 1, 0, 1, 0 };
+
+	return sim_cmd_cycles(&wren, 0) + 2 * sim_cmd_cycles(&status, 1);
+}
+
+/* Software die select, only sent when the die changes */
+static void sim_select(int die)
+{
+	static const struct sim_lines select = { 1, 0, 1, 0 };
+
+	if (sim_num_dies > 1 && die != sim_die_sel)
+		sim_advance(sim_cmd_cycles(&select, 1));
+	sim_die_sel = die;
+}
+
+void flash_sim_init(void)
+{
+	/* The array keeps its content across Init()/UnInit() like the part */
+	if (!sim_powered) {
+		memset(sim_mem, 0xff, sizeof(sim_mem));
+		sim_powered = 1;
+	}
+	sim_prog_mode = QSPI_MODE_1_1_4;
+	sim_read_mode = QSPI_XIP_1_1_1;
+}
+
+/* Stacked-die part, SIM_FLASH_SIZE split evenly. Call with all dies idle. */
+void flash_sim_set_dies(int dies)
+{
+	if (dies < 1 || dies > SIM_MAX_DIES)
+		dies = 1;
+	sim_num_dies = dies;
+	sim_die_sel = 0;
+}
+
+int flash_sim_num_dies(void)
+{
+	return sim_num_dies;
+}
+
+void flash_sim_set_mode(int mode)
+{
+	sim_prog_mode = mode;
+}
+
+int flash_sim_erase_sector(uint32_t address)
+{
+	static const struct sim_lines erase = { 1, 1, 1, 0 };
+	uint32_t start, t_se;
+
+	if (address >= SIM_FLASH_SIZE)
+		return -1;
+
+	sim_check_idle(address);
+	sim_select(sim_die_of(address));
+
+	address &= ~(SIM_SECTOR_SIZE - 1);
+	memset(sim_mem + address, 0xff, SIM_SECTOR_SIZE);
+
+	sim_advance(sim_wren_cycles() + sim_cmd_cycles(&erase, 0));
+	start = latency_start();
+	t_se = sim_t_se_ms[address / SIM_SECTOR_SIZE];
+	sim_advance(t_se ? SIM_US(t_se * 1000) : SIM_US(SIM_T_SE_US));
+	latency_erase(address, start);
+	return 0;
+}
+
+/* Erase time of one sector for the blocking erase, 0 = SIM_T_SE_US */
+void flash_sim_set_erase_ms(uint32_t address, int ms)
+{
+	if (address < SIM_FLASH_SIZE)
+		sim_t_se_ms[address / SIM_SECTOR_SIZE] = ms;
+}
+
+int flash_sim_erase_start(uint32_t address)
+{
+	static const struct sim_lines erase = { 1, 1, 1, 0 };
+	struct sim_die *d;
+
+	if (address >= SIM_FLASH_SIZE)
+		return -1;
+
+	d = sim_check_idle(address);
+	sim_select(sim_die_of(address));
+
+	/* Write enable and the command itself, tSE runs from here */
+	sim_advance(sim_wren_cycles() + sim_cmd_cycles(&erase, 0));
+
+	d->addr = address & ~(SIM_SECTOR_SIZE - 1);
+	memset(sim_mem + d->addr, 0x00, SIM_SECTOR_SIZE);
+	d->active = 1;
+	d->suspended = 0;
+	d->left = SIM_US(SIM_T_SE_US);
+	d->resumed = sim_clock;
+	return 0;
+}
+
+/* Page program on one die without waiting, see flash_sim_die_busy() */
+int flash_sim_write_start(uint32_t address, const uint8_t *data)
+{
+	struct sim_die *d;
+	uint32_t i;
+
+	if (address & (SIM_PAGE_SIZE - 1) || address >= SIM_FLASH_SIZE)
+		return -1;
+
+	d = sim_check_idle(address);
+	sim_select(sim_die_of(address));
+
+	sim_advance(sim_wren_cycles() +
+		sim_cmd_cycles(&sim_prog[sim_prog_mode], SIM_PAGE_SIZE));
+
+	for (i = 0; i < SIM_PAGE_SIZE; i++)
+		sim_mem[address + i] &= data[i];
+	d->addr = ~0u;
+	d->active = 1;
+	d->suspended = 0;
+	d->left = SIM_US(SIM_T_PP_US);
+	d->resumed = sim_clock;
+	return 0;
+}
+
+/* One status register read of the selected die, WIP is clear while suspended */
+int flash_sim_busy(void)
+{
+	static const struct sim_lines status = { 1, 0, 1, 0 };
+	struct sim_die *d = &sim_dies[sim_die_sel];
+
+	sim_advance(sim_cmd_cycles(&status, 1));
+
+	return d->active && !d->suspended;
+}
+
+/* Select a die and read its status */
+int flash_sim_die_busy(int die)
+{
+	sim_select(die);
+	return flash_sim_busy();
+}
+
+void flash_sim_erase_suspend(void)
+{
+	static const struct sim_lines cmd = { 1, 0, 1, 0 };
+	struct sim_die *d = &sim_dies[sim_die_sel];
+
+	if (!d->active || d->suspended || d->addr == ~0u)
+		return;
+	if (sim_clock - d->resumed < SIM_US(SIM_T_RS_US))
+		sim_violations++;
+
+	/* The erase keeps running until the suspend took effect */
+	sim_advance(sim_cmd_cycles(&cmd, 0) + SIM_US(SIM_T_SUS_US));
+	if (d->active)
+		d->suspended = 1;
+}
+
+void flash_sim_erase_resume(void)
+{
+	static const struct sim_lines cmd = { 1, 0, 1, 0 };
+	struct sim_die *d = &sim_dies[sim_die_sel];
+
+	if (!d->active || !d->suspended) {
+		sim_advance(sim_cmd_cycles(&cmd, 0));
+		return;
+	}
+
+	d->suspended = 0;
+	sim_advance(sim_cmd_cycles(&cmd, 0));
+	d->resumed = sim_clock;
+}
+
+uint32_t flash_sim_violations(void)
+{
+	return sim_violations;
+}
+
+int flash_sim_write(uint32_t address, const uint8_t *data, int len)
+{
+	static const struct sim_lines verify = { 1, 1, 4, 8 };
+	uint32_t i, start;
+	int done;
+
+	if (address & (SIM_PAGE_SIZE - 1) || address + len > SIM_FLASH_SIZE)
+		return 0;
+
+	sim_check_idle(address);
+	sim_select(sim_die_of(address));
+
+	/* Whole pages as the QUADSPI driver, NOR program only clears bits */
+	for (done = 0; done < len; done += SIM_PAGE_SIZE) {
+		for (i = 0; i < SIM_PAGE_SIZE; i++)
+			sim_mem[address + i] &= data[done + i];
+
+		sim_advance(sim_wren_cycles() +
+			sim_cmd_cycles(&sim_prog[sim_prog_mode], SIM_PAGE_SIZE));
+		start = latency_start();
+		sim_advance(SIM_US(SIM_T_PP_US));
+		latency_page(start);
+
+#if FLASH_BUS_VERIFY_ON_WRITE
+		sim_advance(sim_cmd_cycles(&verify, SIM_PAGE_SIZE));
+		for (i = 0; i < SIM_PAGE_SIZE; i++)
+			if (sim_mem[address + i] != data[done + i])
+				return done + i;
+#else
+		(void)verify;
+#endif
+		address += SIM_PAGE_SIZE;
+	}
+
+	return len;
+}
+
+void flash_sim_mmap_mode(int mode)
+{
+	sim_read_mode = mode;
+}
+
+/*
+ * Reads are only allowed from an idle die, or a suspended one outside the
+ * erasing sector
+ */
+const uint8_t *flash_sim_ptr(uint32_t address)
+{
+	uint32_t offset = (address - SIM_MEM_BASE) % SIM_FLASH_SIZE;
+	struct sim_die *d = &sim_dies[sim_die_of(offset)];
+
+	if (d->active && (!d->suspended ||
+	    (offset & ~(SIM_SECTOR_SIZE - 1)) == d->addr))
+		sim_violations++;
+
+	return sim_mem + offset;
+}
+
+/* Charge a sequential memory mapped read of len bytes */
+void flash_sim_account_read(uint32_t len)
+{
+	sim_advance(sim_cmd_cycles(&sim_read[sim_read_mode], len));
+}
+
+uint32_t flash_sim_cycles(void)
+{
+	return sim_clock;
+}
+
+void flash_sim_halt(uint32_t us)
+{
+	sim_advance(us * (SIM_CPU_HZ / 1000000));
+}
+
+/* Board hooks of Init(), there is nothing to set up on the host */
+void clock_setup(void)
+{
+}
+
+void board_init_flash_pins(void)
+{
+}
@@ -0,0 +1,79 @@
+#ifndef _FLASH_SIM_H
+#define _FLASH_SIM_H
+
+#include <stdint.h>
+
+/*
+ * Host model of a quad SPI NOR flash (W25Q64 class) behind the QUADSPI
+ * controller, selected with FLASH_BUS_SIM=1 in flash_bus.h. The array is
+ * plain RAM with NOR semantics: erase sets a 4KB sector to 0xFF, page
+ * program can only clear bits. Like the drivers, writes are whole pages.
+ *
+ * Time is virtual. Every operation advances a CPU cycle counter by the
+ * bus transfer time of its commands in the current mode plus the typical
+ * tSE/tPP of the part, so that code timing itself with DWT CYCCNT on the
+ * target can use flash_sim_cycles() on the host.
+ *
+ * flash_sim_erase_start() runs the erase in the background of that clock:
+ * the sector reads 0x00 until tSE has passed, and every other operation
+ * is a protocol violation while it runs. A suspend takes tSUS, after which
+ * everything but the erasing sector may be read; the erase only makes
+ * progress while not suspended and suspending again less than tRS after a
+ * resume is a violation as well. flash_sim_violations() counts them.
+ *
+ * flash_sim_set_dies() turns the model into a stacked-die part with one
+ * WIP per die (software die select, like W25M). flash_sim_write_start()
+ * and flash_sim_erase_start() only keep their own die busy, any access
+ * to a busy die is a violation.
+ *
+ * flash_sim_set_erase_ms() makes the blocking erase of one sector slower
+ * or faster than tSE, like a worn or marginal sector.
+ *
+ * flash_sim_halt() lets time pass outside the loader, as while the core
+ * is halted and the J-Link DLL works. Background operations go on.
+ */
+#define SIM_MEM_BASE				0x90000000	/* memory mapped window */
+#define SIM_FLASH_SIZE				0x00800000
+#define SIM_SECTOR_SIZE				0x1000
+#define SIM_PAGE_SIZE				256
+#define SIM_MAX_DIES				4
+
+#define SIM_CPU_HZ					320000000	/* CYCCNT rate after clock_setup() */
+#define SIM_BUS_DIV					4			/* CPU clocks per QUADSPI clock */
+#define SIM_CMD_OVERHEAD			40			/* CPU clocks of register setup per command */
+
+#ifndef SIM_T_SE_US
+#define SIM_T_SE_US					45000		/* 4KB sector erase */
+#endif
+#ifndef SIM_T_PP_US
+#define SIM_T_PP_US					400			/* page program */
+#endif
+#ifndef SIM_T_SUS_US
+#define SIM_T_SUS_US				20			/* erase suspend latency */
+#endif
+#ifndef SIM_T_RS_US
+#define SIM_T_RS_US					100			/* minimum resume to suspend */
+#endif
+
+void flash_sim_init(void);
+void flash_sim_set_mode(int mode);
+int flash_sim_erase_sector(uint32_t address);
+int flash_sim_write(uint32_t address, const uint8_t *data, int len);
+void flash_sim_mmap_mode(int mode);
+const uint8_t *flash_sim_ptr(uint32_t address);
+void flash_sim_account_read(uint32_t len);
+uint32_t flash_sim_cycles(void);
+void flash_sim_halt(uint32_t us);
+int flash_sim_erase_start(uint32_t address);
+int flash_sim_busy(void);
+void flash_sim_erase_suspend(void);
+void flash_sim_erase_resume(void);
+uint32_t flash_sim_violations(void);
+void flash_sim_set_dies(int dies);
+int flash_sim_num_dies(void);
+int flash_sim_die_of(uint32_t address);
+int flash_sim_write_start(uint32_t address, const uint8_t *data);
+int flash_sim_die_busy(int die);
+void flash_sim_set_erase_ms(uint32_t address, int ms);
+
+#endif /* _FLASH_SIM_H */
@@ -0,0 +1,193 @@
+/*
+ * qspi_model - host model of the STM32H7 QUADSPI controller registers
+ *
+ * Src/hal/qspi.c built with QSPI_REG_MODEL=1 reaches every register
+ * through qspi_model_reg(). Each call first applies what the driver
+ * stored through the register handed out last, then hands out the next
+ * one. A store is seen when it changes the register or when it clears
+ * the marker the model keeps in the upper half of the 64-bit host
+ * unsigned long, so that a plain store of the same value counts too.
+ *
+ * Covered is what mapping the flash and the XIP handoff use: commands
+ * without data, indirect reads taken with 32-bit DR reads, status
+ * polling (the memory is always ready), memory mapped mode and abort.
+ * As on the controller, memory mapped mode sets BUSY with the first
+ * access and keeps it until an abort. A driver waiting for BUSY to clear
+ * then never gets on, the model counts a violation and goes on as if it
+ * had aborted.
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include "qspi.h"
+#include "qspi_model.h"
+
+#define MODEL_REGS		(0x34 / 4)
+#define MODEL_MARK		0x5a5a5a5a00000000UL
+#define MODEL_FIFO		(256 / 4)
+#define MODEL_SPIN		10000		/* BUSY reads with nothing to wait for */
+
+#define REG_CR			(0x00 / 4)
+#define REG_SR			(0x08 / 4)
+#define REG_FCR			(0x0c / 4)
+#define REG_DLR			(0x10 / 4)
+#define REG_CCR			(0x14 / 4)
+#define REG_AR			(0x18 / 4)
+#define REG_DR			(0x20 / 4)
+
+_Static_assert(sizeof(unsigned long) == 8, "the store marker needs a 64-bit long");
+
+static volatile unsigned long model_reg[MODEL_REGS];
+static uint32_t model_val[MODEL_REGS];	/* as seen by the model */
+static int model_last = -1;				/* register handed out last */
+static unsigned long model_out;			/* and its value then */
+
+static uint32_t model_mem[QSPI_MODEL_SIZE / 4];
+static uint32_t model_fifo[MODEL_FIFO];
+static int model_fifo_head, model_fifo_len;
+static int model_busy, model_mapped;
+static uint32_t model_spin, model_violations;
+
+static uint32_t model_sr(void)
+{
+	return model_val[REG_SR] | (model_busy ? QUADSPI_SR_BUSY : 0);
+}
+
+/* A command starts with CCR, or with AR when it has an address phase */
+static void model_start(uint32_t ccr, uint32_t address)
+{
+	uint32_t fmode = ccr & QUADSPI_CCR_FMODE_MASK, i, n;
+	const uint8_t *mem = (const uint8_t *)model_mem;
+
+	model_busy = 1;
+	switch (fmode) {
+	case QUADSPI_CCR_FMODE_IND_RD:
+		n = ccr & QUADSPI_CCR_DMODE_MASK ? (model_val[REG_DLR] + 4) / 4 : 0;
+		if (n > MODEL_FIFO)
+			n = MODEL_FIFO;
+		for (i = 0; i < n; i++)
+			memcpy(&model_fifo[i], mem + (address + 4 * i) % QSPI_MODEL_SIZE, 4);
+		model_fifo_head = 0;
+		model_fifo_len = n;
+		model_val[REG_SR] |= QUADSPI_SR_TCF;
+		model_busy = n != 0;
+		break;
+	case QUADSPI_CCR_FMODE_AUTO_POLL:
+		model_val[REG_SR] |= QUADSPI_SR_SMF;
+		model_busy = 0;
+		break;
+	default:
+		/* Writes without data, the cases mapping and handoff issue */
+		model_val[REG_SR] |= QUADSPI_SR_TCF;
+		model_busy = 0;
+		break;
+	}
+}
+
+static void model_store(int reg, uint32_t val)
+{
+	switch (reg) {
+	case REG_CR:
+		if (val & QUADSPI_CR_ABORT) {
+			val &= ~QUADSPI_CR_ABORT;
+			model_busy = 0;
+			model_mapped = 0;
+			model_fifo_len = 0;
+		}
+		model_val[reg] = val;
+		break;
+	case REG_FCR:
+		model_val[REG_SR] &= ~val;
+		break;
+	case REG_CCR:
+		/* The controller ignores CCR while busy */
+		if (model_busy) {
+			model_violations++;
+			break;
+		}
+		model_val[reg] = val;
+		if ((val & QUADSPI_CCR_FMODE_MASK) == QUADSPI_CCR_FMODE_MEMMAP)
+			model_mapped = 1;
+		else if (!(val & QUADSPI_CCR_ADMODE_MASK))
+			model_start(val, 0);
+		break;
+	case REG_AR:
+		model_val[reg] = val;
+		if (!model_busy && !model_mapped)
+			model_start(model_val[REG_CCR], val);
+		break;
+	case REG_SR:
+	case REG_DR:
+		break;
+	default:
+		model_val[reg] = val;
+		break;
+	}
+}
+
+/* Apply a store through the register handed out last */
+static void model_flush(void)
+{
+	unsigned long v;
+
+	if (model_last >= 0) {
+		v = model_reg[model_last];
+		if (v != model_out)
+			model_store(model_last, (uint32_t)v);
+		model_last = -1;
+	}
+}
+
+volatile unsigned long *qspi_model_reg(unsigned int offset)
+{
+	int reg = offset / 4;
+
+	model_flush();
+
+	if (reg == REG_SR && model_busy && model_mapped && !model_fifo_len) {
+		/* Would hang on the target, go on as after an abort */
+		if (++model_spin == MODEL_SPIN) {
+			model_violations++;
+			model_busy = 0;
+			model_mapped = 0;
+		}
+	} else {
+		model_spin = 0;
+	}
+
+	if (reg == REG_DR && model_fifo_len) {
+		model_val[REG_DR] = model_fifo[model_fifo_head++];
+		if (!--model_fifo_len)
+			model_busy = 0;
+	}
+
+	model_last = reg;
+	model_out = MODEL_MARK | (reg == REG_SR ? model_sr() : model_val[reg]);
+	model_reg[reg] = model_out;
+	return &model_reg[reg];
+}
+
+volatile uint32_t *qspi_model_mem(uint32_t offset)
+{
+	model_flush();
+	if (!model_mapped)
+		model_violations++;
+	model_busy = 1;
+
+	return &model_mem[(offset % QSPI_MODEL_SIZE) / 4];
+}
+
+uint8_t *qspi_model_flash(void)
+{
+	return (uint8_t *)model_mem;
+}
+
+int qspi_model_mapped(void)
+{
+	return model_mapped;
+}
+
+uint32_t qspi_model_violations(void)
+{
+	return model_violations;
+}
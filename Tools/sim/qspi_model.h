@@ -0,0 +1,20 @@
+#ifndef _QSPI_MODEL_H
+#define _QSPI_MODEL_H
+
+#include <stdint.h>
+
+/*
+ * Host model of the QUADSPI controller registers for Src/hal/qspi.c
+ * built with QSPI_REG_MODEL=1, see qspi_model.c. The memory behind it is
+ * QSPI_MODEL_SIZE bytes, repeated over the address range.
+ */
+#define QSPI_MODEL_SIZE				0x10000
+
+/* Memory content, for the check to fill */
+uint8_t *qspi_model_flash(void);
+/* Memory mapped mode set up and not aborted */
+int qspi_model_mapped(void);
+/* Commands started while busy, BUSY waits in memory mapped mode */
+uint32_t qspi_model_violations(void);
+
+#endif /* _QSPI_MODEL_H */
@@ -0,0 +1,74 @@
+/*
+ * sim_test - shared helpers of the host checks, see sim_test.h
+ */
+#include <stdio.h>
+
+#include "sim_test.h"
+
+int sim_fail(const char *msg)
+{
+	fprintf(stderr, "%s\n", msg);
+	return 1;
+}
+
+int sim_blank(const uint8_t *p, uint32_t len)
+{
+	while (len--)
+		if (*p++ != 0xff)
+			return 0;
+	return 1;
+}
+
+int sim_check_suspend(void)
+{
+	uint32_t sector = 0x200000, v;
+
+	v = flash_sim_violations();
+	flash_sim_erase_start(sector);
+	flash_sim_ptr(SIM_MEM_BASE + sector + SIM_SECTOR_SIZE);
+	if (flash_sim_violations() != v + 1)
+		return sim_fail("model: read during a running erase not flagged");
+
+	flash_sim_erase_suspend();
+	if (flash_sim_violations() != v + 2)
+		return sim_fail("model: suspend right after the erase start not flagged");
+	if (flash_sim_busy())
+		return sim_fail("model: WIP set while suspended");
+
+	flash_sim_ptr(SIM_MEM_BASE + sector + SIM_SECTOR_SIZE);
+	if (flash_sim_violations() != v + 2)
+		return sim_fail("model: read of another sector while suspended flagged");
+	flash_sim_ptr(SIM_MEM_BASE + sector + 16);
+	if (flash_sim_violations() != v + 3)
+		return sim_fail("model: read of the erasing sector not flagged");
+
+	flash_sim_erase_resume();
+	while (flash_sim_busy());
+	if (flash_sim_ptr(SIM_MEM_BASE + sector)[SIM_SECTOR_SIZE - 1] != 0xff)
+		return sim_fail("model: sector not erased after resume");
+	return 0;
+}
+
+int sim_check_dies(void)
+{
+	static const uint8_t page[SIM_PAGE_SIZE];
+	uint32_t die_size = SIM_FLASH_SIZE / flash_sim_num_dies();
+	uint32_t v = flash_sim_violations();
+
+	flash_sim_write_start(0x1000, page);
+	flash_sim_ptr(SIM_MEM_BASE + die_size);
+	if (flash_sim_violations() != v)
+		return sim_fail("model: read of the idle die flagged");
+	flash_sim_ptr(SIM_MEM_BASE + 0x2000);
+	if (flash_sim_violations() != v + 1)
+		return sim_fail("model: read of the busy die not flagged");
+	flash_sim_erase_start(die_size);
+	if (flash_sim_violations() != v + 1)
+		return sim_fail("model: erase of the idle die flagged");
+	flash_sim_write_start(0x1100, page);
+	if (flash_sim_violations() != v + 2)
+		return sim_fail("model: program of the busy die not flagged");
+
+	while (flash_sim_die_busy(0) || flash_sim_die_busy(1));
+	return 0;
+}
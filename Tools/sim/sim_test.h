@@ -0,0 +1,26 @@
+#ifndef _SIM_TEST_H
+#define _SIM_TEST_H
+
+#include <stdint.h>
+#include "flash_sim.h"
+
+/*
+ * Shared parts of the host checks that link the loader against the flash
+ * model (erasetest, dietest, hashtest, journaltest, latencytest). They
+ * are built and run by "make test" in Tools/.
+ *
+ * sim_check_suspend() and sim_check_dies() make sure the model flags the
+ * protocol errors a check relies on it to catch, before the loader runs.
+ */
+#define SIM_CYCLES_US(cycles)		((cycles) / (SIM_CPU_HZ / 1000000))
+
+/* Print msg to stderr, returns 1 for "return sim_fail(...)" from main() */
+int sim_fail(const char *msg);
+int sim_blank(const uint8_t *p, uint32_t len);
+
+/* Erase suspend rules, on a single die model */
+int sim_check_suspend(void);
+/* Per-die WIP, after flash_sim_set_dies(2) */
+int sim_check_dies(void);
+
+#endif /* _SIM_TEST_H */